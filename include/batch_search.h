@@ -0,0 +1,92 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: batch_search.h
+ *
+ * Purpose:
+ * Cosine scoring of many queries against one embedding database at once.
+ *
+ * Scoring query by query reads the whole database once per query. Here a
+ * block of queries and a block of database rows are multiplied in one
+ * cv::gemm call (Q x d times d x N), so every row loaded into cache is
+ * used by all the queries in the block. Dot products become cosine
+ * distances by dividing by the precomputed norms, and each query keeps a
+ * bounded heap of its k best rows, so the Q x N score matrix is never
+ * stored whole.
+ */
+
+#ifndef BATCH_SEARCH_H
+#define BATCH_SEARCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "utils.h"
+
+// Queries per block of the product (rows of one gemm call)
+const int GEMM_QUERY_BLOCK = 256;
+
+// Database rows per block of the product (a 256 x 4096 score block is 4 MB)
+const int GEMM_DB_BLOCK = 4096;
+
+/**
+ * One database row in a query's result list
+ */
+struct BatchMatch
+{
+    size_t row = 0;         // row of the database matrix
+    float distance = 0.0f;  // cosine distance, in [0, 2]
+};
+
+/**
+ * Result order: nearer first, ties by row (the order of MatchSelector)
+ */
+inline bool nearerMatch(const BatchMatch &a, const BatchMatch &b)
+{
+    return a.distance < b.distance || (a.distance == b.distance && a.row < b.row);
+}
+
+/**
+ * Offer a match to a bounded heap of the `keep` nearest
+ *
+ * The heap is a max-heap under nearerMatch, so the worst kept match is on
+ * top; std::sort_heap(heap.begin(), heap.end(), nearerMatch) turns it into
+ * a list, nearest first.
+ */
+inline void keepNearest(std::vector<BatchMatch> &heap, const BatchMatch &match, size_t keep)
+{
+    if (heap.size() < keep)
+    {
+        heap.push_back(match);
+        std::push_heap(heap.begin(), heap.end(), nearerMatch);
+    }
+    else if (nearerMatch(match, heap.front()))
+    {
+        std::pop_heap(heap.begin(), heap.end(), nearerMatch);
+        heap.back() = match;
+        std::push_heap(heap.begin(), heap.end(), nearerMatch);
+    }
+}
+
+/**
+ * k nearest database rows of every query by cosine distance
+ *
+ * @param queries Query embeddings, packed with row norms (see packFeatureDatabase)
+ * @param db Database embeddings, packed with row norms, same dim as queries
+ * @param k Matches to keep per query
+ * @param matches Output: matches[q] holds min(k, db.rows) matches of query
+ *                q, nearest first
+ * @return 0 on success, -1 if the inputs do not fit together
+ *
+ * Query blocks run in parallel (cv::parallel_for_). Distances agree with
+ * distanceCosine up to float rounding (the gemm sums in its own order);
+ * rows with a zero norm get the maximum distance 1, as there.
+ *
+ * Example (all-vs-all over one database):
+ *   std::vector<std::vector<BatchMatch>> matches;
+ *   cosineTopKGemm(matrix, matrix, 6, matches);
+ */
+int cosineTopKGemm(const FeatureMatrix &queries, const FeatureMatrix &db, int k,
+                   std::vector<std::vector<BatchMatch>> &matches);
+
+#endif // BATCH_SEARCH_H
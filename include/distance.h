@@ -11,8 +11,51 @@
 #ifndef DISTANCE_H
 #define DISTANCE_H
 
+#include <cstddef>
 #include <vector>
 
+/**
+ * Non-owning view of a feature vector, or of a slice of one
+ *
+ * Composite distances (multi-histogram, texture + colour, custom) slice
+ * their parts out of the parent row with slice() instead of copying them
+ * into new vectors. A view is two words; pass it by value.
+ *
+ * Example:
+ *   FeatureView row(db[i].feature);
+ *   float d = distanceHistogramIntersection(row.slice(0, 256), target.slice(0, 256));
+ */
+struct FeatureView
+{
+    const float *data = nullptr;
+    size_t size = 0;
+
+    FeatureView() = default;
+    FeatureView(const float *data, size_t size) : data(data), size(size) {}
+    FeatureView(const std::vector<float> &feature) : data(feature.data()), size(feature.size()) {}
+
+    FeatureView slice(size_t offset, size_t length) const { return FeatureView(data + offset, length); }
+    float operator[](size_t i) const { return data[i]; }
+};
+
+/**
+ * Check that two feature vectors can be compared
+ *
+ * @param feature1 First feature vector
+ * @param feature2 Second feature vector
+ * @param expectedSize Required length, or 0 for "any length, as long as
+ *                     both match and are non-empty"
+ * @param what Name used in the error message (e.g. "Histogram")
+ * @return true if they can be compared; false after printing the reason
+ *
+ * The FeatureView overloads below do no checking of their own: callers
+ * validate once (per query, or per database) with this, and the per-row
+ * path is left with just the arithmetic. The std::vector overloads still
+ * validate on every call.
+ */
+bool validateFeaturePair(FeatureView feature1, FeatureView feature2,
+                         size_t expectedSize, const char *what);
+
 /**
  * Sum of Squared Differences (SSD) distance metric
  *
@@ -94,6 +137,11 @@
 float distanceSSD(const std::vector<float> &feature1,
                   const std::vector<float> &feature2);
 
+/**
+ * SSD over views (unchecked: both must have the same length)
+ */
+float distanceSSD(FeatureView feature1, FeatureView feature2);
+
 
 /**
  * Histogram Intersection distance metric
@@ -157,6 +205,11 @@ float distanceSSD(const std::vector<float> &feature1,
 float distanceHistogramIntersection(const std::vector<float> &feature1,
                                      const std::vector<float> &feature2);
 
+/**
+ * Histogram intersection over views (unchecked: same length)
+ */
+float distanceHistogramIntersection(FeatureView feature1, FeatureView feature2);
+
 
 /**
  * Multi-histogram distance metric with weighted combination
@@ -203,6 +256,107 @@ float distanceMultiHistogram(const std::vector<float> &feature1,
                               int numHistograms = 2,
                               const std::vector<float> &weights = {0.5f, 0.5f});
 
+/**
+ * Multi-histogram distance over views (unchecked)
+ *
+ * @param weights numHistograms weights
+ *
+ * Both views must have the same length, divisible by numHistograms; each
+ * histogram is a slice of the row, nothing is copied.
+ */
+float distanceMultiHistogram(FeatureView feature1, FeatureView feature2,
+                             int numHistograms, const float *weights);
+
+
+/**
+ * Spatial pyramid match distance
+ *
+ * @param feature1 First pyramid feature (from extractSpatialPyramid)
+ * @param feature2 Second pyramid feature
+ * @param levels Number of pyramid levels (default: 3 -> 1x1, 2x2, 4x4)
+ * @param binsPerCell Histogram size of each cell (default: 64)
+ * @return Distance value in [0, 1] (lower = more similar)
+ *
+ * Implementation details:
+ * What it does:
+ *  1. For every level, average the histogram intersection of matching cells
+ *  2. Combine levels with the pyramid match kernel weights: the coarsest
+ *     level gets 1/2^L and level l >= 1 gets 1/2^(L-l+1), where L = levels-1
+ *  3. Distance = 1 - weighted similarity
+ *
+ * With 3 levels the weights are 1/4 (1x1), 1/4 (2x2), 1/2 (4x4): a match
+ * in the same fine cell counts most, but images whose colours only agree
+ * at a coarser scale still score partially.
+ */
+float distancePyramidMatch(const std::vector<float> &feature1,
+                           const std::vector<float> &feature2,
+                           int levels = 3,
+                           int binsPerCell = 64);
+
+/**
+ * Pyramid match over views (unchecked: both pyramidFeatureSize(levels, binsPerCell) long)
+ */
+float distancePyramidMatch(FeatureView feature1, FeatureView feature2,
+                           int levels, int binsPerCell);
+
+/**
+ * Length of a pyramid feature: binsPerCell * (1 + 4 + ... + 4^(levels-1))
+ */
+size_t pyramidFeatureSize(int levels, int binsPerCell);
+
+
+/**
+ * Block of cells in a grid feature: rows [row0, row1), columns [col0, col1)
+ */
+struct GridWindow
+{
+    int row0 = 0;
+    int col0 = 0;
+    int row1 = 0;
+    int col1 = 0;
+};
+
+/**
+ * Best-window distance between a query histogram and a grid feature
+ *
+ * @param query Query histogram (binsPerCell values, e.g. an ROI histogram),
+ *              or a whole grid feature, which is summed to one histogram first
+ * @param grid Grid feature (from extractRGGridHistogram)
+ * @param gridSize Cells per side (default: 8)
+ * @param binsPerCell Histogram size of each cell (default: 64)
+ * @param best Optional output: the window that gave the returned distance
+ * @return Smallest histogram intersection distance over all windows, in [0, 1]
+ *
+ * Implementation details:
+ * What it does:
+ *  1. Build a summed-area table over the grid's cells
+ *  2. For every contiguous window of cells (1x1 up to the whole grid),
+ *     read its histogram from the table in O(bins) and renormalize it
+ *  3. Return 1 - the best intersection with the query
+ *
+ * An 8x8 grid has 36 × 36 = 1296 windows, so one database image costs
+ * ~1296 × 64 bin operations and no pixel access. This is what makes
+ * "find images containing this region anywhere" a scan over stored data.
+ */
+float distanceGridWindow(FeatureView query,
+                         FeatureView grid,
+                         int gridSize = 8,
+                         int binsPerCell = 64,
+                         GridWindow *best = nullptr);
+
+/**
+ * Best-window distances from one query to a block of packed grid rows
+ *
+ * @param rows count grid features back to back (gridSize² x binsPerCell each)
+ * @param out Output: count distances, as distanceGridWindow returns them
+ * @return 0 on success, -1 if the query does not fit (out is then all -1)
+ *
+ * The query is reduced once and the summed-area table and window buffers
+ * are reused for every row, instead of once per row.
+ */
+int distanceGridWindowBatch(FeatureView query, const float *rows, size_t count,
+                            int gridSize, int binsPerCell, float *out);
+
 
 /**
  * Texture-Color distance metric
@@ -239,6 +393,13 @@ float distanceTextureColor(const std::vector<float> &feature1,
                             float colorWeight = 0.5f,
                             float textureWeight = 0.5f);
 
+/**
+ * Texture-colour distance over views (unchecked: both colorSize + textureSize long)
+ */
+float distanceTextureColor(FeatureView feature1, FeatureView feature2,
+                           int colorSize, int textureSize,
+                           float colorWeight, float textureWeight);
+
 
 
 /**
@@ -300,6 +461,13 @@ float distanceTextureColor(const std::vector<float> &feature1,
 float distanceCosine(const std::vector<float> &feature1,
                      const std::vector<float> &feature2);
 
+/**
+ * Cosine distance over views (unchecked: same length)
+ *
+ * A zero-length vector gives the maximum distance 1 without a warning.
+ */
+float distanceCosine(FeatureView feature1, FeatureView feature2);
+
 
 
 /**
@@ -328,5 +496,150 @@ float distanceCustomBlueScene(const std::vector<float> &customFeature1,
                                const std::vector<float> &customFeature2,
                                const std::vector<float> &dnnFeature1,
                                const std::vector<float> &dnnFeature2);
+
+/**
+ * Custom blue scene distance over views (unchecked: CUSTOM_FEATURE_DIM
+ * custom values and CUSTOM_DNN_DIM DNN values on each side)
+ */
+float distanceCustomBlueScene(FeatureView customFeature1, FeatureView customFeature2,
+                              FeatureView dnnFeature1, FeatureView dnnFeature2);
+
+// Lengths distanceCustomBlueScene expects
+const size_t CUSTOM_FEATURE_DIM = 209;
+const size_t CUSTOM_DNN_DIM = 512;
+
+// ========================================
+// Earth mover's distance approximations
+// ========================================
+
+/**
+ * Earth mover's distance (EMD) between two 1-D histograms
+ *
+ * @param hist1 First histogram (normalized: the bins sum to 1)
+ * @param hist2 Second histogram, same length
+ * @return Mass moved times distance moved, with the bins spread over
+ *         [0, 1] (adjacent bins 1/n apart); 0 = identical, at most 1
+ *
+ * Implementation details:
+ * In one dimension the cheapest way to turn one histogram into the other
+ * is to move mass only between neighbours, and the mass that has to
+ * cross the edge after bin i is the difference of the two cumulative
+ * histograms (CDFs) there:
+ *
+ *  EMD = (1/n) * Σ_i |CDF1(i) - CDF2(i)|
+ *
+ * Unlike histogram intersection this sees bin adjacency: a histogram
+ * shifted by one bin is close, one shifted by half the range is far.
+ * Linear in n, against the O(n^3) of a general transport solver.
+ */
+float distanceEMD1D(FeatureView hist1, FeatureView hist2);
+
+/**
+ * Sliced EMD approximation between two bins x bins rg histograms
+ *
+ * @param hist1 First histogram (hist[r_bin * bins + g_bin], normalized)
+ * @param hist2 Second histogram, same layout
+ * @param bins Bins per channel
+ * @return Average of the 1-D EMDs of four projections, in chromaticity
+ *         units (the r and g axes span [0, 1])
+ *
+ * Implementation details:
+ * Exact 2-D EMD needs a transport solver per pair. Projecting both
+ * histograms onto a line gives a 1-D problem that the CDF formula solves
+ * exactly, and the projected EMD never exceeds the 2-D one. Four lines
+ * are used: the r axis and the g axis (the separable marginals), and the
+ * two diagonals r + g and r - g, which tell apart histograms whose
+ * marginals agree but whose joint layout does not.
+ */
+float distanceSlicedEMD(FeatureView hist1, FeatureView hist2, int bins);
+
+/**
+ * Length of the sliced EMD signature of a bins x bins histogram:
+ * bins (r) + bins (g) + 2 * (2 * bins - 1) (diagonals)
+ */
+constexpr int slicedEMDSignatureSize(int bins)
+{
+    return 6 * bins - 2;
+}
+
+/**
+ * EMD signatures: the distances above as an L1 distance between vectors
+ *
+ * @param histogram Histogram to transform
+ * @param weight Factor applied to the whole signature (a weight of the
+ *               combined distance, e.g. colour vs texture)
+ * @param signature Output: histogram.size() values (1-D), or
+ *                  slicedEMDSignatureSize(bins) values (sliced)
+ *
+ * The signature is the scaled CDF of each projection, so
+ * distanceL1(signature1, signature2) equals weight times the EMD. A
+ * database is transformed once when it is packed, and each comparison in
+ * a scan is then one vectorized L1 pass over 6 * bins - 2 values: fewer
+ * than the bins * bins an intersection reads.
+ */
+void emdSignature1D(FeatureView histogram, float weight, float *signature);
+void slicedEMDSignature(FeatureView histogram, int bins, float weight, float *signature);
+
+/**
+ * Sum of absolute differences (unchecked: same length)
+ */
+float distanceL1(FeatureView feature1, FeatureView feature2);
+
+// ========================================
+// One query against many rows
+// ========================================
+
+/**
+ * Distances from one query to `count` rows stored back to back
+ *
+ * @param query Query feature (unchecked: every row has query.size values)
+ * @param rows count x query.size values, row-major (see FeatureMatrix in utils.h)
+ * @param count Number of rows
+ * @param out Output: out[r] = distance(query, row r), count values
+ *
+ * Same values as calling the pairwise FeatureView version once per row,
+ * without the per-row call chain and with the next rows prefetched.
+ *
+ * Example:
+ *   distanceSSDBatch(target, matrix.row(begin), end - begin, dist + begin);
+ */
+void distanceSSDBatch(FeatureView query, const float *rows, size_t count, float *out);
+void distanceHistogramIntersectionBatch(FeatureView query, const float *rows, size_t count, float *out);
+void distanceL1Batch(FeatureView query, const float *rows, size_t count, float *out);
+
+/**
+ * Batch distances that stop early on rows that cannot come under a bound
+ *
+ * @param bound Largest distance still of interest, e.g. the k-th best
+ *              distance found so far in a top-k scan
+ * @param out Output: the exact distance (same value as the unbounded
+ *            call), or +infinity for a row that was abandoned
+ *
+ * A row is abandoned once its partial sum proves the distance is above
+ * the bound, so with a tight bound most rows cost a fraction of a pass.
+ */
+void distanceSSDBatch(FeatureView query, const float *rows, size_t count, float bound, float *out);
+void distanceHistogramIntersectionBatch(FeatureView query, const float *rows, size_t count, float bound,
+                                        float *out);
+void distanceL1Batch(FeatureView query, const float *rows, size_t count, float bound, float *out);
+
+/**
+ * Cosine distances from one query to a block of rows with known norms
+ *
+ * @param rowNorms L2 norm of each row (from computeRowNorms), count values
+ *
+ * Database rows never change, so their norms are computed once when the
+ * database is packed; the query norm once per call. Each row then costs
+ * one dot product instead of a dot product and a norm.
+ */
+void distanceCosineBatch(FeatureView query, const float *rows, const float *rowNorms,
+                         size_t count, float *out);
+
+/**
+ * L2 norm of each of `count` rows of length dim stored back to back
+ *
+ * @param norms Output: count values
+ */
+void computeRowNorms(const float *rows, size_t dim, size_t count, float *norms);
                                
 #endif // DISTANCE_H
\ No newline at end of file
@@ -0,0 +1,148 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: distance_simd.h
+ *
+ * Purpose:
+ * Vectorized inner loops behind the distance metrics in distance.h.
+ *
+ * The scalar loops in distance.cpp carry one float accumulator from
+ * iteration to iteration, so without -ffast-math the compiler has to add
+ * one element at a time. These kernels keep several vector accumulators
+ * instead and are picked once, on first use, from what the CPU supports:
+ *
+ *   x86-64:  AVX-512F, AVX2 + FMA, or SSE2 (always present)
+ *   AArch64: NEON (always present)
+ *   other:   portable scalar code with four accumulators
+ *
+ * The plain one-accumulator loops are kept as the reference* functions,
+ * and checkDistanceKernels() compares the two. Results differ from the
+ * reference only by float rounding (the sums are added in another order).
+ *
+ * The lengths the shipped features use (16, 64, 147, 256 and 512) also
+ * get copies of each kernel compiled for that length, fully unrolled;
+ * every entry point picks one by n and falls back to the runtime-length
+ * kernel for any other length. The copies give bit-identical results.
+ */
+
+#ifndef DISTANCE_SIMD_H
+#define DISTANCE_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Sum of squared differences of two float arrays
+ */
+float kernelSSD(const float *a, const float *b, size_t n);
+
+/**
+ * Sum of element-wise minimums (histogram intersection before 1 - x)
+ */
+float kernelIntersection(const float *a, const float *b, size_t n);
+
+/**
+ * Sum of absolute differences (L1 distance; EMD signatures in distance.h)
+ */
+float kernelL1(const float *a, const float *b, size_t n);
+
+/**
+ * Dot product of two float arrays
+ *
+ * Same sum, in the same order, as the dot output of kernelDotNorms, so a
+ * cosine from precomputed norms matches one computed in a single pass.
+ */
+float kernelDot(const float *a, const float *b, size_t n);
+
+/**
+ * Dot product and squared L2 norms of two arrays in one pass
+ *
+ * @param dot Output: sum of a[i] * b[i]
+ * @param normA Output: sum of a[i] * a[i]
+ * @param normB Output: sum of b[i] * b[i]
+ */
+void kernelDotNorms(const float *a, const float *b, size_t n,
+                    float &dot, float &normA, float &normB);
+
+/**
+ * One query against `count` rows of length n stored back to back
+ *
+ * @param query Query, n values
+ * @param rows count x n values, row-major
+ * @param out Output: out[r] = kernel(query, row r), count values
+ *
+ * The per-row loop calls the selected kernel directly and prefetches
+ * the rows a little ahead of the one being compared.
+ */
+void kernelSSDBatch(const float *query, const float *rows, size_t n, size_t count, float *out);
+void kernelIntersectionBatch(const float *query, const float *rows, size_t n, size_t count, float *out);
+void kernelL1Batch(const float *query, const float *rows, size_t n, size_t count, float *out);
+void kernelDotBatch(const float *query, const float *rows, size_t n, size_t count, float *out);
+
+/**
+ * Batch SSD that gives up on rows which cannot come under a bound
+ *
+ * @param bound Largest SSD still of interest (e.g. the k-th best so far)
+ * @param out Output: the exact SSD, or +infinity for a row whose partial
+ *            sum already exceeded the bound
+ */
+void kernelSSDBatchBounded(const float *query, const float *rows, size_t n, size_t count,
+                           float bound, float *out);
+
+/**
+ * Batch L1 that gives up on rows which cannot come under a bound (as for SSD)
+ */
+void kernelL1BatchBounded(const float *query, const float *rows, size_t n, size_t count,
+                          float bound, float *out);
+
+/**
+ * Batch intersection that gives up on rows which cannot reach a minimum
+ *
+ * @param minIntersection Smallest intersection still of interest
+ * @param out Output: the exact intersection, or -infinity for a row whose
+ *            partial sum plus the query's remaining mass is below the minimum
+ */
+void kernelIntersectionBatchBounded(const float *query, const float *rows, size_t n, size_t count,
+                                    float minIntersection, float *out);
+
+/**
+ * Dot product of two int8 arrays (quantized embeddings, see quantized_search.h)
+ *
+ * Exact: the products are widened to 16 bits and summed in 32-bit lanes
+ * (SSE2/AVX2 vpmaddwd, NEON vmull + vpadal). n must stay below 2^17 so
+ * the sum cannot overflow.
+ */
+int32_t kernelDotInt8(const int8_t *a, const int8_t *b, size_t n);
+
+/**
+ * kernelDotInt8 of one query against `count` rows of length n stored back to back
+ */
+void kernelDotInt8Batch(const int8_t *query, const int8_t *rows, size_t n, size_t count, int32_t *out);
+
+/**
+ * Scalar reference versions (one accumulator, element order), for validation
+ */
+float referenceSSD(const float *a, const float *b, size_t n);
+float referenceIntersection(const float *a, const float *b, size_t n);
+float referenceL1(const float *a, const float *b, size_t n);
+float referenceDot(const float *a, const float *b, size_t n);
+void referenceDotNorms(const float *a, const float *b, size_t n,
+                       float &dot, float &normA, float &normB);
+int32_t referenceDotInt8(const int8_t *a, const int8_t *b, size_t n);
+
+/**
+ * Name of the kernel set selected for this CPU
+ * @return "avx512", "avx2", "sse2", "neon" or "scalar"
+ */
+const char *distanceKernelName();
+
+/**
+ * Compare the selected kernels with the scalar reference
+ *
+ * @return 0 if every kernel agrees within float rounding on random inputs
+ *         of several lengths (including ones that are not a multiple of
+ *         the vector width), -1 otherwise (details on std::cerr)
+ */
+int checkDistanceKernels();
+
+#endif // DISTANCE_SIMD_H
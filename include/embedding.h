@@ -0,0 +1,76 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: embedding.h
+ *
+ * Purpose:
+ * ResNet18 embedding extraction shared by compute_embeddings and
+ * extract_features. Loads the ONNX model once and runs single-image or
+ * batched forward passes to the 512-D flatten layer.
+ */
+
+#ifndef EMBEDDING_H
+#define EMBEDDING_H
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/dnn.hpp>
+#include <string>
+#include <vector>
+
+// ResNet18 input resolution
+const int NET_SIZE = 224;
+
+// Name of the flatten layer that outputs the 512-D embedding
+const std::string EMBEDDING_LAYER = "onnx_node!resnetv22_flatten0_reshape0";
+
+/**
+ * Load the ResNet18 ONNX model
+ *
+ * @param modelPath Path to the .onnx file (e.g. "data/resnet18-v2-7.onnx")
+ * @param net Output network
+ * @return 0 on success, -1 if the model could not be loaded
+ */
+int loadEmbeddingNet(const std::string &modelPath, cv::dnn::Net &net);
+
+/**
+ * Get embedding from ResNet18 for a single image
+ *
+ * @param src Source image (BGR)
+ * @param embedding Output Mat (1x512 float)
+ * @param net The loaded ResNet18 network
+ * @return 0 on success, -1 on error
+ *
+ * What it does:
+ *  1. Preprocess image: resize to 224x224, normalize with ImageNet mean/std
+ *  2. Forward pass through network
+ *  3. Extract output from the flatten layer (512-D embedding)
+ */
+int getEmbedding(const cv::Mat &src, cv::Mat &embedding, cv::dnn::Net &net);
+
+/**
+ * Get embeddings from ResNet18 for a batch of images in one forward pass
+ *
+ * @param images Source images (BGR), ideally already resized to 224x224
+ * @param embeddings Output Mat (N x 512 float, one row per image)
+ * @param net The loaded ResNet18 network
+ * @return 0 on success, -1 on error (an empty batch, or an OpenCV
+ *         exception from the forward pass, reported on std::cerr)
+ *
+ * Uses the same preprocessing as getEmbedding. blobFromImages only resizes
+ * images that are not already 224x224, with the same bilinear resize, so
+ * pre-resized inputs give identical embeddings to the single-image path.
+ */
+int getEmbeddingsBatch(const std::vector<cv::Mat> &images, cv::Mat &embeddings, cv::dnn::Net &net);
+
+/**
+ * Resize an image to the network input size
+ *
+ * @param src Source image (BGR, any size)
+ * @param dst Output 224x224 image
+ *
+ * Same bilinear resize blobFromImages would apply, done up front so the
+ * full-size decode can be released before the batch runs.
+ */
+void resizeForEmbedding(const cv::Mat &src, cv::Mat &dst);
+
+#endif // EMBEDDING_H
@@ -0,0 +1,1038 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: feature_registry.h
+ *
+ * Purpose:
+ * One place that describes every feature type: its name, dimension,
+ * extractor, distance functor and parameters, plus the GUI label and
+ * default CSV name. extract_features, query and gui_query look types up
+ * here instead of comparing featureType strings in if/else chains.
+ *
+ * Each type is a struct, and the scan over a feature database is a
+ * template instantiated per type, so the per-row loop calls the distance
+ * function directly with no string comparison or indirect call.
+ *
+ * Adding a feature type:
+ *  1. Write the extractor (features.h) and distance (distance.h)
+ *  2. Add a struct below following the same layout
+ *  3. Append it to FeatureTypes
+ */
+
+#ifndef FEATURE_REGISTRY_H
+#define FEATURE_REGISTRY_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "distance.h"
+#include "features.h"
+#include "utils.h"
+
+// Length of a ResNet18 embedding (dnn rows, and the DNN half of custom)
+const int DNN_EMBEDDING_DIM = 512;
+
+/**
+ * Extractor signature shared by every image-based feature type
+ */
+using FeatureExtractFn = int (*)(const cv::Mat &src, std::vector<float> &feature, ExtractionWorkspace &ws);
+
+// ========================================
+// Feature types
+//
+// Every struct provides:
+//   name         - command line / CSV name
+//   label        - GUI legend text
+//   defaultCSV   - file name extract_features writes by default
+//   dim          - feature vector length
+//   extractable  - false if extract() cannot compute it from pixels alone (dnn)
+//   needsDNN     - true if the distance also needs each image's DNN embedding
+//   thumbnailSafe - true if extracting from the 128 px thumbnail cache
+//                  (thumb_cache.h) ranks like full resolution, so
+//                  extract_features --from-cache may use it. Only set from
+//                  a measurement: --from-cache --compare-with on the image
+//                  set must show 80% top-10 agreement, and the figure is
+//                  noted beside the flag
+//   exifThumbnailSafe - true for coarse colour features that rank like full
+//                  resolution from a JPEG's embedded EXIF thumbnail, so
+//                  extract_features --exif-thumb may use it. Set the same
+//                  way, from --exif-thumb --compare-with
+//   extract()    - feature extractor
+//   Distance     - distance functor (two or four FeatureView arguments).
+//                  Unchecked: scanFeatureMatrix validates the target once
+//                  and packFeatureDatabase leaves out rows of the wrong
+//                  length, so the functor never sees a size mismatch.
+//                  Optional batch(query, matrix, begin, count, out)
+//                  computes a block of packed rows in one call;
+//                  optional batchBounded(..., bound, out) may stop early
+//                  on rows whose distance is above the bound
+//   Emd          - optional: dim and signature(row, out) of the row's
+//                  earth mover's distance signature (query --metric emd,
+//                  see EmdMetric below)
+// ========================================
+
+/**
+ * Task 1: 7x7 centre square, sum of squared differences
+ */
+struct BaselineType
+{
+    static constexpr const char *name = "baseline";
+    static constexpr const char *label = "Baseline (7x7 SSD)";
+    static constexpr const char *defaultCSV = "baseline_features.csv";
+    static constexpr int dim = 147;
+    static constexpr bool extractable = true;
+    static constexpr bool needsDNN = false;
+    // The 7x7 centre covers ~25x more of a thumbnail than of a 640 px image
+    static constexpr bool thumbnailSafe = false;
+    static constexpr bool exifThumbnailSafe = false;
+
+    static int extract(const cv::Mat &src, std::vector<float> &feature, ExtractionWorkspace &ws)
+    {
+        return extractBaselineFeature(src, feature, ws);
+    }
+
+    struct Distance
+    {
+        float operator()(FeatureView a, FeatureView b) const
+        {
+            return distanceSSD(a, b);
+        }
+
+        void batch(FeatureView query, const FeatureMatrix &rows, size_t begin, size_t count, float *out) const
+        {
+            distanceSSDBatch(query, rows.row(begin), count, out);
+        }
+
+        void batchBounded(FeatureView query, const FeatureMatrix &rows, size_t begin, size_t count,
+                          float bound, float *out) const
+        {
+            distanceSSDBatch(query, rows.row(begin), count, bound, out);
+        }
+    };
+};
+
+/**
+ * Task 2: 16x16 rg chromaticity histogram, histogram intersection
+ */
+struct HistogramType
+{
+    static constexpr const char *name = "histogram";
+    static constexpr const char *label = "Histogram (rg Chrom)";
+    static constexpr const char *defaultCSV = "histogram_features.csv";
+    static constexpr int bins = 16;
+    static constexpr int dim = bins * bins;
+    static constexpr bool extractable = true;
+    static constexpr bool needsDNN = false;
+    // Top-10 agreement from the thumbnail cache: not measured yet
+    static constexpr bool thumbnailSafe = false;
+    // Top-10 agreement from EXIF thumbnails: not measured yet
+    static constexpr bool exifThumbnailSafe = false;
+
+    static int extract(const cv::Mat &src, std::vector<float> &feature, ExtractionWorkspace &ws)
+    {
+        return extractRGChromaticityHistogram(src, feature, ws, bins);
+    }
+
+    struct Distance
+    {
+        float operator()(FeatureView a, FeatureView b) const
+        {
+            return distanceHistogramIntersection(a, b);
+        }
+
+        void batch(FeatureView query, const FeatureMatrix &rows, size_t begin, size_t count, float *out) const
+        {
+            distanceHistogramIntersectionBatch(query, rows.row(begin), count, out);
+        }
+
+        void batchBounded(FeatureView query, const FeatureMatrix &rows, size_t begin, size_t count,
+                          float bound, float *out) const
+        {
+            distanceHistogramIntersectionBatch(query, rows.row(begin), count, bound, out);
+        }
+    };
+
+    struct Emd
+    {
+        static constexpr int dim = slicedEMDSignatureSize(bins);
+
+        static void signature(FeatureView row, float *out)
+        {
+            slicedEMDSignature(row, bins, 1.0f, out);
+        }
+    };
+};
+
+/**
+ * Task 3: top/bottom 8x8 rg histograms, equally weighted intersection
+ */
+struct MultiHistogramType
+{
+    static constexpr const char *name = "multihistogram";
+    static constexpr const char *label = "Multi-Hist (Top/Bot)";
+    static constexpr const char *defaultCSV = "multihistogram_features.csv";
+    static constexpr int bins = 8;
+    static constexpr int numHistograms = 2;
+    static constexpr int dim = numHistograms * bins * bins;
+    static constexpr float topWeight = 0.5f;
+    static constexpr float bottomWeight = 0.5f;
+    static constexpr bool extractable = true;
+    static constexpr bool needsDNN = false;
+    // Top-10 agreement from the thumbnail cache: not measured yet
+    static constexpr bool thumbnailSafe = false;
+    // Top-10 agreement from EXIF thumbnails: not measured yet
+    static constexpr bool exifThumbnailSafe = false;
+
+    static int extract(const cv::Mat &src, std::vector<float> &feature, ExtractionWorkspace &ws)
+    {
+        return extractMultiHistogram(src, feature, ws, bins);
+    }
+
+    struct Distance
+    {
+        float weights[numHistograms] = {topWeight, bottomWeight};
+
+        float operator()(FeatureView a, FeatureView b) const
+        {
+            return distanceMultiHistogram(a, b, numHistograms, weights);
+        }
+    };
+
+    // Top and bottom signatures side by side, each scaled by its weight
+    struct Emd
+    {
+        static constexpr int histogramDim = slicedEMDSignatureSize(bins);
+        static constexpr int dim = numHistograms * histogramDim;
+
+        static void signature(FeatureView row, float *out)
+        {
+            const float weights[numHistograms] = {topWeight, bottomWeight};
+            for (int h = 0; h < numHistograms; h++)
+            {
+                slicedEMDSignature(row.slice(h * bins * bins, bins * bins), bins, weights[h],
+                                   out + h * histogramDim);
+            }
+        }
+    };
+};
+
+/**
+ * Task 4: rg colour histogram + gradient magnitude histogram
+ */
+struct TextureType
+{
+    static constexpr const char *name = "texture";
+    static constexpr const char *label = "Texture + Color";
+    static constexpr const char *defaultCSV = "texture_features.csv";
+    static constexpr int colorBins = 16;
+    static constexpr int textureBins = 16;
+    static constexpr int colorSize = colorBins * colorBins;
+    static constexpr int textureSize = textureBins;
+    static constexpr int dim = colorSize + textureSize;
+    static constexpr float colorWeight = 0.5f;
+    static constexpr float textureWeight = 0.5f;
+    static constexpr bool extractable = true;
+    static constexpr bool needsDNN = false;
+    // Gradient magnitudes depend on scale: downsampling sharpens edges
+    static constexpr bool thumbnailSafe = false;
+    static constexpr bool exifThumbnailSafe = false;
+
+    static int extract(const cv::Mat &src, std::vector<float> &feature, ExtractionWorkspace &ws)
+    {
+        return extractTextureColorFeature(src, feature, ws, colorBins, textureBins);
+    }
+
+    struct Distance
+    {
+        float operator()(FeatureView a, FeatureView b) const
+        {
+            return distanceTextureColor(a, b, colorSize, textureSize, colorWeight, textureWeight);
+        }
+    };
+
+    // Sliced signature of the rg histogram, then the CDF of the gradient
+    // magnitude histogram (its bins are ordered, so 1-D EMD is exact)
+    struct Emd
+    {
+        static constexpr int colorDim = slicedEMDSignatureSize(colorBins);
+        static constexpr int dim = colorDim + textureSize;
+
+        static void signature(FeatureView row, float *out)
+        {
+            slicedEMDSignature(row.slice(0, colorSize), colorBins, colorWeight, out);
+            emdSignature1D(row.slice(colorSize, textureSize), textureWeight, out + colorDim);
+        }
+    };
+};
+
+/**
+ * Task 5: ResNet18 embeddings, cosine distance
+ *
+ * Not extractable from pixels alone: extract_features runs the network
+ * (embedding.h) and queries read the target's row from the CSV.
+ */
+struct DnnType
+{
+    static constexpr const char *name = "dnn";
+    static constexpr const char *label = "DNN Embeddings";
+    static constexpr const char *defaultCSV = "dnn_features.csv";
+    static constexpr int dim = DNN_EMBEDDING_DIM;
+    static constexpr bool extractable = false;
+    static constexpr bool needsDNN = false;
+    // Not extractable from pixels alone
+    static constexpr bool thumbnailSafe = false;
+    static constexpr bool exifThumbnailSafe = false;
+
+    static int extract(const cv::Mat &, std::vector<float> &, ExtractionWorkspace &)
+    {
+        return -1;
+    }
+
+    struct Distance
+    {
+        float operator()(FeatureView a, FeatureView b) const
+        {
+            return distanceCosine(a, b);
+        }
+
+        // One dot product per row: the row norms were computed when packing
+        void batch(FeatureView query, const FeatureMatrix &rows, size_t begin, size_t count, float *out) const
+        {
+            distanceCosineBatch(query, rows.row(begin), rows.norms.data() + begin, count, out);
+        }
+    };
+};
+
+/**
+ * Task 7: blue scene detector, combined with each image's DNN embedding
+ */
+struct CustomType
+{
+    static constexpr const char *name = "custom";
+    static constexpr const char *label = "Custom (Blue Scene)";
+    static constexpr const char *defaultCSV = "custom_features.csv";
+    static constexpr int dim = CUSTOM_FEATURE_DIM;
+    static constexpr bool extractable = true;
+    static constexpr bool needsDNN = true;
+    // Contains the (scale dependent) gradient histogram
+    static constexpr bool thumbnailSafe = false;
+    static constexpr bool exifThumbnailSafe = false;
+
+    static int extract(const cv::Mat &src, std::vector<float> &feature, ExtractionWorkspace &ws)
+    {
+        return extractCustomBlueSceneFeature(src, feature, ws);
+    }
+
+    struct Distance
+    {
+        float operator()(FeatureView a, FeatureView b, FeatureView dnnA, FeatureView dnnB) const
+        {
+            return distanceCustomBlueScene(a, b, dnnA, dnnB);
+        }
+    };
+};
+
+/**
+ * 1x1, 2x2, 4x4 grids of 8x8 rg histograms, pyramid match distance
+ */
+struct PyramidType
+{
+    static constexpr const char *name = "pyramid";
+    static constexpr const char *label = "Spatial Pyramid";
+    static constexpr const char *defaultCSV = "pyramid_features.csv";
+    static constexpr int levels = 3;
+    static constexpr int bins = 8;
+    static constexpr int cellBins = bins * bins;
+    static constexpr int dim = cellBins * (1 + 4 + 16);
+    static constexpr bool extractable = true;
+    static constexpr bool needsDNN = false;
+    // Top-10 agreement from the thumbnail cache: not measured yet
+    static constexpr bool thumbnailSafe = false;
+    // Not measured; camera thumbnails are a fixed 4:3 with black bars for
+    // other aspect ratios, which shifts every cell of the grid
+    static constexpr bool exifThumbnailSafe = false;
+
+    static int extract(const cv::Mat &src, std::vector<float> &feature, ExtractionWorkspace &ws)
+    {
+        return extractSpatialPyramid(src, feature, ws, levels, bins);
+    }
+
+    struct Distance
+    {
+        float operator()(FeatureView a, FeatureView b) const
+        {
+            return distancePyramidMatch(a, b, levels, cellBins);
+        }
+    };
+};
+
+/**
+ * 8x8 grid of 8x8 rg cell histograms, best matching cell window
+ *
+ * Backs region-of-interest queries: the query is an rg histogram of the
+ * selected region (see extractGridROIQuery) and every database image is
+ * searched for the cell window that matches it best. A whole-image query
+ * looks for the target's overall colour distribution anywhere.
+ */
+struct GridType
+{
+    static constexpr const char *name = "grid";
+    static constexpr const char *label = "Grid (ROI search)";
+    static constexpr const char *defaultCSV = "grid_features.csv";
+    static constexpr int gridSize = 8;
+    static constexpr int bins = 8;
+    static constexpr int cellBins = bins * bins;
+    static constexpr int dim = gridSize * gridSize * cellBins;
+    static constexpr bool extractable = true;
+    static constexpr bool needsDNN = false;
+    // Top-10 agreement from the thumbnail cache: not measured yet
+    static constexpr bool thumbnailSafe = false;
+    // Not measured; letterboxed camera thumbnails shift the cell grid
+    static constexpr bool exifThumbnailSafe = false;
+
+    static int extract(const cv::Mat &src, std::vector<float> &feature, ExtractionWorkspace &ws)
+    {
+        return extractRGGridHistogram(src, feature, ws, gridSize, bins);
+    }
+
+    struct Distance
+    {
+        // Checked: the query may be one cell histogram or a whole grid
+        float operator()(FeatureView a, FeatureView b) const
+        {
+            return distanceGridWindow(a, b, gridSize, cellBins);
+        }
+
+        // Reduces the query and allocates the window scratch once per block
+        void batch(FeatureView query, const FeatureMatrix &rows, size_t begin, size_t count, float *out) const
+        {
+            distanceGridWindowBatch(query, rows.row(begin), count, gridSize, cellBins, out);
+        }
+    };
+};
+
+/**
+ * Every registered type, in menu order (GUI keys 1, 2, ...)
+ */
+using FeatureTypes = std::tuple<BaselineType, HistogramType, MultiHistogramType,
+                                TextureType, DnnType, CustomType, PyramidType, GridType>;
+
+// Number of registered types
+constexpr int NUM_FEATURE_TYPES = static_cast<int>(std::tuple_size<FeatureTypes>::value);
+
+// ========================================
+// Lookup
+// ========================================
+
+/**
+ * Call fn(Type{}) for every registered type, in order
+ */
+template <typename Fn>
+void forEachFeatureType(Fn &&fn)
+{
+    std::apply([&](auto... type) { (fn(type), ...); }, FeatureTypes{});
+}
+
+/**
+ * Call fn(Type{}) for the type called `name`
+ *
+ * @return true if the type exists (and fn was called), false otherwise
+ *
+ * Example:
+ *   dispatchFeatureType(featureType, [&](auto type) {
+ *       using Type = decltype(type);
+ *       scanFeatureMatrix<Type>(...);
+ *   });
+ */
+template <typename Fn>
+bool dispatchFeatureType(const std::string &name, Fn &&fn)
+{
+    bool found = false;
+    forEachFeatureType([&](auto type)
+    {
+        if (!found && name == decltype(type)::name)
+        {
+            found = true;
+            fn(type);
+        }
+    });
+    return found;
+}
+
+/**
+ * Check whether `name` is a registered feature type
+ */
+inline bool isFeatureType(const std::string &name)
+{
+    return dispatchFeatureType(name, [](auto) {});
+}
+
+/**
+ * Comma-separated list of registered names, for error messages
+ */
+inline std::string featureTypeList()
+{
+    std::string list;
+    forEachFeatureType([&](auto type)
+    {
+        list += (list.empty() ? "" : ", ") + std::string(decltype(type)::name);
+    });
+    return list;
+}
+
+/**
+ * Look up the extractor of an image-based type
+ *
+ * @return the extractor, or nullptr for unknown / non-extractable types (dnn)
+ */
+inline FeatureExtractFn findFeatureExtractor(const std::string &name)
+{
+    FeatureExtractFn extract = nullptr;
+    dispatchFeatureType(name, [&](auto type)
+    {
+        using Type = decltype(type);
+        if (Type::extractable)
+            extract = &Type::extract;
+    });
+    return extract;
+}
+
+// ========================================
+// Region-of-interest queries
+// ========================================
+
+/**
+ * Build the query vector for a region-of-interest search
+ *
+ * @param src Target image (BGR)
+ * @param roi Region in image pixels (clipped to the image)
+ * @param query Output: rg histogram of the region, GridType::cellBins values
+ * @param ws Extraction workspace
+ * @return 0 on success, -1 if the region is empty after clipping
+ *
+ * The result is scanned with scanFeatureMatrix<GridType> against a
+ * grid feature database.
+ */
+inline int extractGridROIQuery(const cv::Mat &src, const cv::Rect &roi,
+                               std::vector<float> &query, ExtractionWorkspace &ws)
+{
+    cv::Rect clipped = roi & cv::Rect(0, 0, src.cols, src.rows);
+    if (clipped.area() <= 0)
+    {
+        std::cerr << "Error: Region of interest " << roi.x << "," << roi.y << " "
+                  << roi.width << "x" << roi.height << " is outside the "
+                  << src.cols << "x" << src.rows << " image" << std::endl;
+        return -1;
+    }
+
+    return extractRGChromaticityHistogram(src(clipped), query, ws, GridType::bins);
+}
+
+/**
+ * Convert a grid window of a database image to image pixels
+ *
+ * @param window Window reported by distanceGridWindow
+ * @param size Size of the database image
+ * @return Rectangle using the same cell boundaries as extraction
+ */
+inline cv::Rect gridWindowRect(const GridWindow &window, const cv::Size &size)
+{
+    // First pixel column (row) whose cell index col * gridSize / width reaches `cell`
+    auto edge = [](int cell, int length) {
+        return static_cast<int>((static_cast<long long>(cell) * length + GridType::gridSize - 1) / GridType::gridSize);
+    };
+    int x0 = edge(window.col0, size.width);
+    int y0 = edge(window.row0, size.height);
+    return cv::Rect(x0, y0, edge(window.col1, size.width) - x0, edge(window.row1, size.height) - y0);
+}
+
+// ========================================
+// DNN embedding lookup for types with needsDNN
+// ========================================
+
+/**
+ * Filename -> DNN embedding, built once from the DNN database
+ */
+using DNNIndex = std::unordered_map<std::string, const std::vector<float> *>;
+
+/**
+ * Index a DNN database by filename
+ *
+ * Replaces a linear search of the DNN database per feature row (which
+ * made custom queries O(N^2)) with one hash lookup per row.
+ */
+inline void buildDNNIndex(const std::vector<FeatureData> &dnnDb, DNNIndex &index)
+{
+    index.clear();
+    index.reserve(dnnDb.size());
+    for (const auto &data : dnnDb)
+    {
+        index.emplace(data.filename, &data.feature);
+    }
+}
+
+/**
+ * Line DNN embeddings up with the rows of a feature database
+ *
+ * @param db Feature database
+ * @param index DNN index from buildDNNIndex
+ * @param rows Output: rows[i] is db[i]'s embedding, or nullptr if missing
+ * @return Number of rows without an embedding
+ */
+inline int alignDNNRows(const std::vector<FeatureData> &db, const DNNIndex &index,
+                        std::vector<const std::vector<float> *> &rows)
+{
+    int missing = 0;
+    rows.assign(db.size(), nullptr);
+    for (size_t i = 0; i < db.size(); i++)
+    {
+        auto it = index.find(db[i].filename);
+        if (it != index.end())
+            rows[i] = it->second;
+        else
+            missing++;
+    }
+    return missing;
+}
+
+// ========================================
+// Per-type scan
+// ========================================
+
+/**
+ * Check whether a database row has the length Type's distance expects
+ */
+template <typename Type>
+bool featureRowFits(const std::vector<float> &feature)
+{
+    return feature.size() == static_cast<size_t>(Type::dim);
+}
+
+/**
+ * Check a query target once, before scanning
+ *
+ * @param target Target feature vector
+ * @param targetDNN Target DNN embedding (needsDNN types only)
+ * @return true if the target can be compared with Type's rows; false
+ *         after printing the reason
+ *
+ * A grid target may also be a single cell histogram (region query).
+ */
+template <typename Type>
+bool validateScanTarget(const std::vector<float> &target,
+                        const std::vector<float> &targetDNN = {})
+{
+    bool fits = featureRowFits<Type>(target);
+    if constexpr (std::is_same<Type, GridType>::value)
+    {
+        fits = fits || target.size() == static_cast<size_t>(GridType::cellBins);
+    }
+
+    if (!fits)
+    {
+        std::cerr << "Error: " << Type::name << " target has " << target.size()
+                  << " values, expected " << Type::dim << std::endl;
+        return false;
+    }
+
+    if (Type::needsDNN && targetDNN.size() != static_cast<size_t>(DNN_EMBEDDING_DIM))
+    {
+        std::cerr << "Error: " << Type::name << " target DNN embedding has " << targetDNN.size()
+                  << " values, expected " << DNN_EMBEDDING_DIM << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Pack a feature database for scanning
+ *
+ * @param db Feature database
+ * @param matrix Output: the rows of length Type::dim, back to back
+ * @return Number of rows left out because of their length (reported
+ *         once on std::cerr)
+ *
+ * Done once after loading, along with the row norms for the cosine (dnn)
+ * type; every query then scans the matrix.
+ */
+template <typename Type>
+int packFeatureDatabase(const std::vector<FeatureData> &db, FeatureMatrix &matrix)
+{
+    int wrongLength = buildFeatureMatrix(db, static_cast<size_t>(Type::dim), matrix);
+
+    // Row norms never change; cosine scans divide by them instead of
+    // recomputing. No other type reads them.
+    if constexpr (std::is_same_v<Type, DnnType>)
+    {
+        matrix.norms.resize(matrix.rows);
+        computeRowNorms(matrix.data.data(), matrix.dim, matrix.rows, matrix.norms.data());
+    }
+
+    if (wrongLength > 0)
+    {
+        std::cerr << "Warning: " << wrongLength << " " << Type::name
+                  << " database rows have the wrong length and were skipped" << std::endl;
+    }
+    return wrongLength;
+}
+
+// ========================================
+// Earth mover's distance metric
+// ========================================
+
+/**
+ * Whether a type provides an EMD signature (nested Emd struct)
+ */
+template <typename Type, typename = void>
+struct HasEmdMetric : std::false_type {};
+
+template <typename Type>
+struct HasEmdMetric<Type, std::void_t<decltype(&Type::Emd::signature)>> : std::true_type {};
+
+/**
+ * A histogram type compared by earth mover's distance instead of intersection
+ *
+ * Scanned like any type, over a matrix of EMD signatures (packEmdSignatures)
+ * rather than the raw rows: the L1 distance between two signatures is the
+ * EMD approximation (see distanceSlicedEMD), so the scan is one vectorized
+ * pass per row and top-k scans abandon rows early as SSD does.
+ *
+ * Example:
+ *   FeatureMatrix signatures;
+ *   std::vector<float> targetSignature;
+ *   packEmdSignatures<HistogramType>(database, signatures);
+ *   emdTargetSignature<HistogramType>(target, targetSignature);
+ *   selectFeatureMatches<EmdMetric<HistogramType>>(targetSignature, signatures, database, ...);
+ */
+template <typename Type>
+struct EmdMetric
+{
+    static constexpr const char *name = Type::name;
+    static constexpr int dim = Type::Emd::dim;
+    static constexpr bool needsDNN = false;
+
+    struct Distance
+    {
+        float operator()(FeatureView a, FeatureView b) const
+        {
+            return distanceL1(a, b);
+        }
+
+        void batch(FeatureView query, const FeatureMatrix &rows, size_t begin, size_t count, float *out) const
+        {
+            distanceL1Batch(query, rows.row(begin), count, out);
+        }
+
+        void batchBounded(FeatureView query, const FeatureMatrix &rows, size_t begin, size_t count,
+                          float bound, float *out) const
+        {
+            distanceL1Batch(query, rows.row(begin), count, bound, out);
+        }
+    };
+};
+
+/**
+ * Pack the EMD signatures of a feature database
+ *
+ * @param db Feature database of Type
+ * @param matrix Output: one Type::Emd::dim signature per row of length
+ *               Type::dim, with source indices as packFeatureDatabase
+ * @return Number of rows left out because of their length
+ */
+template <typename Type>
+int packEmdSignatures(const std::vector<FeatureData> &db, FeatureMatrix &matrix)
+{
+    FeatureMatrix histograms;
+    int wrongLength = buildFeatureMatrix(db, static_cast<size_t>(Type::dim), histograms);
+    if (wrongLength > 0)
+    {
+        std::cerr << "Warning: " << wrongLength << " " << Type::name
+                  << " database rows have the wrong length and were skipped" << std::endl;
+    }
+
+    matrix.rows = histograms.rows;
+    matrix.dim = static_cast<size_t>(Type::Emd::dim);
+    matrix.source = std::move(histograms.source);
+    matrix.norms.clear();
+    matrix.data.resize(matrix.rows * matrix.dim);
+
+    for (size_t r = 0; r < matrix.rows; r++)
+    {
+        Type::Emd::signature(FeatureView(histograms.row(r), histograms.dim), matrix.data.data() + r * matrix.dim);
+    }
+    return wrongLength;
+}
+
+/**
+ * EMD signature of a query target
+ *
+ * @return 0 on success, -1 if the target is not a Type feature (reason on std::cerr)
+ */
+template <typename Type>
+int emdTargetSignature(const std::vector<float> &target, std::vector<float> &signature)
+{
+    if (!validateScanTarget<Type>(target))
+        return -1;
+
+    signature.resize(static_cast<size_t>(Type::Emd::dim));
+    Type::Emd::signature(FeatureView(target), signature.data());
+    return 0;
+}
+
+// ========================================
+// Scan loop
+// ========================================
+
+/**
+ * Whether a Distance functor has a batch(query, rows, count, out) member
+ */
+template <typename Distance, typename = void>
+struct HasBatchDistance : std::false_type {};
+
+template <typename Distance>
+struct HasBatchDistance<Distance, std::void_t<decltype(&Distance::batch)>> : std::true_type {};
+
+/**
+ * Whether a Distance functor has a batchBounded(query, rows, count, bound, out) member
+ */
+template <typename Distance, typename = void>
+struct HasBoundedBatchDistance : std::false_type {};
+
+template <typename Distance>
+struct HasBoundedBatchDistance<Distance, std::void_t<decltype(&Distance::batchBounded)>> : std::true_type {};
+
+// Rows per block of a scan: the distances of one block fit in L1
+const size_t SCAN_BLOCK_ROWS = 256;
+
+// Smallest database for early abandoning: below this the rows stay in
+// cache and a full pass costs about as much as the checks it would save
+const size_t BOUNDED_SCAN_MIN_ROWS = 8192;
+
+/**
+ * Distances from a target to rows [begin, end) of a packed feature database
+ *
+ * @param bound Callable returning the largest distance still of interest,
+ *              read once per block (infinity: every row is wanted)
+ * @param visit Called as visit(row, distance) for every row. The distance
+ *              is negative if the row has no usable DNN embedding or the
+ *              distance failed, and may be +infinity for a row abandoned
+ *              above the bound
+ *
+ * The rows are compared a block at a time: types whose Distance has a
+ * batch() member (SSD, intersection, cosine, grid) compute the whole block in
+ * one call that keeps the target in L1 and prefetches rows ahead; the
+ * others call the distance directly per row. With a finite bound, types
+ * with batchBounded() stop early on rows that cannot come under it.
+ * The target must already be validated (validateScanTarget).
+ */
+template <typename Type, typename Bound, typename Visit>
+void scanFeatureRows(const std::vector<float> &target,
+                     const FeatureMatrix &matrix,
+                     size_t begin, size_t end,
+                     const std::vector<float> &targetDNN,
+                     const std::vector<const std::vector<float> *> &dbDNN,
+                     Bound bound, Visit visit)
+{
+    typename Type::Distance distance;
+    float dist[SCAN_BLOCK_ROWS];
+
+    for (size_t block = begin; block < end; block += SCAN_BLOCK_ROWS)
+    {
+        size_t count = std::min(SCAN_BLOCK_ROWS, end - block);
+
+        // === Distances for the block ===
+
+        if constexpr (HasBoundedBatchDistance<typename Type::Distance>::value)
+        {
+            float limit = bound();
+            if (limit < std::numeric_limits<float>::infinity())
+                distance.batchBounded(target, matrix, block, count, limit, dist);
+            else
+                distance.batch(target, matrix, block, count, dist);
+        }
+        else if constexpr (HasBatchDistance<typename Type::Distance>::value)
+        {
+            distance.batch(target, matrix, block, count, dist);
+        }
+        else
+        {
+            for (size_t r = 0; r < count; r++)
+            {
+                FeatureView row(matrix.row(block + r), matrix.dim);
+
+                if constexpr (Type::needsDNN)
+                {
+                    size_t i = matrix.source[block + r];
+                    if (i >= dbDNN.size() || dbDNN[i] == nullptr ||
+                        dbDNN[i]->size() != static_cast<size_t>(DNN_EMBEDDING_DIM))
+                    {
+                        dist[r] = -1.0f;
+                        continue;
+                    }
+                    dist[r] = distance(target, row, targetDNN, *dbDNN[i]);
+                }
+                else
+                {
+                    dist[r] = distance(target, row);
+                }
+            }
+        }
+
+        // === Hand over ===
+
+        for (size_t r = 0; r < count; r++)
+        {
+            visit(block + r, dist[r]);
+        }
+    }
+}
+
+/**
+ * Distance from a target to every row of a packed feature database
+ *
+ * @param target Target feature vector
+ * @param matrix Database rows from packFeatureDatabase<Type>
+ * @param db The database the matrix was packed from (for filenames)
+ * @param results Output: one MatchResult per row with a valid distance (unsorted)
+ * @param targetDNN Target DNN embedding (needsDNN types only)
+ * @param dbDNN Per-row DNN embeddings from alignDNNRows(db, ...) (needsDNN types only)
+ * @return Number of database rows skipped (left out of the matrix, no
+ *         usable DNN embedding, or distance error); every row if the
+ *         target itself is invalid
+ *
+ * Instantiated once per type. Sizes are checked here rather than in the
+ * distance: the target once up front, the rows when the matrix is packed.
+ * Callers that only display the nearest few rows should use
+ * selectFeatureMatches instead.
+ */
+template <typename Type>
+int scanFeatureMatrix(const std::vector<float> &target,
+                      const FeatureMatrix &matrix,
+                      const std::vector<FeatureData> &db,
+                      std::vector<MatchResult> &results,
+                      const std::vector<float> &targetDNN = {},
+                      const std::vector<const std::vector<float> *> &dbDNN = {})
+{
+    int skipped = static_cast<int>(db.size() - matrix.rows);
+
+    results.clear();
+
+    if (!validateScanTarget<Type>(target, targetDNN))
+    {
+        return static_cast<int>(db.size());
+    }
+
+    results.reserve(matrix.rows);
+
+    scanFeatureRows<Type>(target, matrix, 0, matrix.rows, targetDNN, dbDNN,
+        [] { return std::numeric_limits<float>::infinity(); },
+        [&](size_t row, float dist)
+        {
+            // Negative distance: no DNN embedding, or a distance error
+            if (dist < 0)
+            {
+                skipped++;
+                return;
+            }
+
+            MatchResult match;
+            match.filename = db[matrix.source[row]].filename;
+            match.distance = dist;
+            results.push_back(match);
+        });
+
+    return skipped;
+}
+
+/**
+ * The nearest (and optionally farthest) rows of a packed feature database
+ *
+ * @param target Target feature vector
+ * @param matrix Database rows from packFeatureDatabase<Type>
+ * @param db The database the matrix was packed from (for filenames)
+ * @param keepBest Nearest matches to return
+ * @param keepWorst Farthest matches to return (0 for none)
+ * @param selection Output: the matches, sorted, and the number of rows ranked
+ * @param targetDNN Target DNN embedding (needsDNN types only)
+ * @param dbDNN Per-row DNN embeddings from alignDNNRows(db, ...) (needsDNN types only)
+ * @return Number of database rows skipped, as for scanFeatureMatrix
+ *
+ * The database is split into one contiguous range of blocks per thread
+ * (cv::parallel_for_); each range fills its own MatchSelector and the
+ * partial heaps are merged at the end, so no MatchResult is built for a
+ * row that is not returned and nothing is sorted but the kept rows.
+ *
+ * When only the nearest rows are wanted and the database has at least
+ * BOUNDED_SCAN_MIN_ROWS rows, each range's k-th best distance so far is
+ * the bound for its next block (infinite until keepBest rows are in):
+ * SSD and intersection rows that cannot beat it are abandoned after the
+ * first stride of the arithmetic, and their other cache lines are never
+ * loaded. Kept rows have exactly the distances of a full scan.
+ */
+template <typename Type>
+int selectFeatureMatches(const std::vector<float> &target,
+                         const FeatureMatrix &matrix,
+                         const std::vector<FeatureData> &db,
+                         size_t keepBest, size_t keepWorst,
+                         MatchSelection &selection,
+                         const std::vector<float> &targetDNN = {},
+                         const std::vector<const std::vector<float> *> &dbDNN = {})
+{
+    int skipped = static_cast<int>(db.size() - matrix.rows);
+    MatchSelector merged(keepBest, keepWorst);
+    std::mutex mergeLock;
+
+    selection = MatchSelection();
+
+    if (!validateScanTarget<Type>(target, targetDNN))
+    {
+        return static_cast<int>(db.size());
+    }
+
+    // Abandoned rows never reach the selector's farthest heap, so bound only top-k scans
+    bool bounded = keepWorst == 0 && matrix.rows >= BOUNDED_SCAN_MIN_ROWS;
+    int numBlocks = static_cast<int>((matrix.rows + SCAN_BLOCK_ROWS - 1) / SCAN_BLOCK_ROWS);
+
+    // One stripe per thread, so each keeps its bound across its blocks
+    cv::parallel_for_(cv::Range(0, numBlocks), [&](const cv::Range &range)
+    {
+        MatchSelector local(keepBest, keepWorst);
+        int localSkipped = 0;
+
+        size_t begin = static_cast<size_t>(range.start) * SCAN_BLOCK_ROWS;
+        size_t end = std::min(static_cast<size_t>(range.end) * SCAN_BLOCK_ROWS, matrix.rows);
+
+        scanFeatureRows<Type>(target, matrix, begin, end, targetDNN, dbDNN,
+            [&]
+            {
+                return bounded ? local.bound() : std::numeric_limits<float>::infinity();
+            },
+            [&](size_t row, float dist)
+            {
+                if (dist < 0)
+                {
+                    localSkipped++;
+                    return;
+                }
+                local.add(matrix.source[row], dist);
+            });
+
+        std::lock_guard<std::mutex> lock(mergeLock);
+        merged.merge(local);
+        skipped += localSkipped;
+    }, cv::getNumThreads());
+
+    merged.finish(db, selection);
+    return skipped;
+}
+
+#endif // FEATURE_REGISTRY_H
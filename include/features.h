@@ -12,8 +12,69 @@
 #define FEATURES_H
 
 #include <opencv2/opencv.hpp>
+#include <cstdint>
 #include <vector>
 
+// Images with at least this many pixels (e.g. 100+ megapixel scans) are
+// split into row tiles that are counted in parallel and merged, instead of
+// stalling one worker for seconds
+const int TILE_PARALLEL_MIN_PIXELS = 16 * 1000 * 1000;
+
+// Rows per tile in tile-parallel mode
+const int TILE_ROWS = 256;
+
+/**
+ * Reusable scratch buffers for feature extraction
+ *
+ * Every extractor has an overload that takes one of these. Keep one
+ * workspace per worker thread and pass it to every call: each plane is
+ * grown to the largest image seen so far and handed out as a view of the
+ * right size, and the histogram buffer keeps its capacity between calls,
+ * so steady-state extraction performs zero heap allocations.
+ *
+ * A workspace must never be shared between threads.
+ */
+struct ExtractionWorkspace
+{
+    cv::Mat sobelTemp;      // Separable Sobel intermediate (CV_16SC3)
+    cv::Mat sobelX;         // Sobel X gradient (CV_16SC3)
+    cv::Mat sobelY;         // Sobel Y gradient (CV_16SC3)
+    cv::Mat gradMag;        // Gradient magnitude (CV_8UC3)
+    cv::Mat gradGray;       // Grayscale gradient magnitude (CV_8UC1)
+    cv::Mat hsv;            // HSV conversion for blue dominance (CV_8UC3)
+    std::vector<float> histogram;  // Bin counts shared by the histogram helpers
+
+    // Tile-parallel mode for very large images: row tiles (with halo rows
+    // for Sobel) are counted concurrently into per-tile partial histograms
+    // that are merged at the end. Set tileMinPixels <= 0 to disable.
+    int tileMinPixels = TILE_PARALLEL_MIN_PIXELS;
+    std::vector<float> tileHistograms;  // numTiles x bins partial counts
+    std::vector<int> tilePixels;        // Pixels counted per tile
+    std::vector<ExtractionWorkspace> tileWorkspaces;  // Scratch planes per parallel stripe
+
+    // Spatial pyramid: per-cell rg counts from one pixel sweep, and their
+    // summed-area table (double so 100+ megapixel sums stay exact)
+    std::vector<uint32_t> gridCounts;   // gridRows x gridCols x bins² counts
+    std::vector<double> cellSAT;        // (gridRows+1) x (gridCols+1) x bins²
+    std::vector<int> colCells;          // Grid column of every image column
+};
+
+/**
+ * Get a rows x cols view of a workspace plane
+ *
+ * @param buffer Backing plane owned by an ExtractionWorkspace
+ * @param rows Rows needed
+ * @param cols Columns needed
+ * @param type OpenCV type needed (e.g. CV_16SC3)
+ * @return View into buffer with exactly the requested size and type
+ *
+ * The backing plane is only reallocated when the request is larger than
+ * anything seen before (or the type changes). The returned view is not
+ * continuous when it is smaller than the plane, so callers must walk it
+ * row by row with ptr<>(), which every extractor here already does.
+ */
+cv::Mat workspacePlane(cv::Mat &buffer, int rows, int cols, int type);
+
 /**
  * Extract baseline feature: center 7x7 square as feature vector
  * 
@@ -69,6 +130,8 @@
  * - Returns -1 if image is empty
  */
 int extractBaselineFeature(const cv::Mat &src, std::vector<float> &feature);
+int extractBaselineFeature(const cv::Mat &src, std::vector<float> &feature,
+                           ExtractionWorkspace &ws);
 
 /**
  * Extract rg chromaticity histogram as feature vector
@@ -105,6 +168,10 @@ int extractBaselineFeature(const cv::Mat &src, std::vector<float> &feature);
 int extractRGChromaticityHistogram(const cv::Mat &src, 
                                     std::vector<float> &feature,
                                     int binsPerChannel = 16);
+int extractRGChromaticityHistogram(const cv::Mat &src,
+                                    std::vector<float> &feature,
+                                    ExtractionWorkspace &ws,
+                                    int binsPerChannel = 16);
 
 
 /**
@@ -143,6 +210,182 @@ int extractRGChromaticityHistogram(const cv::Mat &src,
 int extractMultiHistogram(const cv::Mat &src, 
                           std::vector<float> &feature,
                           int binsPerChannel = 8);
+int extractMultiHistogram(const cv::Mat &src,
+                          std::vector<float> &feature,
+                          ExtractionWorkspace &ws,
+                          int binsPerChannel = 8);
+
+
+/**
+ * Count rg chromaticity bins for every cell of a gridRows x gridCols grid
+ *
+ * @param src Source image (BGR)
+ * @param gridRows Number of cell rows
+ * @param gridCols Number of cell columns
+ * @param binsPerChannel Number of bins for r and g
+ * @param counts Output: counts[(cellRow * gridCols + cellCol) * bins² + bin]
+ * @param ws Workspace providing the column -> cell table
+ * @return 0 on success, -1 on error
+ *
+ * One sweep over the pixels fills every cell; cell boundaries are at
+ * row * gridRows / rows (same for columns), so cells differ by at most
+ * one pixel in size. Binning is identical to the rg histogram extractor.
+ */
+int extractRGGridCounts(const cv::Mat &src, int gridRows, int gridCols,
+                        int binsPerChannel, std::vector<uint32_t> &counts,
+                        ExtractionWorkspace &ws);
+
+/**
+ * Build a summed-area table over grid cell histograms
+ *
+ * @param cells Cell histograms, cells[(cellRow * gridCols + cellCol) * numBins + bin]
+ *              (raw counts from extractRGGridCounts, or a stored grid feature)
+ * @param gridRows Number of cell rows
+ * @param gridCols Number of cell columns
+ * @param numBins Bins per cell (bins²)
+ * @param sat Output: (gridRows+1) x (gridCols+1) x numBins table where
+ *            entry (r, c) is the histogram of all cells above and left of (r, c)
+ *
+ * Header-only (like cellRegionHistogram) so distance.cpp can search
+ * stored grids without linking the extractors.
+ */
+template <typename T>
+void buildCellSAT(const T *cells, int gridRows, int gridCols, int numBins,
+                  std::vector<double> &sat)
+{
+    size_t satCols = static_cast<size_t>(gridCols) + 1;
+    sat.assign((static_cast<size_t>(gridRows) + 1) * satCols * numBins, 0.0);
+    
+    // sat(r+1, c+1) = cell(r, c) + sat(r, c+1) + sat(r+1, c) - sat(r, c)
+    for (int r = 0; r < gridRows; r++)
+    {
+        for (int c = 0; c < gridCols; c++)
+        {
+            const T *cell = cells + (static_cast<size_t>(r) * gridCols + c) * numBins;
+            double *dst = sat.data() + ((r + 1) * satCols + (c + 1)) * numBins;
+            const double *up = sat.data() + (r * satCols + (c + 1)) * numBins;
+            const double *left = sat.data() + ((r + 1) * satCols + c) * numBins;
+            const double *diag = sat.data() + (r * satCols + c) * numBins;
+            
+            for (int i = 0; i < numBins; i++)
+            {
+                dst[i] = cell[i] + up[i] + left[i] - diag[i];
+            }
+        }
+    }
+}
+
+/**
+ * Normalized histogram of a rectangle of cells, read from a cell SAT
+ *
+ * @param sat Table from buildCellSAT
+ * @param gridCols Number of cell columns the table was built with
+ * @param numBins Bins per cell
+ * @param row0 First cell row (inclusive)
+ * @param col0 First cell column (inclusive)
+ * @param row1 Last cell row (exclusive)
+ * @param col1 Last cell column (exclusive)
+ * @param out Destination for numBins values (all zero if the region is empty)
+ * @return Total mass of the region before normalization (pixels, for raw counts)
+ *
+ * Four lookups per bin, so any rectangle costs O(bins) no matter how
+ * many pixels or cells it covers.
+ */
+inline double cellRegionHistogram(const std::vector<double> &sat, int gridCols, int numBins,
+                                  int row0, int col0, int row1, int col1, float *out)
+{
+    size_t satCols = static_cast<size_t>(gridCols) + 1;
+    const double *br = sat.data() + (row1 * satCols + col1) * numBins;
+    const double *tr = sat.data() + (row0 * satCols + col1) * numBins;
+    const double *bl = sat.data() + (row1 * satCols + col0) * numBins;
+    const double *tl = sat.data() + (row0 * satCols + col0) * numBins;
+    
+    double total = 0.0;
+    for (int i = 0; i < numBins; i++)
+    {
+        total += br[i] - tr[i] - bl[i] + tl[i];
+    }
+    
+    for (int i = 0; i < numBins; i++)
+    {
+        double count = br[i] - tr[i] - bl[i] + tl[i];
+        out[i] = (total > 0) ? static_cast<float>(count / total) : 0.0f;
+    }
+    
+    return total;
+}
+
+
+/**
+ * Extract grid histogram feature: an rg histogram for every cell of a grid
+ *
+ * @param src Source image (cv::Mat, BGR color image)
+ * @param feature Output feature vector (std::vector<float>)
+ * @param gridSize Cells per side (default: 8)
+ * @param binsPerChannel Number of bins for r and g (default: 8)
+ * @return 0 on success, -1 on error
+ *
+ * Implementation details:
+ *  Each cell stores its bin counts divided by the pixel count of the
+ *  whole image (not of the cell), so the cells can be summed: the
+ *  histogram of any block of cells is the sum of its cells, renormalized.
+ *  Region-of-interest queries use this to compare an ROI against every
+ *  cell window of every database image without touching pixels.
+ *
+ * With gridSize=8, binsPerChannel=8:
+ *  - 64 cells × 64 bins = 4096 values
+ *
+ * Feature vector format (cells row-major):
+ *  [cell(0,0) bins 0-63, cell(0,1) bins 0-63, ..., cell(7,7) bins 0-63]
+ */
+int extractRGGridHistogram(const cv::Mat &src,
+                           std::vector<float> &feature,
+                           int gridSize = 8,
+                           int binsPerChannel = 8);
+int extractRGGridHistogram(const cv::Mat &src,
+                           std::vector<float> &feature,
+                           ExtractionWorkspace &ws,
+                           int gridSize = 8,
+                           int binsPerChannel = 8);
+
+
+/**
+ * Extract spatial pyramid feature: rg histograms over 1x1, 2x2, 4x4 grids
+ *
+ * @param src Source image (cv::Mat, BGR color image)
+ * @param feature Output feature vector (std::vector<float>)
+ * @param levels Number of pyramid levels (default: 3 -> 1x1, 2x2, 4x4)
+ * @param binsPerChannel Number of bins for r and g (default: 8)
+ * @return 0 on success, -1 on error
+ *
+ * Implementation details:
+ * What it does:
+ *  1. Count rg bins for every cell of the finest grid in one pixel sweep
+ *  2. Build a summed-area table over the cells
+ *  3. For every level, read each cell's histogram from the table
+ *     (a level-l cell is a block of finer cells) and normalize it
+ *
+ * Only the finest grid touches pixels, so the coarser levels cost
+ * O(bins) per cell instead of another pass over the image.
+ *
+ * With levels=3, binsPerChannel=8:
+ *  - Level 0: 1 cell × 64 bins = 64 values
+ *  - Level 1: 4 cells × 64 bins = 256 values
+ *  - Level 2: 16 cells × 64 bins = 1024 values
+ *  - Total feature vector: 1344 values
+ *
+ * Feature vector format (cells row-major within a level):
+ *  [level0_cell0 (64), level1_cell0 (64), ..., level1_cell3, level2_cell0, ..., level2_cell15]
+ */
+int extractSpatialPyramid(const cv::Mat &src,
+                          std::vector<float> &feature,
+                          int levels = 3,
+                          int binsPerChannel = 8);
+int extractSpatialPyramid(const cv::Mat &src,
+                          std::vector<float> &feature,
+                          ExtractionWorkspace &ws,
+                          int levels = 3,
+                          int binsPerChannel = 8);
 
 
 /**
@@ -184,10 +427,19 @@ int extractTextureColorFeature(const cv::Mat &src,
                                 std::vector<float> &feature,
                                 int colorBins = 16,
                                 int textureBins = 16);
+int extractTextureColorFeature(const cv::Mat &src,
+                                std::vector<float> &feature,
+                                ExtractionWorkspace &ws,
+                                int colorBins = 16,
+                                int textureBins = 16);
 
 // Helper function declarations (you already have these from Project 1)
+// The workspace overloads take their intermediate plane from ws; pass a
+// dst obtained from workspacePlane() to avoid allocating the output too.
 int sobelX3x3(cv::Mat &src, cv::Mat &dst);
 int sobelY3x3(cv::Mat &src, cv::Mat &dst);
+int sobelX3x3(cv::Mat &src, cv::Mat &dst, ExtractionWorkspace &ws);
+int sobelY3x3(cv::Mat &src, cv::Mat &dst, ExtractionWorkspace &ws);
 int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat &dst);
 
 /**
@@ -211,5 +463,8 @@ int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat &dst);
  */
 int extractCustomBlueSceneFeature(const cv::Mat &src, 
                                    std::vector<float> &feature);
+int extractCustomBlueSceneFeature(const cv::Mat &src,
+                                   std::vector<float> &feature,
+                                   ExtractionWorkspace &ws);
 
 #endif // FEATURES_H
@@ -0,0 +1,118 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: jpeg_fast.h
+ *
+ * Purpose:
+ * JPEG ingest paths that avoid decoding the whole image when a feature
+ * only needs part of it. The baseline feature reads 49 pixels from the
+ * centre, so with libjpeg-turbo available (CBIR_HAVE_LIBJPEG) we decode
+ * only the iMCU rows and columns around the centre instead of all
+ * 12 megapixels.
+ *
+ * Bulk first-pass indexing can go further: most camera JPEGs embed a
+ * ~160x120 EXIF thumbnail, which is enough for coarse colour features and
+ * costs a tiny fraction of the full decode (readExifThumbnail).
+ *
+ * Also holds the minimal EXIF (APP1) parsing these paths need.
+ */
+
+#ifndef JPEG_FAST_H
+#define JPEG_FAST_H
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Fields read from an EXIF APP1 segment
+ *
+ * orientation: TIFF orientation tag (1 = stored upright; 2-8 = imread
+ *              rotates/flips the pixels when loading)
+ * thumbnailOffset, thumbnailLength: embedded JPEG thumbnail (IFD1), as a
+ *              byte range of the APP1 payload; length 0 if there is none
+ */
+struct ExifInfo
+{
+    int orientation = 1;
+    size_t thumbnailOffset = 0;
+    size_t thumbnailLength = 0;
+};
+
+/**
+ * Parse an EXIF APP1 segment
+ *
+ * @param data APP1 payload, starting with "Exif\0\0"
+ * @param size Payload length in bytes
+ * @param info Output fields (left at their defaults when a tag is absent)
+ * @return 0 on success, -1 if this is not a well-formed EXIF segment
+ */
+int parseExif(const uint8_t *data, size_t size, ExifInfo &info);
+
+/**
+ * Rotate/flip an image the way imread applies an EXIF orientation
+ *
+ * @param image Image as stored in the file; replaced by the upright one
+ * @param orientation TIFF orientation tag (1-8; anything else is left as-is)
+ */
+void applyExifOrientation(cv::Mat &image, int orientation);
+
+/**
+ * Decode the EXIF thumbnail embedded in a JPEG file
+ *
+ * @param path JPEG file
+ * @param thumbnail Output: upright BGR thumbnail (orientation applied,
+ *                  as imread would for the full image)
+ * @return 0 on success, -1 if the file has no usable EXIF thumbnail
+ *         (callers then fall back to a full decode)
+ *
+ * Only the marker segments before the image data are read (with plain
+ * file I/O, no libjpeg needed), then the thumbnail's few KB are decoded
+ * with cv::imdecode. Thumbnails narrower than EXIF_THUMB_MIN_SIDE are
+ * rejected as too coarse.
+ *
+ * Camera thumbnails are a fixed 160x120, so non-4:3 photos come with
+ * black bars; whether a feature still ranks well from them is measured
+ * with extract_features --exif-thumb --compare-with.
+ */
+int readExifThumbnail(const std::string &path, cv::Mat &thumbnail);
+
+// Shortest side an EXIF thumbnail needs to be used
+const int EXIF_THUMB_MIN_SIDE = 64;
+
+/**
+ * Check whether this build has the ROI decode path (libjpeg-turbo)
+ */
+bool haveROIDecode();
+
+/**
+ * Extract the baseline feature straight from a JPEG file, decoding only
+ * the centre of the image
+ *
+ * @param path JPEG file
+ * @param feature Output: 147 values, identical to
+ *                extractBaselineFeature(cv::imread(path), feature)
+ * @return 0 on success, -1 if this path cannot be used for the file
+ *         (callers then fall back to imread + extractBaselineFeature)
+ *
+ * Implementation details:
+ *  1. Read the header and EXIF orientation. Anything imread would not
+ *     hand over as-is (orientation != 1, non-YCbCr colour, < 7 px) falls back.
+ *  2. jpeg_crop_scanline() limits decoding to the iMCU columns around the
+ *     centre, and jpeg_skip_scanlines() skips the rows above it
+ *  3. Read the 7 centre rows and copy the 7x7 patch in B,G,R order
+ *
+ * The crop is widened by one iMCU on every side, so fancy upsampling
+ * sees the same neighbours as a full decode and the pixels match
+ * exactly. Reduced-scale (DCT scaling) decode is not used: it changes
+ * pixel values and would not reproduce the full-resolution feature.
+ *
+ * Rows below the patch are never decoded; rows above it are still
+ * entropy-decoded (JPEG has no row index) but skip IDCT and colour
+ * conversion, which dominate the cost.
+ */
+int extractBaselineFromJPEG(const std::string &path, std::vector<float> &feature);
+
+#endif // JPEG_FAST_H
@@ -0,0 +1,251 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: pipeline.h
+ *
+ * Purpose:
+ * Small thread-pipeline building blocks shared by the extraction tools.
+ * Lets a producer thread (e.g. video or image decode) run ahead of the
+ * consumer doing feature extraction, with bounded memory, and puts results
+ * finished out of order by parallel workers back into input order.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed-capacity blocking FIFO queue
+ *
+ * push() blocks while the queue is full, pop() blocks while it is empty.
+ * After close(), push() is rejected and pop() drains the remaining items
+ * and then returns false, which is how consumers learn the producer is done.
+ *
+ * Example:
+ *   BoundedQueue<cv::Mat> frames(8);
+ *   std::thread decoder([&] { ...; frames.push(std::move(frame)); ...; frames.close(); });
+ *   cv::Mat frame;
+ *   while (frames.pop(frame)) { ... }
+ *   decoder.join();
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity > 0 ? capacity : 1) {}
+
+    /**
+     * Add an item, waiting for space if the queue is full
+     * @return false if the queue was closed
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_)
+            return false;
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    /**
+     * Remove the oldest item, waiting for one if the queue is empty
+     * @return false once the queue is closed and fully drained
+     */
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty())
+            return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    /**
+     * Like pop(), but give up after `timeout` if nothing arrives
+     * @return false on timeout, or once the queue is closed and drained
+     */
+    template <typename Rep, typename Period>
+    bool popFor(T &item, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait_for(lock, timeout, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty())
+            return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    /**
+     * Stop accepting items and wake every waiting thread
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+    /**
+     * Check whether close() has been called (lets producers stop early)
+     */
+    bool closed()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_;
+    }
+
+private:
+    size_t capacity_;
+    bool closed_ = false;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+};
+
+/**
+ * Fixed-size window that turns out-of-order results back into input order
+ *
+ * Work items are numbered 0, 1, 2, ... Workers finish them in any order and
+ * put() the result under its number; drain() hands results to a single
+ * emit callback strictly in number order, so the output is the same no
+ * matter how many workers ran.
+ *
+ * Memory stays flat: acquire(i) blocks until item i is within `capacity`
+ * of the next item to be emitted, so at most `capacity` results are ever
+ * held. Call acquire() BEFORE starting work on an item (i.e. when claiming
+ * it), never after - then everything in flight already fits in the window
+ * and put() never has to wait. Keep capacity at least as large as the
+ * number of items a worker can hold at once (e.g. a whole DNN batch).
+ *
+ * Example:
+ *   ReorderBuffer<FeatureData> ordered(4 * numWorkers);
+ *   // worker
+ *   for (size_t i = next++; i < n && ordered.acquire(i); i = next++)
+ *   {
+ *       ...; ordered.put(i, std::move(row));   // or ordered.skip(i)
+ *       ordered.drain([&](FeatureData &row) { return writer.write(row); });
+ *   }
+ */
+template <typename T>
+class ReorderBuffer
+{
+public:
+    explicit ReorderBuffer(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1), slots_(capacity_), state_(capacity_, EMPTY) {}
+
+    /**
+     * Wait until item `index` fits in the window
+     * @return false if the buffer was closed
+     */
+    bool acquire(size_t index)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        advanced_.wait(lock, [&] { return closed_ || index < next_ + capacity_; });
+        return !closed_;
+    }
+
+    /**
+     * Store the result for an acquired item
+     */
+    void put(size_t index, T item)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[index % capacity_] = std::move(item);
+        state_[index % capacity_] = READY;
+    }
+
+    /**
+     * Mark an acquired item as done with nothing to emit (e.g. failed to load)
+     */
+    void skip(size_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state_[index % capacity_] = SKIPPED;
+    }
+
+    /**
+     * Emit every result that is next in order
+     *
+     * @param emit Called as emit(T &item) for each result, in order, while
+     *             the buffer is locked; return non-zero to report an error
+     * @return 0 on success, -1 if emit failed
+     *
+     * Any thread may call this after put()/skip(); whoever finds the next
+     * item ready does the emitting, so no dedicated writer thread is needed.
+     */
+    template <typename Emit>
+    int drain(Emit emit)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int status = 0;
+        bool advanced = false;
+
+        while (state_[next_ % capacity_] != EMPTY)
+        {
+            size_t slot = next_ % capacity_;
+
+            if (state_[slot] == READY && emit(slots_[slot]) != 0)
+                status = -1;
+
+            slots_[slot] = T();     // release the result's memory now
+            state_[slot] = EMPTY;
+            next_++;
+            advanced = true;
+
+            if (status != 0)
+                break;
+        }
+
+        if (advanced)
+            advanced_.notify_all();
+        return status;
+    }
+
+    /**
+     * Stop the pipeline: every waiting and future acquire() returns false
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        advanced_.notify_all();
+    }
+
+    /**
+     * Number of items emitted (or skipped) so far
+     */
+    size_t emitted()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return next_;
+    }
+
+private:
+    enum SlotState : char { EMPTY, READY, SKIPPED };
+
+    size_t capacity_;
+    size_t next_ = 0;
+    bool closed_ = false;
+    std::vector<T> slots_;
+    std::vector<char> state_;
+    std::mutex mutex_;
+    std::condition_variable advanced_;
+};
+
+#endif // PIPELINE_H
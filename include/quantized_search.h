@@ -0,0 +1,84 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: quantized_search.h
+ *
+ * Purpose:
+ * Cosine search over embeddings quantized to 8-bit integers.
+ *
+ * Each row is stored as int8 codes times one float scale (symmetric,
+ * max |x| maps to 127), a quarter of the bytes of the float row. A query
+ * is quantized the same way and scored against every row with the int8
+ * dot-product kernel; the scales and the exact float norms turn that into
+ * an approximate cosine distance. The R nearest candidates by that
+ * estimate are then rescored with the float distanceCosine, so the
+ * distances returned are exact and only the candidate list is approximate.
+ * measureInt8Recall compares the result with the float scan.
+ */
+
+#ifndef QUANTIZED_SEARCH_H
+#define QUANTIZED_SEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "batch_search.h"
+#include "distance.h"
+#include "utils.h"
+
+/**
+ * A FeatureMatrix with every row quantized to int8
+ */
+struct QuantizedMatrix
+{
+    size_t rows = 0;
+    size_t dim = 0;
+    std::vector<int8_t> codes;      // rows x dim codes
+    std::vector<float> scales;      // scales[r]: row r is approximately codes * scales[r]
+
+    const int8_t *row(size_t r) const { return codes.data() + r * dim; }
+};
+
+/**
+ * Quantize one vector: codes[i] = round(values[i] / scale), scale = max |x| / 127
+ *
+ * @param codes Output: n codes in [-127, 127]
+ * @return The scale (0 for an all-zero vector, whose codes are all 0)
+ */
+float quantizeInt8(const float *values, size_t n, int8_t *codes);
+
+/**
+ * Quantize every row of a packed matrix
+ *
+ * Done once after packing, like the row norms. The float matrix is still
+ * needed afterwards: its norms scale the int8 scores and its rows are
+ * used for rescoring.
+ */
+void quantizeFeatureMatrix(const FeatureMatrix &matrix, QuantizedMatrix &quantized);
+
+/**
+ * k nearest rows by cosine distance: int8 scan, then float rescoring
+ *
+ * @param query Query embedding, matrix.dim values
+ * @param matrix Packed float embeddings with row norms (see packFeatureDatabase)
+ * @param quantized quantizeFeatureMatrix(matrix)
+ * @param k Matches to keep
+ * @param rescore Candidates taken from the int8 scan and rescored (at least k)
+ * @param matches Output: min(k, rows) matches, nearest first, with exact distances
+ * @return 0 on success, -1 if the inputs do not fit together
+ */
+int cosineTopKInt8(FeatureView query, const FeatureMatrix &matrix, const QuantizedMatrix &quantized,
+                   size_t k, size_t rescore, std::vector<BatchMatch> &matches);
+
+/**
+ * Recall@k of cosineTopKInt8 against the exact float scan
+ *
+ * @param numQueries Database rows used as queries, evenly spaced
+ * @return Fraction of the float top-k found by the int8 search, averaged
+ *         over the queries (each query's own row is left out of both
+ *         lists), or -1 on error
+ */
+double measureInt8Recall(const FeatureMatrix &matrix, const QuantizedMatrix &quantized,
+                         size_t k, size_t rescore, size_t numQueries);
+
+#endif // QUANTIZED_SEARCH_H
@@ -0,0 +1,136 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: thumb_cache.h
+ *
+ * Purpose:
+ * Packed cache of small, uncompressed BGR thumbnails (128 px on the long
+ * side), written once during a full extraction. New or re-binned
+ * histogram features can then be recomputed from the cache at memory
+ * speed instead of decoding every full-size JPEG again.
+ *
+ * File layout (little-endian):
+ *   header:  "CBIRTHMB" | uint32 version | uint32 long side
+ *   record:  uint32 key length | key bytes | uint16 width | uint16 height |
+ *            width * height * 3 bytes of BGR pixels (row-major, no padding)
+ *
+ * Records are only ever appended. A run that dies mid-record leaves a
+ * partial tail, which the writer cuts off when it reopens the file.
+ */
+
+#ifndef THUMB_CACHE_H
+#define THUMB_CACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Long side of a cached thumbnail, in pixels
+const int THUMB_CACHE_LONG_SIDE = 128;
+
+/**
+ * Downsample an image for the thumbnail cache
+ *
+ * @param src Source image (BGR)
+ * @param dst Output: src scaled so its long side is THUMB_CACHE_LONG_SIDE
+ *            (area interpolation); images already that small are copied
+ * @return 0 on success, -1 on error
+ */
+int makeCacheThumbnail(const cv::Mat &src, cv::Mat &dst);
+
+/**
+ * Location of one thumbnail inside a loaded cache file
+ */
+struct ThumbnailCacheEntry
+{
+    std::string key;
+    size_t offset = 0;      // start of the pixels
+    int width = 0;
+    int height = 0;
+};
+
+/**
+ * Appends thumbnails to a cache file
+ *
+ * Not thread-safe: downsample on the workers with makeCacheThumbnail and
+ * call write() from the single in-order writer.
+ *
+ * Example:
+ *   ThumbnailCacheWriter cache;
+ *   std::unordered_set<std::string> cached;
+ *   cache.open("data/olympus.thumbs", true, cached);
+ *   cache.write("pic.0001.jpg", thumbnail);
+ *   cache.close();
+ */
+class ThumbnailCacheWriter
+{
+public:
+    /**
+     * Open a cache for writing
+     *
+     * @param path Cache file
+     * @param append Keep the records of an existing cache (and cut off a
+     *               partial last record) instead of starting a new file
+     * @param cachedKeys Output: keys already in the cache
+     * @return 0 on success, -1 on error
+     */
+    int open(const std::string &path, bool append, std::unordered_set<std::string> &cachedKeys);
+
+    /**
+     * Append one thumbnail
+     *
+     * @param key Row key (filename, or file#frame)
+     * @param thumbnail Output of makeCacheThumbnail (CV_8UC3)
+     * @return 0 on success, -1 on error
+     */
+    int write(const std::string &key, const cv::Mat &thumbnail);
+
+    /**
+     * Flush and close
+     * @return 0 on success, -1 on error
+     */
+    int close();
+
+    bool isOpen() const { return file.is_open(); }
+
+    // Thumbnails appended since open()
+    size_t written() const { return newRecords; }
+
+private:
+    std::string cachePath;
+    std::ofstream file;
+    size_t newRecords = 0;
+};
+
+/**
+ * Read-only view of a whole cache file, loaded into memory
+ *
+ * image(i) returns a header over the loaded bytes (no copy), so extracting
+ * from the cache never touches the disk after load().
+ */
+class ThumbnailCache
+{
+public:
+    /**
+     * Load and index a cache file
+     * @return 0 on success, -1 on error (missing file, bad header, corrupt record)
+     */
+    int load(const std::string &path);
+
+    size_t size() const { return entries.size(); }
+    const std::string &key(size_t i) const { return entries[i].key; }
+
+    /**
+     * Thumbnail i as a CV_8UC3 view into the loaded data (valid while the cache lives)
+     */
+    cv::Mat image(size_t i) const;
+
+private:
+    std::vector<uint8_t> data;
+    std::vector<ThumbnailCacheEntry> entries;
+};
+
+#endif // THUMB_CACHE_H
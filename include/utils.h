@@ -13,8 +13,10 @@
 #define UTILS_H
 
 #include <opencv2/opencv.hpp>
+#include <fstream>
 #include <vector>
 #include <string>
+#include <unordered_set>
 
 /**
  * Structure to hold feature data
@@ -25,6 +27,34 @@ struct FeatureData {
     std::vector<float> feature;     
 };
 
+/**
+ * Feature database rows packed into one contiguous block
+ *
+ * A std::vector<FeatureData> keeps every row in its own heap allocation,
+ * so a scan chases one pointer per row. The matrix stores the rows back to
+ * back (row-major), which is what the batch distances in distance.h read.
+ * Rows are packed once after loading and reused for every query.
+ */
+struct FeatureMatrix {
+    size_t rows = 0;
+    size_t dim = 0;
+    std::vector<float> data;        // rows x dim values
+    std::vector<size_t> source;     // source[r]: index of row r in the database it was packed from
+    std::vector<float> norms;       // norms[r]: L2 norm of row r, for cosine (computeRowNorms in distance.h)
+
+    const float *row(size_t r) const { return data.data() + r * dim; }
+};
+
+/**
+ * Pack the rows of a feature database into a FeatureMatrix
+ * @param db Feature database
+ * @param dim Row length to keep
+ * @param matrix Output matrix (replaced)
+ * @return Number of rows left out because their length is not dim
+ */
+int buildFeatureMatrix(const std::vector<FeatureData> &db, size_t dim,
+                       FeatureMatrix &matrix);
+
 /**
  * Structure to hold query results
  * Contains filename and distance from query image
@@ -38,6 +68,95 @@ struct MatchResult {
     }
 };
 
+/**
+ * The nearest and farthest matches of one query
+ */
+struct MatchSelection {
+    std::vector<MatchResult> best;      // nearest matches, nearest first
+    std::vector<MatchResult> worst;     // farthest matches, ascending (farthest last)
+    size_t ranked = 0;                  // rows that had a valid distance
+};
+
+/**
+ * Keeps the k smallest and k largest distances of a scan
+ *
+ * Displaying a query reads only its top few (and for custom features the
+ * bottom 3) matches, so sorting every MatchResult is wasted work: N log N
+ * comparisons, and a string move per swap. The selector keeps two bounded
+ * heaps of (distance, database index) pairs instead, O(N log k), and
+ * builds MatchResults for the kept rows only. Each thread of a scan fills
+ * its own selector and the partial heaps are merged at the end. Ties are
+ * broken by database index, so the result does not depend on the merge
+ * order.
+ *
+ * Example:
+ *   MatchSelector selector(5, 0);
+ *   for (size_t i = 0; i < db.size(); i++)
+ *       selector.add(i, distance(target, db[i].feature));
+ *   MatchSelection selection;
+ *   selector.finish(db, selection);
+ */
+class MatchSelector
+{
+public:
+    /**
+     * @param keepBest Nearest matches to keep
+     * @param keepWorst Farthest matches to keep
+     */
+    MatchSelector(size_t keepBest = 0, size_t keepWorst = 0)
+        : keepBest(keepBest), keepWorst(keepWorst) {}
+
+    /**
+     * Offer one database row
+     * @param item Index of the row in the database (db passed to finish)
+     * @param distance Its distance to the query
+     */
+    void add(size_t item, float distance);
+
+    /** Add the rows kept by another selector with the same k */
+    void merge(const MatchSelector &other);
+
+    /**
+     * Largest distance that can still enter the nearest matches: the k-th
+     * best so far, or infinity while fewer than keepBest rows are in or
+     * the farthest matches are wanted too
+     */
+    float bound() const;
+
+    /** Rows offered so far, including merged ones */
+    size_t count() const { return offered; }
+
+    /**
+     * Build the kept matches, sorted
+     * @param db The database the item indices refer to
+     * @param selection Output (replaced)
+     */
+    void finish(const std::vector<FeatureData> &db, MatchSelection &selection) const;
+
+private:
+    struct Entry
+    {
+        float distance;
+        size_t item;
+    };
+
+    // Strict (distance, item) order, so equal distances keep a fixed order
+    static bool nearer(const Entry &a, const Entry &b)
+    {
+        return a.distance < b.distance || (a.distance == b.distance && a.item < b.item);
+    }
+    static bool farther(const Entry &a, const Entry &b) { return nearer(b, a); }
+
+    void offerBest(const Entry &entry);
+    void offerWorst(const Entry &entry);
+
+    size_t keepBest;
+    size_t keepWorst;
+    size_t offered = 0;
+    std::vector<Entry> best;        // max-heap under nearer(): the worst kept match on top
+    std::vector<Entry> worst;       // max-heap under farther(): the nearest kept match on top
+};
+
 /**
  * Write features to CSV file
  * Format: filename,feature1,feature2,...,featureN
@@ -94,6 +213,109 @@ int readFeaturesFromCSV(const std::string &filename,
 int getImageFilenames(const std::string &dirPath, 
                       std::vector<std::string> &filenames);
 
+/**
+ * Get all video filenames from a directory
+ * Filters for common video extensions (.mp4, .avi, .mov, .mkv, .m4v, .webm)
+ * @param dirPath Directory path to search
+ * @param filenames Output vector of filenames (relative to dirPath)
+ * @return 0 on success, -1 on error
+ *
+ * Same behaviour as getImageFilenames (case-insensitive extensions,
+ * basenames only, sorted alphabetically), but for video files.
+ */
+int getVideoFilenames(const std::string &dirPath,
+                      std::vector<std::string> &filenames);
+
+/**
+ * Check whether a path has a video file extension
+ * @param path File path or filename
+ * @return true for .mp4, .avi, .mov, .mkv, .m4v, .webm (any case)
+ */
+bool isVideoFile(const std::string &path);
+
+/**
+ * Checkpointed, resumable feature CSV writer
+ *
+ * Rows are appended to the CSV as they are produced. Every
+ * checkpointEvery rows the file is flushed and a progress marker
+ * "<csv>.progress" records how many rows and bytes are committed:
+ *
+ *   rows 12500
+ *   bytes 18734112
+ *
+ * The marker is replaced atomically (written to a temp file, then
+ * renamed), so after a crash it always describes a prefix of complete
+ * rows. close() removes it once the whole run has been written.
+ *
+ * Resuming (open with resume = true):
+ *  - marker present: the CSV is truncated back to the committed bytes
+ *    (dropping any half-written tail) and the committed keys are returned
+ *  - no marker but the CSV exists: the previous run finished, every row
+ *    in it counts as committed
+ *  - neither: a fresh run
+ *
+ * Example:
+ *   FeatureCSVWriter writer;
+ *   std::unordered_set<std::string> done;
+ *   writer.open("data/histogram_features.csv", true, done);
+ *   ... skip keys in done, writer.write(row) for the rest ...
+ *   writer.close();
+ */
+class FeatureCSVWriter
+{
+public:
+    /**
+     * Open the CSV for writing
+     * @param path Output CSV filename
+     * @param resume Keep committed rows from an interrupted run
+     * @param committedKeys Output: keys (filenames) already in the CSV
+     * @return 0 on success, -1 on error
+     */
+    int open(const std::string &path, bool resume,
+             std::unordered_set<std::string> &committedKeys);
+
+    /**
+     * Append one row; checkpoints automatically every checkpointEvery rows
+     * @return 0 on success, -1 on write error
+     */
+    int write(const FeatureData &data);
+
+    /**
+     * Append one row from a key and a feature vector (no FeatureData copy)
+     * @return 0 on success, -1 on write error
+     */
+    int write(const std::string &key, const std::vector<float> &feature);
+
+    /**
+     * Flush the CSV and record the committed rows/bytes in the marker
+     * @return 0 on success, -1 on error
+     */
+    int checkpoint();
+
+    /**
+     * Final checkpoint, close the CSV and remove the progress marker
+     * @return 0 on success, -1 on error
+     */
+    int close();
+
+    /** Rows in the CSV, including ones committed by an earlier run */
+    size_t rows() const { return rowCount; }
+
+    /** Rows written by this run */
+    size_t rowsWritten() const { return newRows; }
+
+    /** Rows between automatic checkpoints */
+    size_t checkpointEvery = 500;
+
+private:
+    std::string csvPath;
+    std::string progressPath;
+    std::ofstream file;
+    size_t rowCount = 0;
+    size_t newRows = 0;
+    size_t sinceCheckpoint = 0;
+};
+
 /**
  * Print top N matches to console
  * Displays ranked results with distances
@@ -0,0 +1,66 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: video.h
+ *
+ * Purpose:
+ * Frame sampling for video inputs, so video archives can be indexed
+ * directly instead of dumping frames to JPEG first. Decoding runs on its
+ * own thread and is pipelined with feature extraction.
+ */
+
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Frame sampling options for sampleVideoFrames
+ *
+ * frameStride:    Only every Nth frame is a candidate (1 = every frame)
+ * sceneThreshold: If > 0, a candidate is kept only when its coarse rg
+ *                 histogram differs from the last kept frame by more than
+ *                 this histogram-intersection distance (scene change mode).
+ *                 If 0, every candidate is kept (fixed stride mode).
+ * queueDepth:     Decoded frames buffered between decode and extraction
+ */
+struct VideoSamplingOptions
+{
+    int frameStride = 30;
+    float sceneThreshold = 0.0f;
+    int queueDepth = 8;
+};
+
+/**
+ * Key used for a video frame's feature row: "<video filename>#<frame index>"
+ *
+ * Example: videoFrameKey("harbor.mp4", 120) -> "harbor.mp4#120"
+ */
+std::string videoFrameKey(const std::string &videoFilename, int frameIndex);
+
+/**
+ * Decode a video and hand sampled frames to a callback
+ *
+ * @param path Path to the video file (anything cv::VideoCapture can open)
+ * @param options Stride / scene-change sampling options
+ * @param onFrame Called on the calling thread for every kept frame with
+ *                (frameIndex, frame); return non-zero to stop early
+ * @return Number of frames passed to onFrame, or -1 if the video could not be opened
+ *
+ * Implementation details:
+ *  - A decode thread reads the video with cv::VideoCapture and pushes kept
+ *    frames into a bounded queue; the calling thread pops them and runs
+ *    onFrame, so decode and extraction overlap.
+ *  - Non-candidate frames are only grab()bed, never retrieve()d, which
+ *    skips colour conversion for frames that would be thrown away.
+ *  - Scene detection compares 8x8 rg histograms of a 64-px-wide thumbnail,
+ *    so it costs almost nothing next to the decode itself.
+ */
+int sampleVideoFrames(const std::string &path,
+                      const VideoSamplingOptions &options,
+                      const std::function<int(int, const cv::Mat &)> &onFrame);
+
+#endif // VIDEO_H
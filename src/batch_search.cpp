@@ -0,0 +1,112 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: batch_search.cpp
+ *
+ * Purpose:
+ * Blocked multi-query cosine scoring with cv::gemm (see batch_search.h).
+ */
+
+#include "batch_search.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <iostream>
+
+/**
+ * k nearest database rows of every query by cosine distance
+ */
+int cosineTopKGemm(const FeatureMatrix &queries, const FeatureMatrix &db, int k,
+                   std::vector<std::vector<BatchMatch>> &matches)
+{
+    // === Step 1: Validate input ===
+
+    if (queries.dim != db.dim || queries.dim == 0)
+    {
+        std::cerr << "Error: Query and database embeddings have different lengths: "
+                  << queries.dim << " vs " << db.dim << std::endl;
+        return -1;
+    }
+
+    if (queries.norms.size() != queries.rows || db.norms.size() != db.rows)
+    {
+        std::cerr << "Error: Embedding matrices need their row norms (pack them with packFeatureDatabase)" << std::endl;
+        return -1;
+    }
+
+    if (k <= 0)
+    {
+        std::cerr << "Error: Number of matches must be positive" << std::endl;
+        return -1;
+    }
+
+    matches.assign(queries.rows, std::vector<BatchMatch>());
+
+    if (queries.rows == 0 || db.rows == 0)
+        return 0;
+
+    size_t keep = std::min(static_cast<size_t>(k), db.rows);
+    int dim = static_cast<int>(queries.dim);
+    int numQueryBlocks = static_cast<int>((queries.rows + GEMM_QUERY_BLOCK - 1) / GEMM_QUERY_BLOCK);
+
+    // === Step 2: One query block per task; each walks every database block ===
+
+    cv::parallel_for_(cv::Range(0, numQueryBlocks), [&](const cv::Range &range)
+    {
+        cv::Mat scores;
+
+        for (int block = range.start; block < range.end; block++)
+        {
+            size_t q0 = static_cast<size_t>(block) * GEMM_QUERY_BLOCK;
+            int numQueries = static_cast<int>(std::min(static_cast<size_t>(GEMM_QUERY_BLOCK), queries.rows - q0));
+
+            // Headers over the packed rows: no copy
+            cv::Mat queryBlock(numQueries, dim, CV_32F, const_cast<float *>(queries.row(q0)));
+
+            for (int q = 0; q < numQueries; q++)
+            {
+                matches[q0 + q].reserve(keep);
+            }
+
+            for (size_t r0 = 0; r0 < db.rows; r0 += GEMM_DB_BLOCK)
+            {
+                int numRows = static_cast<int>(std::min(static_cast<size_t>(GEMM_DB_BLOCK), db.rows - r0));
+                cv::Mat dbBlock(numRows, dim, CV_32F, const_cast<float *>(db.row(r0)));
+
+                // scores = queryBlock * dbBlock^T: all dot products of the two blocks
+                cv::gemm(queryBlock, dbBlock, 1.0, cv::Mat(), 0.0, scores, cv::GEMM_2_T);
+
+                // === Step 3: Dot products to distances, into each query's heap ===
+
+                for (int q = 0; q < numQueries; q++)
+                {
+                    const float *dots = scores.ptr<float>(q);
+                    float queryNorm = queries.norms[q0 + q];
+                    std::vector<BatchMatch> &heap = matches[q0 + q];
+
+                    for (int r = 0; r < numRows; r++)
+                    {
+                        float rowNorm = db.norms[r0 + r];
+                        float distance = 1.0f;  // Maximum distance for zero-length vectors
+
+                        if (queryNorm >= 1e-10f && rowNorm >= 1e-10f)
+                        {
+                            float similarity = dots[r] / (queryNorm * rowNorm);
+                            distance = 1.0f - std::max(-1.0f, std::min(1.0f, similarity));
+                        }
+
+                        keepNearest(heap, BatchMatch{r0 + r, distance}, keep);
+                    }
+                }
+            }
+
+            // === Step 4: Nearest first ===
+
+            for (int q = 0; q < numQueries; q++)
+            {
+                std::sort_heap(matches[q0 + q].begin(), matches[q0 + q].end(), nearerMatch);
+            }
+        }
+    });
+
+    return 0;
+}
@@ -20,6 +20,7 @@
 #include <vector>
 #include <algorithm>
 #include "distance.h"
+#include "feature_registry.h"
 #include "utils.h"
 
 const int THUMB_W = 180;
@@ -59,8 +60,18 @@ void drawBorder(cv::Mat &img, const cv::Scalar &color, int t = 3)
     cv::rectangle(img, cv::Point(0, 0), cv::Point(img.cols - 1, img.rows - 1), color, t);
 }
 
+/**
+ * Nearest images of a DNN database by cosine distance to one of its images
+ *
+ * @param matrix db packed by packFeatureDatabase<DnnType>, with its row norms; each
+ *               row costs one dot product (distanceCosineBatch)
+ * @param numMatches Matches to return (the target itself is left out)
+ * @return The matches, nearest first
+ */
 std::vector<MatchResult> queryDNN(const std::string &targetFile,
-                                   const std::vector<FeatureData> &db)
+                                   const std::vector<FeatureData> &db,
+                                   const FeatureMatrix &matrix,
+                                   int numMatches)
 {
     std::vector<MatchResult> results;
     std::vector<float> tFeat;
@@ -72,24 +83,24 @@ std::vector<MatchResult> queryDNN(const std::string &targetFile,
             break;
         }
 
-    if (tFeat.empty())
+    if (tFeat.size() != matrix.dim || matrix.rows == 0)
         return results;
 
-    for (size_t i = 0; i < db.size(); i++)
+    std::vector<float> dist(matrix.rows);
+    distanceCosineBatch(tFeat, matrix.row(0), matrix.norms.data(), matrix.rows, dist.data());
+
+    // Bounded heap of the nearest rows instead of sorting them all
+    MatchSelector selector(static_cast<size_t>(std::max(numMatches, 0)), 0);
+    for (size_t r = 0; r < matrix.rows; r++)
     {
-        if (db[i].filename == targetFile)
+        if (db[matrix.source[r]].filename == targetFile)
             continue;
-        float dist = distanceCosine(tFeat, db[i].feature);
-        if (dist >= 0)
-        {
-            MatchResult m;
-            m.filename = db[i].filename;
-            m.distance = dist;
-            results.push_back(m);
-        }
+        selector.add(matrix.source[r], dist[r]);
     }
-    std::sort(results.begin(), results.end());
-    return results;
+
+    MatchSelection selection;
+    selector.finish(db, selection);
+    return selection.best;
 }
 
 cv::Mat buildComparisonImage(const std::string &targetFile,
@@ -216,6 +227,11 @@ int main(int argc, char *argv[])
     }
     std::cout << "  Loaded " << customDb.size() << " vectors (" << customDb[0].feature.size() << "D)" << std::endl;
 
+    // Pack each database and its row norms once; every query scans the packed rows
+    FeatureMatrix providedMatrix, customMatrix;
+    packFeatureDatabase<DnnType>(providedDb, providedMatrix);
+    packFeatureDatabase<DnnType>(customDb, customMatrix);
+
     // Query images to compare
     std::vector<std::string> queryImages = {"pic.0893.jpg", "pic.0164.jpg", "pic.1072.jpg"};
     int numMatches = 3;
@@ -227,8 +243,8 @@ int main(int argc, char *argv[])
     {
         std::cout << "\nComparing: " << query << std::endl;
 
-        auto providedResults = queryDNN(query, providedDb);
-        auto customResults = queryDNN(query, customDb);
+        auto providedResults = queryDNN(query, providedDb, providedMatrix, numMatches);
+        auto customResults = queryDNN(query, customDb, customMatrix, numMatches);
 
         std::cout << "  Provided top 3: ";
         for (int i = 0; i < 3 && i < (int)providedResults.size(); i++)
@@ -9,9 +9,41 @@
  */
 
 #include "distance.h"
+#include "distance_simd.h"
+#include "features.h"
 #include <iostream>
+#include <algorithm>
 #include <cmath>
 
+/**
+ * Check that two feature vectors can be compared
+ */
+bool validateFeaturePair(FeatureView feature1, FeatureView feature2,
+                         size_t expectedSize, const char *what)
+{
+    if (feature1.size != feature2.size)
+    {
+        std::cerr << "Error: " << what << " feature vectors have different sizes: "
+                  << feature1.size << " vs " << feature2.size << std::endl;
+        return false;
+    }
+    
+    if (feature1.size == 0)
+    {
+        std::cerr << "Error: " << what << " feature vectors are empty" << std::endl;
+        return false;
+    }
+    
+    if (expectedSize != 0 && feature1.size != expectedSize)
+    {
+        std::cerr << "Error: " << what << " feature vectors must be " << expectedSize
+                  << " values. Got: " << feature1.size << std::endl;
+        return false;
+    }
+    
+    return true;
+}
+
 /**
  * Sum of Squared Differences (SSD) distance metric
  *
@@ -69,6 +101,9 @@
  *  - Very similar: SSD = small value (e.g., 100-5000)
  *  - Different: SSD = large value (e.g., 50000-200000)
  *  - Very different: SSD = very large value (e.g., 500000+)
+ *
+ * The loop itself runs in kernelSSD (distance_simd.h), which splits the sum
+ * over several vector accumulators instead of one float.
  */
 float distanceSSD(const std::vector<float> &feature1,
                   const std::vector<float> &feature2)
@@ -90,30 +125,17 @@ float distanceSSD(const std::vector<float> &feature1,
         return -1.0f;
     }
 
-    // === Step 2: Initialize accumulator ===
-
-    // This will hold the sum of all squared differences
-    float sum = 0.0f;
-
-    // === Step 3: Compute SSD ===
-
-    // Get the size once (more efficient than calling .size() repeatedly)
-    size_t n = feature1.size();
+    // === Step 2: Compute SSD (vectorized) ===
 
-    // Loop through all elements in the feature vectors
-    for (size_t i = 0; i < n; i++)
-    {
-        // Calculate the difference between corresponding elements
-        float diff = feature1[i] - feature2[i];
-
-        // Square the difference and add to sum
-        // Using diff * diff instead of pow(diff, 2) for performance
-        sum += diff * diff;
-    }
-
-    // === Step 4: Return result ===
+    return distanceSSD(FeatureView(feature1), FeatureView(feature2));
+}
 
-    return sum;
+/**
+ * SSD over views (unchecked)
+ */
+float distanceSSD(FeatureView feature1, FeatureView feature2)
+{
+    return kernelSSD(feature1.data, feature2.data, feature1.size);
 }
 
 /**
@@ -139,15 +161,16 @@ float distanceHistogramIntersection(const std::vector<float> &feature1,
     
     // === Step 2: Compute histogram intersection ===
     
-    float intersection = 0.0f;
-    
-    // For each bin, take the minimum value
-    for (size_t i = 0; i < feature1.size(); i++)
-    {
-        // Take minimum of the two histogram bins
-        float minVal = std::min(feature1[i], feature2[i]);
-        intersection += minVal;
-    }
+    return distanceHistogramIntersection(FeatureView(feature1), FeatureView(feature2));
+}
+
+/**
+ * Histogram intersection over views (unchecked)
+ */
+float distanceHistogramIntersection(FeatureView feature1, FeatureView feature2)
+{
+    // Sum of the per-bin minimums (vectorized)
+    float intersection = kernelIntersection(feature1.data, feature2.data, feature1.size);
     
     // === Step 3: Convert intersection to distance ===
     
@@ -201,11 +224,7 @@ float distanceMultiHistogram(const std::vector<float> &feature1,
         std::cerr << "Warning: Weights do not sum to 1.0 (sum = " << weightSum << ")" << std::endl;
     }
     
-    // === Step 2: Calculate histogram size ===
-    
     // Each histogram has equal size
-    size_t histogramSize = feature1.size() / numHistograms;
-    
     if (feature1.size() % numHistograms != 0)
     {
         std::cerr << "Error: Feature vector size (" << feature1.size() 
@@ -213,28 +232,31 @@ float distanceMultiHistogram(const std::vector<float> &feature1,
         return -1.0f;
     }
     
+    return distanceMultiHistogram(FeatureView(feature1), FeatureView(feature2),
+                                  numHistograms, weights.data());
+}
+
+/**
+ * Multi-histogram distance over views (unchecked)
+ */
+float distanceMultiHistogram(FeatureView feature1, FeatureView feature2,
+                             int numHistograms, const float *weights)
+{
+    // === Step 2: Calculate histogram size ===
+    
+    size_t histogramSize = feature1.size / numHistograms;
+    
     // === Step 3: Compute distance for each histogram pair ===
     
     float totalDistance = 0.0f;
     
     for (int h = 0; h < numHistograms; h++)
     {
-        // Extract the h-th histogram from both feature vectors
+        // The h-th histogram of both rows, sliced in place
         size_t startIdx = h * histogramSize;
-        size_t endIdx = startIdx + histogramSize;
-        
-        // Create sub-vectors for this histogram
-        std::vector<float> hist1(feature1.begin() + startIdx, feature1.begin() + endIdx);
-        std::vector<float> hist2(feature2.begin() + startIdx, feature2.begin() + endIdx);
         
-        // Compute histogram intersection distance for this pair
-        float dist = distanceHistogramIntersection(hist1, hist2);
-        
-        if (dist < 0)
-        {
-            std::cerr << "Error: Failed to compute distance for histogram " << h << std::endl;
-            return -1.0f;
-        }
+        float dist = distanceHistogramIntersection(feature1.slice(startIdx, histogramSize),
+                                                   feature2.slice(startIdx, histogramSize));
         
         // Add weighted distance to total
         totalDistance += weights[h] * dist;
@@ -243,6 +265,256 @@ float distanceMultiHistogram(const std::vector<float> &feature1,
     return totalDistance;
 }
 
+/**
+ * Spatial pyramid match distance
+ */
+float distancePyramidMatch(const std::vector<float> &feature1,
+                           const std::vector<float> &feature2,
+                           int levels,
+                           int binsPerCell)
+{
+    // === Step 1: Validate input ===
+    
+    if (feature1.size() != feature2.size())
+    {
+        std::cerr << "Error: Pyramid feature vectors have different sizes: "
+                  << feature1.size() << " vs " << feature2.size() << std::endl;
+        return -1.0f;
+    }
+    
+    if (levels <= 0 || binsPerCell <= 0)
+    {
+        std::cerr << "Error: Pyramid levels and bins per cell must be positive" << std::endl;
+        return -1.0f;
+    }
+    
+    size_t expected = pyramidFeatureSize(levels, binsPerCell);
+    
+    if (feature1.size() != expected)
+    {
+        std::cerr << "Error: Pyramid feature size (" << feature1.size()
+                  << ") doesn't match " << levels << " levels of "
+                  << binsPerCell << " bins (" << expected << ")" << std::endl;
+        return -1.0f;
+    }
+    
+    return distancePyramidMatch(FeatureView(feature1), FeatureView(feature2), levels, binsPerCell);
+}
+
+/**
+ * Length of a pyramid feature
+ */
+size_t pyramidFeatureSize(int levels, int binsPerCell)
+{
+    // Level l has 4^l cells
+    size_t expected = 0;
+    for (int level = 0; level < levels; level++)
+    {
+        expected += (static_cast<size_t>(1) << (2 * level)) * binsPerCell;
+    }
+    return expected;
+}
+
+/**
+ * Pyramid match over views (unchecked)
+ */
+float distancePyramidMatch(FeatureView feature1, FeatureView feature2,
+                           int levels, int binsPerCell)
+{
+    // === Step 2: Mean cell intersection per level, weighted ===
+    
+    int finest = levels - 1;
+    float similarity = 0.0f;
+    size_t offset = 0;
+    
+    for (int level = 0; level < levels; level++)
+    {
+        int numCells = 1 << (2 * level);
+        size_t levelSize = static_cast<size_t>(numCells) * binsPerCell;
+        
+        float intersection = kernelIntersection(feature1.data + offset, feature2.data + offset, levelSize);
+        
+        // Each cell histogram sums to 1, so the mean is in [0, 1]
+        float levelSimilarity = intersection / numCells;
+        
+        // 1/2^L for the coarsest level, 1/2^(L-l+1) for the others
+        int shift = (level == 0) ? finest : finest - level + 1;
+        similarity += levelSimilarity / static_cast<float>(1 << shift);
+        
+        offset += levelSize;
+    }
+    
+    // === Step 3: Convert similarity to distance ===
+    
+    return 1.0f - similarity;
+}
+
+
+/**
+ * Check a grid shape and reduce a grid query to one cell histogram
+ *
+ * @param target Output: binsPerCell values
+ * @return 0 on success, -1 (after printing why) if the sizes do not fit
+ */
+static int prepareGridQuery(FeatureView query, int gridSize, int binsPerCell, std::vector<float> &target)
+{
+    if (gridSize <= 0 || binsPerCell <= 0)
+    {
+        std::cerr << "Error: Grid size and bins per cell must be positive" << std::endl;
+        return -1;
+    }
+    
+    size_t numCells = static_cast<size_t>(gridSize) * gridSize;
+    size_t gridLength = numCells * binsPerCell;
+    
+    target.assign(binsPerCell, 0.0f);
+    
+    if (query.size == static_cast<size_t>(binsPerCell))
+    {
+        target.assign(query.data, query.data + query.size);
+    }
+    else if (query.size == gridLength)
+    {
+        // Cells are fractions of the whole image, so their sum is already normalized
+        for (size_t cell = 0; cell < numCells; cell++)
+        {
+            for (int i = 0; i < binsPerCell; i++)
+            {
+                target[i] += query[cell * binsPerCell + i];
+            }
+        }
+    }
+    else
+    {
+        std::cerr << "Error: Grid query size (" << query.size << ") must be "
+                  << binsPerCell << " (region) or " << gridLength << " (whole grid)" << std::endl;
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Best-window distance from a reduced query to one grid row
+ *
+ * @param sat Scratch for the summed-area table (reused across rows)
+ * @param window Scratch, binsPerCell values
+ */
+static float bestGridWindow(const float *target, const float *grid, int gridSize, int binsPerCell,
+                            std::vector<double> &sat, float *window, GridWindow *best)
+{
+    // === Summed-area table over the cells ===
+    
+    buildCellSAT(grid, gridSize, gridSize, binsPerCell, sat);
+    
+    // === Best intersection over every window ===
+    
+    float bestIntersection = -1.0f;
+    
+    for (int row0 = 0; row0 < gridSize; row0++)
+    {
+        for (int row1 = row0 + 1; row1 <= gridSize; row1++)
+        {
+            for (int col0 = 0; col0 < gridSize; col0++)
+            {
+                for (int col1 = col0 + 1; col1 <= gridSize; col1++)
+                {
+                    // Windows with no (non-black) pixels cannot match anything
+                    if (cellRegionHistogram(sat, gridSize, binsPerCell,
+                                            row0, col0, row1, col1, window) <= 0)
+                        continue;
+                    
+                    float intersection = kernelIntersection(target, window, binsPerCell);
+                    
+                    if (intersection > bestIntersection)
+                    {
+                        bestIntersection = intersection;
+                        if (best != nullptr)
+                        {
+                            *best = GridWindow{row0, col0, row1, col1};
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    // === Convert intersection to distance ===
+    
+    // An all-black image has no windows; treat it as no overlap
+    if (bestIntersection < 0)
+    {
+        return 1.0f;
+    }
+    
+    return 1.0f - bestIntersection;
+}
+
+/**
+ * Best-window distance between a query histogram and a grid feature
+ */
+float distanceGridWindow(FeatureView query,
+                         FeatureView grid,
+                         int gridSize,
+                         int binsPerCell,
+                         GridWindow *best)
+{
+    // === Step 1: Validate input, reduce a whole-grid query to one histogram ===
+    
+    std::vector<float> target;
+    if (prepareGridQuery(query, gridSize, binsPerCell, target) != 0)
+    {
+        return -1.0f;
+    }
+    
+    size_t numCells = static_cast<size_t>(gridSize) * gridSize;
+    
+    if (grid.size != numCells * binsPerCell)
+    {
+        std::cerr << "Error: Grid feature size (" << grid.size << ") doesn't match "
+                  << gridSize << "x" << gridSize << " cells of " << binsPerCell
+                  << " bins" << std::endl;
+        return -1.0f;
+    }
+    
+    // === Step 2: Best window ===
+    
+    std::vector<double> sat;
+    std::vector<float> window(binsPerCell);
+    return bestGridWindow(target.data(), grid.data, gridSize, binsPerCell, sat, window.data(), best);
+}
+
+/**
+ * Best-window distances from one query to a block of grid rows
+ */
+int distanceGridWindowBatch(FeatureView query, const float *rows, size_t count,
+                            int gridSize, int binsPerCell, float *out)
+{
+    // === Step 1: Validate and reduce the query once for the block ===
+    
+    std::vector<float> target;
+    if (prepareGridQuery(query, gridSize, binsPerCell, target) != 0)
+    {
+        std::fill(out, out + count, -1.0f);
+        return -1;
+    }
+    
+    // === Step 2: Every row, with one table and window buffer ===
+    
+    size_t gridLength = static_cast<size_t>(gridSize) * gridSize * binsPerCell;
+    std::vector<double> sat;
+    std::vector<float> window(binsPerCell);
+    
+    for (size_t r = 0; r < count; r++)
+    {
+        out[r] = bestGridWindow(target.data(), rows + r * gridLength, gridSize, binsPerCell,
+                                sat, window.data(), nullptr);
+    }
+    
+    return 0;
+}
+
+
 /**
  * Texture-Color distance metric
  */
@@ -273,36 +545,38 @@ float distanceTextureColor(const std::vector<float> &feature1,
         std::cerr << "Warning: Weights do not sum to 1.0 (sum = " << weightSum << ")" << std::endl;
     }
     
-    // === Step 2: Extract color histograms ===
-    
-    std::vector<float> color1(feature1.begin(), feature1.begin() + colorSize);
-    std::vector<float> color2(feature2.begin(), feature2.begin() + colorSize);
+    if (colorSize <= 0 || textureSize <= 0)
+    {
+        std::cerr << "Error: Color and texture sizes must be positive" << std::endl;
+        return -1.0f;
+    }
     
-    // === Step 3: Extract texture histograms ===
+    return distanceTextureColor(FeatureView(feature1), FeatureView(feature2),
+                                colorSize, textureSize, colorWeight, textureWeight);
+}
+
+/**
+ * Texture-colour distance over views (unchecked)
+ */
+float distanceTextureColor(FeatureView feature1, FeatureView feature2,
+                           int colorSize, int textureSize,
+                           float colorWeight, float textureWeight)
+{
+    // === Step 2-3: Slice the color and texture histograms ===
     
-    std::vector<float> texture1(feature1.begin() + colorSize, feature1.end());
-    std::vector<float> texture2(feature2.begin() + colorSize, feature2.end());
+    FeatureView color1 = feature1.slice(0, colorSize);
+    FeatureView color2 = feature2.slice(0, colorSize);
+    FeatureView texture1 = feature1.slice(colorSize, textureSize);
+    FeatureView texture2 = feature2.slice(colorSize, textureSize);
     
     // === Step 4: Compute color distance ===
     
     float colorDist = distanceHistogramIntersection(color1, color2);
     
-    if (colorDist < 0)
-    {
-        std::cerr << "Error: Failed to compute color histogram distance" << std::endl;
-        return -1.0f;
-    }
-    
     // === Step 5: Compute texture distance ===
     
     float textureDist = distanceHistogramIntersection(texture1, texture2);
     
-    if (textureDist < 0)
-    {
-        std::cerr << "Error: Failed to compute texture histogram distance" << std::endl;
-        return -1.0f;
-    }
-    
     // === Step 6: Combine with weighted sum ===
     
     float totalDistance = colorWeight * colorDist + textureWeight * textureDist;
@@ -312,45 +586,17 @@ float distanceTextureColor(const std::vector<float> &feature1,
 
 
 /**
- * Cosine distance metric
+ * Cosine distance shared by both overloads
+ *
+ * @param degenerate Set to true if either vector has near-zero length
+ *                   (the distance is then the maximum, 1)
  */
-float distanceCosine(const std::vector<float> &feature1,
-                     const std::vector<float> &feature2)
+static float cosineDistance(FeatureView feature1, FeatureView feature2, bool &degenerate)
 {
-    // === Step 1: Validate input ===
-    
-    if (feature1.size() != feature2.size())
-    {
-        std::cerr << "Error: Feature vectors have different sizes: "
-                  << feature1.size() << " vs " << feature2.size() << std::endl;
-        return -1.0f;
-    }
-    
-    if (feature1.empty())
-    {
-        std::cerr << "Error: Feature vectors are empty" << std::endl;
-        return -1.0f;
-    }
-    
-    // === Step 2: Compute dot product ===
-    
-    float dotProduct = 0.0f;
-    
-    for (size_t i = 0; i < feature1.size(); i++)
-    {
-        dotProduct += feature1[i] * feature2[i];
-    }
-    
-    // === Step 3: Compute L2-norms (magnitudes) ===
-    
-    float norm1 = 0.0f;
-    float norm2 = 0.0f;
+    // === Step 2-3: Dot product and L2-norms (magnitudes), one vectorized pass ===
     
-    for (size_t i = 0; i < feature1.size(); i++)
-    {
-        norm1 += feature1[i] * feature1[i];
-        norm2 += feature2[i] * feature2[i];
-    }
+    float dotProduct, norm1, norm2;
+    kernelDotNorms(feature1.data, feature2.data, feature1.size, dotProduct, norm1, norm2);
     
     norm1 = sqrt(norm1);
     norm2 = sqrt(norm2);
@@ -359,7 +605,7 @@ float distanceCosine(const std::vector<float> &feature1,
     
     if (norm1 < 1e-10f || norm2 < 1e-10f)
     {
-        std::cerr << "Warning: One or both vectors have near-zero length" << std::endl;
+        degenerate = true;
         return 1.0f;  // Maximum distance
     }
     
@@ -373,11 +619,52 @@ float distanceCosine(const std::vector<float> &feature1,
     
     // === Step 6: Convert to distance ===
     
-    float cosineDistance = 1.0f - cosineSimilarity;
+    return 1.0f - cosineSimilarity;
+}
+
+
+/**
+ * Cosine distance metric
+ */
+float distanceCosine(const std::vector<float> &feature1,
+                     const std::vector<float> &feature2)
+{
+    // === Step 1: Validate input ===
+    
+    if (feature1.size() != feature2.size())
+    {
+        std::cerr << "Error: Feature vectors have different sizes: "
+                  << feature1.size() << " vs " << feature2.size() << std::endl;
+        return -1.0f;
+    }
+    
+    if (feature1.empty())
+    {
+        std::cerr << "Error: Feature vectors are empty" << std::endl;
+        return -1.0f;
+    }
+    
+    bool degenerate = false;
+    float distance = cosineDistance(FeatureView(feature1), FeatureView(feature2), degenerate);
+    
+    if (degenerate)
+    {
+        std::cerr << "Warning: One or both vectors have near-zero length" << std::endl;
+    }
     
-    return cosineDistance;
+    return distance;
 }
 
+/**
+ * Cosine distance over views (unchecked)
+ */
+float distanceCosine(FeatureView feature1, FeatureView feature2)
+{
+    bool degenerate = false;
+    return cosineDistance(feature1, feature2, degenerate);
+}
+
+
 
 /**
  * Custom distance metric for blue scene detection
@@ -389,20 +676,30 @@ float distanceCustomBlueScene(const std::vector<float> &customFeature1,
 {
     // === Step 1: Validate inputs ===
     
-    if (customFeature1.size() != 209 || customFeature2.size() != 209)
+    if (customFeature1.size() != CUSTOM_FEATURE_DIM || customFeature2.size() != CUSTOM_FEATURE_DIM)
     {
-        std::cerr << "Error: Custom features must be 209 values. Got: "
+        std::cerr << "Error: Custom features must be " << CUSTOM_FEATURE_DIM << " values. Got: "
                   << customFeature1.size() << " and " << customFeature2.size() << std::endl;
         return -1.0f;
     }
     
-    if (dnnFeature1.size() != 512 || dnnFeature2.size() != 512)
+    if (dnnFeature1.size() != CUSTOM_DNN_DIM || dnnFeature2.size() != CUSTOM_DNN_DIM)
     {
-        std::cerr << "Error: DNN features must be 512 values. Got: "
+        std::cerr << "Error: DNN features must be " << CUSTOM_DNN_DIM << " values. Got: "
                   << dnnFeature1.size() << " and " << dnnFeature2.size() << std::endl;
         return -1.0f;
     }
     
+    return distanceCustomBlueScene(FeatureView(customFeature1), FeatureView(customFeature2),
+                                   FeatureView(dnnFeature1), FeatureView(dnnFeature2));
+}
+
+/**
+ * Custom blue scene distance over views (unchecked)
+ */
+float distanceCustomBlueScene(FeatureView customFeature1, FeatureView customFeature2,
+                              FeatureView dnnFeature1, FeatureView dnnFeature2)
+{
     // === Step 2: Component 1 - Blue dominance distance (1 value) ===
     
     float blueDom1 = customFeature1[0];
@@ -413,44 +710,21 @@ float distanceCustomBlueScene(const std::vector<float> &customFeature1,
     
     // === Step 3: Component 2 - Texture distance (16 values) ===
     
-    std::vector<float> texture1(customFeature1.begin() + 1, 
-                                 customFeature1.begin() + 17);
-    std::vector<float> texture2(customFeature2.begin() + 1, 
-                                 customFeature2.begin() + 17);
-    
-    float textureDist = distanceHistogramIntersection(texture1, texture2);
-    
-    if (textureDist < 0)
-    {
-        std::cerr << "Error: Failed to compute texture distance" << std::endl;
-        return -1.0f;
-    }
+    float textureDist = distanceHistogramIntersection(customFeature1.slice(1, 16),
+                                                      customFeature2.slice(1, 16));
     
     // === Step 4: Component 3 - Spatial layout distance (192 values = 3×64) ===
     
-    std::vector<float> spatial1(customFeature1.begin() + 17, customFeature1.end());
-    std::vector<float> spatial2(customFeature2.begin() + 17, customFeature2.end());
-    
     // Treat as 3 histograms of 64 bins each
-    std::vector<float> spatialWeights = {0.33f, 0.34f, 0.33f}; // Equal weights for 3 regions
-    float spatialDist = distanceMultiHistogram(spatial1, spatial2, 3, spatialWeights);
-    
-    if (spatialDist < 0)
-    {
-        std::cerr << "Error: Failed to compute spatial distance" << std::endl;
-        return -1.0f;
-    }
+    static const float spatialWeights[3] = {0.33f, 0.34f, 0.33f}; // Equal weights for 3 regions
+    float spatialDist = distanceMultiHistogram(customFeature1.slice(17, 192),
+                                               customFeature2.slice(17, 192),
+                                               3, spatialWeights);
     
     // === Step 5: Component 4 - DNN semantic distance ===
     
     float dnnDist = distanceCosine(dnnFeature1, dnnFeature2);
     
-    if (dnnDist < 0)
-    {
-        std::cerr << "Error: Failed to compute DNN distance" << std::endl;
-        return -1.0f;
-    }
-    
     // === Step 6: Weighted combination ===
     
     float blueWeight = 0.4f;      // 40% - most important for blue scenes
@@ -464,4 +738,206 @@ float distanceCustomBlueScene(const std::vector<float> &customFeature1,
                          dnnWeight * dnnDist;
     
     return totalDistance;
-}
\ No newline at end of file
+}
+
+
+/**
+ * 1-D earth mover's distance from the CDF difference
+ */
+float distanceEMD1D(FeatureView hist1, FeatureView hist2)
+{
+    // The running difference of the CDFs is the mass crossing each bin edge
+    float carried = 0.0f;
+    float moved = 0.0f;
+    for (size_t i = 0; i < hist1.size; i++)
+    {
+        carried += hist1[i] - hist2[i];
+        moved += std::fabs(carried);
+    }
+    return hist1.size == 0 ? 0.0f : moved / hist1.size;
+}
+
+/**
+ * Sliced EMD: 1-D EMDs of four projections, through the signatures
+ */
+float distanceSlicedEMD(FeatureView hist1, FeatureView hist2, int bins)
+{
+    std::vector<float> signature1(slicedEMDSignatureSize(bins));
+    std::vector<float> signature2(slicedEMDSignatureSize(bins));
+    slicedEMDSignature(hist1, bins, 1.0f, signature1.data());
+    slicedEMDSignature(hist2, bins, 1.0f, signature2.data());
+    return distanceL1(FeatureView(signature1), FeatureView(signature2));
+}
+
+/**
+ * Scaled CDF of a 1-D histogram
+ */
+void emdSignature1D(FeatureView histogram, float weight, float *signature)
+{
+    // Adjacent bins are 1/n apart
+    float scale = histogram.size == 0 ? 0.0f : weight / histogram.size;
+    float cumulative = 0.0f;
+    for (size_t i = 0; i < histogram.size; i++)
+    {
+        cumulative += histogram[i];
+        signature[i] = scale * cumulative;
+    }
+}
+
+/**
+ * Scaled CDFs of the four projections of an rg histogram
+ */
+void slicedEMDSignature(FeatureView histogram, int bins, float weight, float *signature)
+{
+    size_t n = static_cast<size_t>(bins);
+    float *rAxis = signature;               // n values: mass per r bin
+    float *gAxis = rAxis + n;               // n values: mass per g bin
+    float *diagonal = gAxis + n;            // 2n - 1 values: mass per r + g
+    float *antiDiagonal = diagonal + 2 * n - 1;  // 2n - 1 values: mass per g - r + n - 1
+    std::fill(signature, signature + slicedEMDSignatureSize(bins), 0.0f);
+    
+    // === Step 1: Project onto the four lines ===
+    
+    for (size_t r = 0; r < n; r++)
+    {
+        const float *row = histogram.data + r * n;
+        float rowMass = 0.0f;
+        for (size_t g = 0; g < n; g++)
+        {
+            rowMass += row[g];
+            gAxis[g] += row[g];
+            diagonal[r + g] += row[g];
+            antiDiagonal[n - 1 - r + g] += row[g];
+        }
+        rAxis[r] = rowMass;
+    }
+    
+    // === Step 2: Cumulative sums, scaled by bin spacing and slice count ===
+    
+    // Axis bins are 1/n apart; diagonal bins 1/(n * sqrt(2)) apart along
+    // the unit diagonal. Each slice counts 1/4 towards the average.
+    float axisScale = weight / (4.0f * n);
+    float diagonalScale = axisScale / std::sqrt(2.0f);
+    
+    struct Slice { float *bins; size_t size; float scale; };
+    const Slice slices[] = {{rAxis, n, axisScale}, {gAxis, n, axisScale},
+                            {diagonal, 2 * n - 1, diagonalScale}, {antiDiagonal, 2 * n - 1, diagonalScale}};
+    
+    for (const Slice &slice : slices)
+    {
+        float cumulative = 0.0f;
+        for (size_t i = 0; i < slice.size; i++)
+        {
+            cumulative += slice.bins[i];
+            slice.bins[i] = slice.scale * cumulative;
+        }
+    }
+}
+
+/**
+ * Sum of absolute differences
+ */
+float distanceL1(FeatureView feature1, FeatureView feature2)
+{
+    return kernelL1(feature1.data, feature2.data, feature1.size);
+}
+
+/**
+ * SSD from one query to a block of rows
+ */
+void distanceSSDBatch(FeatureView query, const float *rows, size_t count, float *out)
+{
+    kernelSSDBatch(query.data, rows, query.size, count, out);
+}
+
+/**
+ * Histogram intersection distance from one query to a block of rows
+ */
+void distanceHistogramIntersectionBatch(FeatureView query, const float *rows, size_t count, float *out)
+{
+    kernelIntersectionBatch(query.data, rows, query.size, count, out);
+    
+    for (size_t r = 0; r < count; r++)
+    {
+        out[r] = 1.0f - out[r];
+    }
+}
+
+/**
+ * L1 distance from one query to a block of rows (EMD signatures)
+ */
+void distanceL1Batch(FeatureView query, const float *rows, size_t count, float *out)
+{
+    kernelL1Batch(query.data, rows, query.size, count, out);
+}
+
+/**
+ * SSD from one query to a block of rows, abandoning rows above the bound
+ */
+void distanceSSDBatch(FeatureView query, const float *rows, size_t count, float bound, float *out)
+{
+    kernelSSDBatchBounded(query.data, rows, query.size, count, bound, out);
+}
+
+/**
+ * Histogram intersection distance to a block of rows, abandoning rows above the bound
+ */
+void distanceHistogramIntersectionBatch(FeatureView query, const float *rows, size_t count, float bound,
+                                        float *out)
+{
+    // distance = 1 - intersection, so distance <= bound needs intersection >= 1 - bound
+    kernelIntersectionBatchBounded(query.data, rows, query.size, count, 1.0f - bound, out);
+    
+    for (size_t r = 0; r < count; r++)
+    {
+        out[r] = 1.0f - out[r];
+    }
+}
+
+/**
+ * L1 distance to a block of rows, abandoning rows above the bound
+ */
+void distanceL1Batch(FeatureView query, const float *rows, size_t count, float bound, float *out)
+{
+    kernelL1BatchBounded(query.data, rows, query.size, count, bound, out);
+}
+
+/**
+ * Cosine distance from one query to a block of rows with known norms
+ */
+void distanceCosineBatch(FeatureView query, const float *rows, const float *rowNorms,
+                         size_t count, float *out)
+{
+    // === Step 1: Dot products, one vectorized pass per row ===
+    
+    kernelDotBatch(query.data, rows, query.size, count, out);
+    
+    // === Step 2: Divide by the norms ===
+    
+    float queryNorm = sqrt(kernelDot(query.data, query.data, query.size));
+    
+    for (size_t r = 0; r < count; r++)
+    {
+        if (queryNorm < 1e-10f || rowNorms[r] < 1e-10f)
+        {
+            out[r] = 1.0f;  // Maximum distance
+            continue;
+        }
+        
+        float cosineSimilarity = out[r] / (queryNorm * rowNorms[r]);
+        cosineSimilarity = std::max(-1.0f, std::min(1.0f, cosineSimilarity));
+        out[r] = 1.0f - cosineSimilarity;
+    }
+}
+
+/**
+ * L2 norm of each row
+ */
+void computeRowNorms(const float *rows, size_t dim, size_t count, float *norms)
+{
+    for (size_t r = 0; r < count; r++)
+    {
+        const float *row = rows + r * dim;
+        norms[r] = sqrt(kernelDot(row, row, dim));
+    }
+}
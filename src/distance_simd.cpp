@@ -0,0 +1,1283 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: distance_simd.cpp
+ *
+ * Purpose:
+ * Vectorized distance kernels with runtime CPU dispatch (see distance_simd.h).
+ *
+ * Every x86 variant is compiled with a target attribute, so the file builds
+ * with the default flags and only runs AVX code on CPUs that have it.
+ */
+
+#include "distance_simd.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CBIR_SIMD_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CBIR_SIMD_NEON 1
+#endif
+
+// ========================================
+// Scalar reference
+// ========================================
+
+float referenceSSD(const float *a, const float *b, size_t n)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+float referenceIntersection(const float *a, const float *b, size_t n)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += std::min(a[i], b[i]);
+    }
+    return sum;
+}
+
+float referenceL1(const float *a, const float *b, size_t n)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += std::fabs(a[i] - b[i]);
+    }
+    return sum;
+}
+
+float referenceDot(const float *a, const float *b, size_t n)
+{
+    float dot = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        dot += a[i] * b[i];
+    }
+    return dot;
+}
+
+void referenceDotNorms(const float *a, const float *b, size_t n,
+                       float &dot, float &normA, float &normB)
+{
+    dot = normA = normB = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        dot += a[i] * b[i];
+        normA += a[i] * a[i];
+        normB += b[i] * b[i];
+    }
+}
+
+int32_t referenceDotInt8(const int8_t *a, const int8_t *b, size_t n)
+{
+    int32_t dot = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        dot += static_cast<int32_t>(a[i]) * b[i];
+    }
+    return dot;
+}
+
+// ========================================
+// Fixed-length copies
+// ========================================
+
+// Lengths the shipped features pass to the kernels: colour-texture and
+// custom texture bins (16); 8x8 rg cells of the multi-histogram, pyramid,
+// grid and custom features (64); baseline (147); rg histogram and
+// texture colour (256); DNN embeddings (512). Multi-histogram (128),
+// texture (272) and custom (209) rows are never passed whole: their
+// distances call the kernels on those slices.
+static const size_t FIXED_LENGTHS[] = {16, 64, 147, 256, 512};
+static const size_t NUM_FIXED_LENGTHS = sizeof(FIXED_LENGTHS) / sizeof(FIXED_LENGTHS[0]);
+
+// Inline every call in the function body (the runtime kernel, below)
+#if defined(__GNUC__)
+#define CBIR_FLATTEN __attribute__((flatten))
+#else
+#define CBIR_FLATTEN
+#endif
+
+/*
+ * Copies of one ISA's kernels with the length fixed at compile time
+ *
+ * Each inlines the runtime kernel of the same target with the constant
+ * N, so the trip counts are constants: the loops unroll and tail loops
+ * that cannot run drop out. The operations and their order are
+ * unchanged, so the results are bit-identical to the runtime kernel.
+ * isa is the target attribute of the copies (empty off x86).
+ */
+#define CBIR_FIXED_KERNELS(prefix, isa) \
+    template <size_t N> isa CBIR_FLATTEN \
+    static float prefix##SSDFixed(const float *a, const float *b, size_t) \
+    { \
+        return prefix##SSD(a, b, N); \
+    } \
+    template <size_t N> isa CBIR_FLATTEN \
+    static float prefix##IntersectionFixed(const float *a, const float *b, size_t) \
+    { \
+        return prefix##Intersection(a, b, N); \
+    } \
+    template <size_t N> isa CBIR_FLATTEN \
+    static float prefix##L1Fixed(const float *a, const float *b, size_t) \
+    { \
+        return prefix##L1(a, b, N); \
+    } \
+    template <size_t N> isa CBIR_FLATTEN \
+    static float prefix##DotFixed(const float *a, const float *b, size_t) \
+    { \
+        return prefix##Dot(a, b, N); \
+    } \
+    template <size_t N> isa CBIR_FLATTEN \
+    static void prefix##DotNormsFixed(const float *a, const float *b, size_t, \
+                                      float &dot, float &normA, float &normB) \
+    { \
+        prefix##DotNorms(a, b, N, dot, normA, normB); \
+    }
+
+#if !defined(CBIR_SIMD_X86) && !defined(CBIR_SIMD_NEON)
+
+// ========================================
+// Portable: four independent accumulators
+// ========================================
+
+static float scalarSSD(const float *a, const float *b, size_t n)
+{
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float d0 = a[i] - b[i], d1 = a[i + 1] - b[i + 1];
+        float d2 = a[i + 2] - b[i + 2], d3 = a[i + 3] - b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    float sum = (s0 + s1) + (s2 + s3);
+    return sum + referenceSSD(a + i, b + i, n - i);
+}
+
+static float scalarIntersection(const float *a, const float *b, size_t n)
+{
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += std::min(a[i], b[i]);
+        s1 += std::min(a[i + 1], b[i + 1]);
+        s2 += std::min(a[i + 2], b[i + 2]);
+        s3 += std::min(a[i + 3], b[i + 3]);
+    }
+    float sum = (s0 + s1) + (s2 + s3);
+    return sum + referenceIntersection(a + i, b + i, n - i);
+}
+
+static float scalarL1(const float *a, const float *b, size_t n)
+{
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += std::fabs(a[i] - b[i]);
+        s1 += std::fabs(a[i + 1] - b[i + 1]);
+        s2 += std::fabs(a[i + 2] - b[i + 2]);
+        s3 += std::fabs(a[i + 3] - b[i + 3]);
+    }
+    float sum = (s0 + s1) + (s2 + s3);
+    return sum + referenceL1(a + i, b + i, n - i);
+}
+
+static float scalarDot(const float *a, const float *b, size_t n)
+{
+    float d0 = 0.0f, d1 = 0.0f;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        d0 += a[i] * b[i];
+        d1 += a[i + 1] * b[i + 1];
+    }
+    return d0 + d1 + referenceDot(a + i, b + i, n - i);
+}
+
+static void scalarDotNorms(const float *a, const float *b, size_t n,
+                           float &dot, float &normA, float &normB)
+{
+    float d0 = 0.0f, d1 = 0.0f, a0 = 0.0f, a1 = 0.0f, b0 = 0.0f, b1 = 0.0f;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        d0 += a[i] * b[i];
+        d1 += a[i + 1] * b[i + 1];
+        a0 += a[i] * a[i];
+        a1 += a[i + 1] * a[i + 1];
+        b0 += b[i] * b[i];
+        b1 += b[i + 1] * b[i + 1];
+    }
+
+    float td, ta, tb;
+    referenceDotNorms(a + i, b + i, n - i, td, ta, tb);
+    dot = d0 + d1 + td;
+    normA = a0 + a1 + ta;
+    normB = b0 + b1 + tb;
+}
+
+static int32_t scalarDotInt8(const int8_t *a, const int8_t *b, size_t n)
+{
+    int32_t d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        d0 += static_cast<int32_t>(a[i]) * b[i];
+        d1 += static_cast<int32_t>(a[i + 1]) * b[i + 1];
+        d2 += static_cast<int32_t>(a[i + 2]) * b[i + 2];
+        d3 += static_cast<int32_t>(a[i + 3]) * b[i + 3];
+    }
+    return (d0 + d1) + (d2 + d3) + referenceDotInt8(a + i, b + i, n - i);
+}
+
+CBIR_FIXED_KERNELS(scalar, )
+
+#endif // portable
+
+#ifdef CBIR_SIMD_X86
+
+// ========================================
+// SSE2 (baseline x86-64): 2 x 4 lanes
+// ========================================
+
+static float hsum128(__m128 v)
+{
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+__attribute__((target("sse2")))
+static float sse2SSD(const float *a, const float *b, size_t n)
+{
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+    }
+    return hsum128(_mm_add_ps(acc0, acc1)) + referenceSSD(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static float sse2Intersection(const float *a, const float *b, size_t n)
+{
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_min_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_min_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    return hsum128(_mm_add_ps(acc0, acc1)) + referenceIntersection(a + i, b + i, n - i);
+}
+
+// |x| clears the sign bit
+__attribute__((target("sse2")))
+static float sse2L1(const float *a, const float *b, size_t n)
+{
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        acc0 = _mm_add_ps(acc0, _mm_andnot_ps(sign, d0));
+        acc1 = _mm_add_ps(acc1, _mm_andnot_ps(sign, d1));
+    }
+    return hsum128(_mm_add_ps(acc0, acc1)) + referenceL1(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static float sse2Dot(const float *a, const float *b, size_t n)
+{
+    __m128 accD = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        accD = _mm_add_ps(accD, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    return hsum128(accD) + referenceDot(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sse2DotNorms(const float *a, const float *b, size_t n,
+                         float &dot, float &normA, float &normB)
+{
+    __m128 accD = _mm_setzero_ps(), accA = _mm_setzero_ps(), accB = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        accD = _mm_add_ps(accD, _mm_mul_ps(va, vb));
+        accA = _mm_add_ps(accA, _mm_mul_ps(va, va));
+        accB = _mm_add_ps(accB, _mm_mul_ps(vb, vb));
+    }
+
+    float td, ta, tb;
+    referenceDotNorms(a + i, b + i, n - i, td, ta, tb);
+    dot = hsum128(accD) + td;
+    normA = hsum128(accA) + ta;
+    normB = hsum128(accB) + tb;
+}
+
+/**
+ * int8 dot product: bytes widened to 16 bits, then multiply-add to 32 bits
+ *
+ * SSE2 has no signed byte widening, so each byte is interleaved with its
+ * sign (0 or -1 from a compare). _mm_madd_epi16 multiplies 16-bit pairs
+ * and adds neighbours into 32-bit lanes; a product is at most 127^2 (or
+ * 128^2), so the 32-bit sums cannot overflow for any feature length here.
+ */
+__attribute__((target("sse2")))
+static int32_t sse2DotInt8(const int8_t *a, const int8_t *b, size_t n)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        __m128i signA = _mm_cmpgt_epi8(zero, va);
+        __m128i signB = _mm_cmpgt_epi8(zero, vb);
+        acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(va, signA), _mm_unpacklo_epi8(vb, signB)));
+        acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(va, signA), _mm_unpackhi_epi8(vb, signB)));
+    }
+
+    int32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), _mm_add_epi32(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + referenceDotInt8(a + i, b + i, n - i);
+}
+
+CBIR_FIXED_KERNELS(sse2, __attribute__((target("sse2"))))
+
+// ========================================
+// AVX2 + FMA: 4 x 8 lanes
+// ========================================
+
+__attribute__((target("avx2,fma")))
+static float hsum256(__m256 v)
+{
+    return hsum128(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2SSD(const float *a, const float *b, size_t n)
+{
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        acc2 = _mm256_fmadd_ps(d2, d2, acc2);
+        acc3 = _mm256_fmadd_ps(d3, d3, acc3);
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(d, d, acc0);
+    }
+    __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    return hsum256(acc) + referenceSSD(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2Intersection(const float *a, const float *b, size_t n)
+{
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        acc0 = _mm256_add_ps(acc0, _mm256_min_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_min_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+        acc2 = _mm256_add_ps(acc2, _mm256_min_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16)));
+        acc3 = _mm256_add_ps(acc3, _mm256_min_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24)));
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm256_add_ps(acc0, _mm256_min_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    return hsum256(acc) + referenceIntersection(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2L1(const float *a, const float *b, size_t n)
+{
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(sign, d0));
+        acc1 = _mm256_add_ps(acc1, _mm256_andnot_ps(sign, d1));
+        acc2 = _mm256_add_ps(acc2, _mm256_andnot_ps(sign, d2));
+        acc3 = _mm256_add_ps(acc3, _mm256_andnot_ps(sign, d3));
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(sign, d));
+    }
+    __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    return hsum256(acc) + referenceL1(a + i, b + i, n - i);
+}
+
+// Same accumulators and order as avx2DotNorms, so the dot products agree exactly
+__attribute__((target("avx2,fma")))
+static float avx2Dot(const float *a, const float *b, size_t n)
+{
+    __m256 d0 = _mm256_setzero_ps(), d1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        d0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), d0);
+        d1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), d1);
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        d0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), d0);
+    }
+    return hsum256(_mm256_add_ps(d0, d1)) + referenceDot(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2DotNorms(const float *a, const float *b, size_t n,
+                         float &dot, float &normA, float &normB)
+{
+    // Two sets of three accumulators hide the FMA latency
+    __m256 d0 = _mm256_setzero_ps(), d1 = _mm256_setzero_ps();
+    __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+    __m256 b0 = _mm256_setzero_ps(), b1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 va0 = _mm256_loadu_ps(a + i), vb0 = _mm256_loadu_ps(b + i);
+        __m256 va1 = _mm256_loadu_ps(a + i + 8), vb1 = _mm256_loadu_ps(b + i + 8);
+        d0 = _mm256_fmadd_ps(va0, vb0, d0);
+        d1 = _mm256_fmadd_ps(va1, vb1, d1);
+        a0 = _mm256_fmadd_ps(va0, va0, a0);
+        a1 = _mm256_fmadd_ps(va1, va1, a1);
+        b0 = _mm256_fmadd_ps(vb0, vb0, b0);
+        b1 = _mm256_fmadd_ps(vb1, vb1, b1);
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 va = _mm256_loadu_ps(a + i), vb = _mm256_loadu_ps(b + i);
+        d0 = _mm256_fmadd_ps(va, vb, d0);
+        a0 = _mm256_fmadd_ps(va, va, a0);
+        b0 = _mm256_fmadd_ps(vb, vb, b0);
+    }
+
+    float td, ta, tb;
+    referenceDotNorms(a + i, b + i, n - i, td, ta, tb);
+    dot = hsum256(_mm256_add_ps(d0, d1)) + td;
+    normA = hsum256(_mm256_add_ps(a0, a1)) + ta;
+    normB = hsum256(_mm256_add_ps(b0, b1)) + tb;
+}
+
+// int8 dot product: vpmovsxbw widens 16 bytes to 16 x 16 bits, vpmaddwd
+// multiplies and adds pairs into 8 x 32 bits (see sse2DotInt8)
+__attribute__((target("avx2,fma")))
+static int32_t avx2DotInt8(const int8_t *a, const int8_t *b, size_t n)
+{
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i a0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        __m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        __m256i a1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16)));
+        __m256i b1 = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16)));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(a1, b1));
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(va, vb));
+    }
+
+    __m256i acc = _mm256_add_epi32(acc0, acc1);
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum) + referenceDotInt8(a + i, b + i, n - i);
+}
+
+CBIR_FIXED_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+
+// ========================================
+// AVX-512F: 4 x 16 lanes, masked tail
+// ========================================
+
+// GCC 12's own AVX-512 intrinsics trip -Wuninitialized (GCC bug 105593)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx512f")))
+static float hsum512(__m512 v)
+{
+    // Fold 256-bit halves, then 128-bit quarters, then the last 4 lanes
+    __m512 t = _mm512_add_ps(v, _mm512_shuffle_f32x4(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    t = _mm512_add_ps(t, _mm512_shuffle_f32x4(t, t, _MM_SHUFFLE(2, 3, 0, 1)));
+    return hsum128(_mm512_castps512_ps128(t));
+}
+
+__attribute__((target("avx512f")))
+static float avx512SSD(const float *a, const float *b, size_t n)
+{
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        __m512 d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+        __m512 d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+        acc2 = _mm512_fmadd_ps(d2, d2, acc2);
+        acc3 = _mm512_fmadd_ps(d3, d3, acc3);
+    }
+    for (; i < n; i += 16)
+    {
+        // Lanes past n load as zero on both sides, so they add nothing
+        __mmask16 mask = n - i >= 16 ? 0xFFFF : static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        acc0 = _mm512_fmadd_ps(d, d, acc0);
+    }
+    return hsum512(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+__attribute__((target("avx512f")))
+static float avx512Intersection(const float *a, const float *b, size_t n)
+{
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        acc0 = _mm512_add_ps(acc0, _mm512_min_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+        acc1 = _mm512_add_ps(acc1, _mm512_min_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16)));
+        acc2 = _mm512_add_ps(acc2, _mm512_min_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32)));
+        acc3 = _mm512_add_ps(acc3, _mm512_min_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48)));
+    }
+    for (; i < n; i += 16)
+    {
+        __mmask16 mask = n - i >= 16 ? 0xFFFF : static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 m = _mm512_min_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        acc0 = _mm512_add_ps(acc0, m);
+    }
+    return hsum512(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+__attribute__((target("avx512f")))
+static float avx512L1(const float *a, const float *b, size_t n)
+{
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i))));
+        acc1 = _mm512_add_ps(acc1, _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16))));
+        acc2 = _mm512_add_ps(acc2, _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32))));
+        acc3 = _mm512_add_ps(acc3, _mm512_abs_ps(_mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48))));
+    }
+    for (; i < n; i += 16)
+    {
+        __mmask16 mask = n - i >= 16 ? 0xFFFF : static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(d));
+    }
+    return hsum512(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+__attribute__((target("avx512f")))
+static float avx512Dot(const float *a, const float *b, size_t n)
+{
+    __m512 d0 = _mm512_setzero_ps(), d1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        d0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), d0);
+        d1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), d1);
+    }
+    for (; i < n; i += 16)
+    {
+        __mmask16 mask = n - i >= 16 ? 0xFFFF : static_cast<__mmask16>((1u << (n - i)) - 1);
+        d0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), d0);
+    }
+    return hsum512(_mm512_add_ps(d0, d1));
+}
+
+__attribute__((target("avx512f")))
+static void avx512DotNorms(const float *a, const float *b, size_t n,
+                           float &dot, float &normA, float &normB)
+{
+    __m512 d0 = _mm512_setzero_ps(), d1 = _mm512_setzero_ps();
+    __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps();
+    __m512 b0 = _mm512_setzero_ps(), b1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m512 va0 = _mm512_loadu_ps(a + i), vb0 = _mm512_loadu_ps(b + i);
+        __m512 va1 = _mm512_loadu_ps(a + i + 16), vb1 = _mm512_loadu_ps(b + i + 16);
+        d0 = _mm512_fmadd_ps(va0, vb0, d0);
+        d1 = _mm512_fmadd_ps(va1, vb1, d1);
+        a0 = _mm512_fmadd_ps(va0, va0, a0);
+        a1 = _mm512_fmadd_ps(va1, va1, a1);
+        b0 = _mm512_fmadd_ps(vb0, vb0, b0);
+        b1 = _mm512_fmadd_ps(vb1, vb1, b1);
+    }
+    for (; i < n; i += 16)
+    {
+        __mmask16 mask = n - i >= 16 ? 0xFFFF : static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 va = _mm512_maskz_loadu_ps(mask, a + i), vb = _mm512_maskz_loadu_ps(mask, b + i);
+        d0 = _mm512_fmadd_ps(va, vb, d0);
+        a0 = _mm512_fmadd_ps(va, va, a0);
+        b0 = _mm512_fmadd_ps(vb, vb, b0);
+    }
+    dot = hsum512(_mm512_add_ps(d0, d1));
+    normA = hsum512(_mm512_add_ps(a0, a1));
+    normB = hsum512(_mm512_add_ps(b0, b1));
+}
+
+// The 512-bit vpmaddwd is AVX-512BW, not AVX-512F: use the AVX2 loop
+// (every AVX-512F CPU has AVX2)
+__attribute__((target("avx2,fma"))) CBIR_FLATTEN
+static int32_t avx512DotInt8(const int8_t *a, const int8_t *b, size_t n)
+{
+    return avx2DotInt8(a, b, n);
+}
+
+CBIR_FIXED_KERNELS(avx512, __attribute__((target("avx512f"))))
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // CBIR_SIMD_X86
+
+#ifdef CBIR_SIMD_NEON
+
+// ========================================
+// NEON (AArch64): 4 x 4 lanes
+// ========================================
+
+static float neonSSD(const float *a, const float *b, size_t n)
+{
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f), acc3 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        float32x4_t d1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        float32x4_t d2 = vsubq_f32(vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        float32x4_t d3 = vsubq_f32(vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+        acc0 = vfmaq_f32(acc0, d0, d0);
+        acc1 = vfmaq_f32(acc1, d1, d1);
+        acc2 = vfmaq_f32(acc2, d2, d2);
+        acc3 = vfmaq_f32(acc3, d3, d3);
+    }
+    float32x4_t acc = vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3));
+    return vaddvq_f32(acc) + referenceSSD(a + i, b + i, n - i);
+}
+
+static float neonIntersection(const float *a, const float *b, size_t n)
+{
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f), acc3 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = vaddq_f32(acc0, vminq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+        acc1 = vaddq_f32(acc1, vminq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4)));
+        acc2 = vaddq_f32(acc2, vminq_f32(vld1q_f32(a + i + 8), vld1q_f32(b + i + 8)));
+        acc3 = vaddq_f32(acc3, vminq_f32(vld1q_f32(a + i + 12), vld1q_f32(b + i + 12)));
+    }
+    float32x4_t acc = vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3));
+    return vaddvq_f32(acc) + referenceIntersection(a + i, b + i, n - i);
+}
+
+static float neonL1(const float *a, const float *b, size_t n)
+{
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f), acc3 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = vaddq_f32(acc0, vabdq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+        acc1 = vaddq_f32(acc1, vabdq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4)));
+        acc2 = vaddq_f32(acc2, vabdq_f32(vld1q_f32(a + i + 8), vld1q_f32(b + i + 8)));
+        acc3 = vaddq_f32(acc3, vabdq_f32(vld1q_f32(a + i + 12), vld1q_f32(b + i + 12)));
+    }
+    float32x4_t acc = vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3));
+    return vaddvq_f32(acc) + referenceL1(a + i, b + i, n - i);
+}
+
+static float neonDot(const float *a, const float *b, size_t n)
+{
+    float32x4_t d0 = vdupq_n_f32(0.0f), d1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        d0 = vfmaq_f32(d0, vld1q_f32(a + i), vld1q_f32(b + i));
+        d1 = vfmaq_f32(d1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(d0, d1)) + referenceDot(a + i, b + i, n - i);
+}
+
+static void neonDotNorms(const float *a, const float *b, size_t n,
+                         float &dot, float &normA, float &normB)
+{
+    float32x4_t d0 = vdupq_n_f32(0.0f), d1 = vdupq_n_f32(0.0f);
+    float32x4_t a0 = vdupq_n_f32(0.0f), a1 = vdupq_n_f32(0.0f);
+    float32x4_t b0 = vdupq_n_f32(0.0f), b1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        float32x4_t va0 = vld1q_f32(a + i), vb0 = vld1q_f32(b + i);
+        float32x4_t va1 = vld1q_f32(a + i + 4), vb1 = vld1q_f32(b + i + 4);
+        d0 = vfmaq_f32(d0, va0, vb0);
+        d1 = vfmaq_f32(d1, va1, vb1);
+        a0 = vfmaq_f32(a0, va0, va0);
+        a1 = vfmaq_f32(a1, va1, va1);
+        b0 = vfmaq_f32(b0, vb0, vb0);
+        b1 = vfmaq_f32(b1, vb1, vb1);
+    }
+
+    float td, ta, tb;
+    referenceDotNorms(a + i, b + i, n - i, td, ta, tb);
+    dot = vaddvq_f32(vaddq_f32(d0, d1)) + td;
+    normA = vaddvq_f32(vaddq_f32(a0, a1)) + ta;
+    normB = vaddvq_f32(vaddq_f32(b0, b1)) + tb;
+}
+
+// int8 dot product: vmull_s8 multiplies 8 byte pairs into 16 bits, and
+// vpadalq_s16 adds neighbouring products into the 32-bit accumulator
+static int32_t neonDotInt8(const int8_t *a, const int8_t *b, size_t n)
+{
+    int32x4_t acc0 = vdupq_n_s32(0), acc1 = vdupq_n_s32(0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        int8x16_t va = vld1q_s8(a + i);
+        int8x16_t vb = vld1q_s8(b + i);
+        acc0 = vpadalq_s16(acc0, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc1 = vpadalq_s16(acc1, vmull_high_s8(va, vb));
+    }
+    return vaddvq_s32(vaddq_s32(acc0, acc1)) + referenceDotInt8(a + i, b + i, n - i);
+}
+
+CBIR_FIXED_KERNELS(neon, )
+
+#endif // CBIR_SIMD_NEON
+
+// ========================================
+// One query against a block of rows
+// ========================================
+
+// Rows ahead of the current one to prefetch: far enough to cover memory
+// latency at one row per ~100 ns, near enough to stay in L1
+static const size_t PREFETCH_ROWS = 2;
+
+/**
+ * Ask for every cache line of an upcoming row
+ */
+static inline void prefetchBytes(const void *row, size_t bytes)
+{
+#if defined(__GNUC__)
+    const char *p = static_cast<const char *>(row);
+    for (size_t i = 0; i < bytes; i += 64)
+    {
+        __builtin_prefetch(p + i, 0, 3);
+    }
+#else
+    (void)row;
+    (void)bytes;
+#endif
+}
+
+static inline void prefetchRow(const float *row, size_t n)
+{
+    prefetchBytes(row, n * sizeof(float));
+}
+
+/**
+ * Apply a pairwise kernel to `count` rows of length n stored back to back
+ *
+ * Instantiated per kernel, so the per-row call is direct rather than
+ * through the dispatch table, and the query stays in L1 for the whole block.
+ */
+template <float (*Kernel)(const float *, const float *, size_t)>
+static void batchRows(const float *query, const float *rows, size_t n, size_t count, float *out)
+{
+    for (size_t r = 0; r < count; r++)
+    {
+        if (r + PREFETCH_ROWS < count)
+            prefetchRow(rows + (r + PREFETCH_ROWS) * n, n);
+        out[r] = Kernel(query, rows + r * n, n);
+    }
+}
+
+// Elements between checks of an early-abandon bound (four cache lines)
+static const size_t ABANDON_STRIDE = 64;
+
+// Relative margin before a row is abandoned, so float rounding of the
+// partial sums can never drop a row that ties the bound
+static const float ABANDON_SLACK = 1e-5f;
+
+// Most strides the bounded intersection orders on the stack (rows of up
+// to 4096 values; longer rows are computed without a bound)
+static const size_t MAX_ABANDON_STRIDES = 64;
+
+/**
+ * Bounded SSD (or L1) over a block of rows
+ *
+ * The sum is built a stride at a time and the row is dropped as soon as
+ * it passes the bound (partial sums of non-negative terms only grow). Only the first
+ * stride of the rows ahead is prefetched: on a large database most rows
+ * are dropped there, and their remaining cache lines are never loaded.
+ * Rows that survive are recomputed in one call of Full, so their value is
+ * exactly what the unbounded kernel returns; with a small k that is only
+ * a few rows. Stride is the runtime-length kernel of the same ISA.
+ */
+template <float (*Stride)(const float *, const float *, size_t),
+          float (*Full)(const float *, const float *, size_t)>
+static void batchRowsBoundedSum(const float *query, const float *rows, size_t n, size_t count,
+                                float bound, float *out)
+{
+    float limit = bound + ABANDON_SLACK * std::fabs(bound);
+
+    for (size_t r = 0; r < count; r++)
+    {
+        if (r + PREFETCH_ROWS < count)
+            prefetchRow(rows + (r + PREFETCH_ROWS) * n, std::min(n, ABANDON_STRIDE));
+
+        const float *row = rows + r * n;
+        float partial = 0.0f;
+        for (size_t i = 0; i < n && partial <= limit; i += ABANDON_STRIDE)
+        {
+            partial += Stride(query + i, row + i, std::min(ABANDON_STRIDE, n - i));
+        }
+
+        out[r] = partial > limit ? INFINITY : Full(query, row, n);
+    }
+}
+
+/**
+ * Bounded histogram intersection over a block of rows
+ *
+ * The rest of a row can add at most the query's mass there (min(q, h) <=
+ * q), so partial + remaining query mass bounds the final intersection.
+ * Strides are visited heaviest query mass first, so that bound falls
+ * fastest; rows whose bound drops below minIntersection are dropped and
+ * the survivors are recomputed exactly, as for SSD. Rows of more than
+ * MAX_ABANDON_STRIDES strides are computed in full.
+ */
+template <float (*Stride)(const float *, const float *, size_t),
+          float (*Full)(const float *, const float *, size_t)>
+static void batchRowsBoundedIntersection(const float *query, const float *rows, size_t n, size_t count,
+                                         float minIntersection, float *out)
+{
+    float limit = minIntersection - ABANDON_SLACK;
+
+    // === Step 1: Stride order and remaining query mass, once per block ===
+
+    size_t numStrides = (n + ABANDON_STRIDE - 1) / ABANDON_STRIDE;
+    if (numStrides == 0 || numStrides > MAX_ABANDON_STRIDES)
+    {
+        batchRows<Full>(query, rows, n, count, out);
+        return;
+    }
+
+    // Stack arrays: this runs once per scan block, so it must not allocate
+    float mass[MAX_ABANDON_STRIDES] = {};
+    for (size_t i = 0; i < n; i++)
+        mass[i / ABANDON_STRIDE] += query[i];
+
+    size_t order[MAX_ABANDON_STRIDES];
+    for (size_t s = 0; s < numStrides; s++)
+        order[s] = s;
+    std::sort(order, order + numStrides, [&](size_t x, size_t y) { return mass[x] > mass[y]; });
+
+    // remaining[k]: query mass of the strides after the k-th visited one
+    float remaining[MAX_ABANDON_STRIDES] = {};
+    for (size_t k = numStrides - 1; k-- > 0;)
+        remaining[k] = remaining[k + 1] + mass[order[k + 1]];
+
+    // === Step 2: Rows ===
+
+    for (size_t r = 0; r < count; r++)
+    {
+        const float *row = rows + r * n;
+        if (r + PREFETCH_ROWS < count)
+        {
+            size_t first = order[0] * ABANDON_STRIDE;
+            prefetchRow(rows + (r + PREFETCH_ROWS) * n + first, std::min(n - first, ABANDON_STRIDE));
+        }
+
+        float partial = 0.0f;
+        bool abandoned = false;
+        for (size_t k = 0; k < numStrides && !abandoned; k++)
+        {
+            size_t i = order[k] * ABANDON_STRIDE;
+            partial += Stride(query + i, row + i, std::min(ABANDON_STRIDE, n - i));
+            abandoned = partial + remaining[k] < limit;
+        }
+
+        out[r] = abandoned ? -INFINITY : Full(query, row, n);
+    }
+}
+
+// ========================================
+// Dispatch
+// ========================================
+
+/**
+ * The kernels of one ISA for one row length (or for any length)
+ */
+struct LengthKernels
+{
+    float (*ssd)(const float *, const float *, size_t);
+    float (*intersection)(const float *, const float *, size_t);
+    float (*l1)(const float *, const float *, size_t);
+    float (*dot)(const float *, const float *, size_t);
+    void (*dotNorms)(const float *, const float *, size_t, float &, float &, float &);
+    void (*ssdBatch)(const float *, const float *, size_t, size_t, float *);
+    void (*intersectionBatch)(const float *, const float *, size_t, size_t, float *);
+    void (*l1Batch)(const float *, const float *, size_t, size_t, float *);
+    void (*dotBatch)(const float *, const float *, size_t, size_t, float *);
+    void (*ssdBatchBounded)(const float *, const float *, size_t, size_t, float, float *);
+    void (*intersectionBatchBounded)(const float *, const float *, size_t, size_t, float, float *);
+    void (*l1BatchBounded)(const float *, const float *, size_t, size_t, float, float *);
+};
+
+/**
+ * One kernel set, chosen for the CPU the first time a distance is computed
+ */
+struct DistanceKernels
+{
+    const char *name;
+    LengthKernels any;                          // runtime length
+    LengthKernels fixed[NUM_FIXED_LENGTHS];     // fixed[i]: length FIXED_LENGTHS[i]
+    int32_t (*dotInt8)(const int8_t *, const int8_t *, size_t);
+};
+
+// suffix is empty for the runtime-length kernels, Fixed<N> for a fixed length
+#define CBIR_LENGTH_KERNELS(prefix, suffix) \
+    {prefix##SSD##suffix, prefix##Intersection##suffix, prefix##L1##suffix, prefix##Dot##suffix, \
+     prefix##DotNorms##suffix, batchRows<prefix##SSD##suffix>, batchRows<prefix##Intersection##suffix>, \
+     batchRows<prefix##L1##suffix>, batchRows<prefix##Dot##suffix>, \
+     batchRowsBoundedSum<prefix##SSD, prefix##SSD##suffix>, \
+     batchRowsBoundedIntersection<prefix##Intersection, prefix##Intersection##suffix>, \
+     batchRowsBoundedSum<prefix##L1, prefix##L1##suffix>}
+
+// Same order as FIXED_LENGTHS (checkDistanceKernels compares every copy with the runtime kernel)
+#define CBIR_KERNEL_SET(label, prefix) \
+    {label, CBIR_LENGTH_KERNELS(prefix, ), \
+     {CBIR_LENGTH_KERNELS(prefix, Fixed<16>), CBIR_LENGTH_KERNELS(prefix, Fixed<64>), \
+      CBIR_LENGTH_KERNELS(prefix, Fixed<147>), CBIR_LENGTH_KERNELS(prefix, Fixed<256>), \
+      CBIR_LENGTH_KERNELS(prefix, Fixed<512>)}, \
+     prefix##DotInt8}
+
+static DistanceKernels selectKernels()
+{
+#if defined(CBIR_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return CBIR_KERNEL_SET("avx512", avx512);
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return CBIR_KERNEL_SET("avx2", avx2);
+    return CBIR_KERNEL_SET("sse2", sse2);
+#elif defined(CBIR_SIMD_NEON)
+    return CBIR_KERNEL_SET("neon", neon);
+#else
+    return CBIR_KERNEL_SET("scalar", scalar);
+#endif
+}
+
+static const DistanceKernels &kernels()
+{
+    // Initialized once, thread-safe (C++11 magic static)
+    static const DistanceKernels selected = selectKernels();
+    return selected;
+}
+
+/**
+ * Kernels for length n: the fixed-length copy if n is a shipped length
+ */
+static const LengthKernels &kernelsFor(size_t n)
+{
+    const DistanceKernels &selected = kernels();
+    for (size_t i = 0; i < NUM_FIXED_LENGTHS; i++)
+    {
+        if (FIXED_LENGTHS[i] == n)
+            return selected.fixed[i];
+    }
+    return selected.any;
+}
+
+float kernelSSD(const float *a, const float *b, size_t n)
+{
+    return kernelsFor(n).ssd(a, b, n);
+}
+
+float kernelIntersection(const float *a, const float *b, size_t n)
+{
+    return kernelsFor(n).intersection(a, b, n);
+}
+
+float kernelL1(const float *a, const float *b, size_t n)
+{
+    return kernelsFor(n).l1(a, b, n);
+}
+
+float kernelDot(const float *a, const float *b, size_t n)
+{
+    return kernelsFor(n).dot(a, b, n);
+}
+
+void kernelDotNorms(const float *a, const float *b, size_t n,
+                    float &dot, float &normA, float &normB)
+{
+    kernelsFor(n).dotNorms(a, b, n, dot, normA, normB);
+}
+
+void kernelSSDBatch(const float *query, const float *rows, size_t n, size_t count, float *out)
+{
+    kernelsFor(n).ssdBatch(query, rows, n, count, out);
+}
+
+void kernelIntersectionBatch(const float *query, const float *rows, size_t n, size_t count, float *out)
+{
+    kernelsFor(n).intersectionBatch(query, rows, n, count, out);
+}
+
+void kernelSSDBatchBounded(const float *query, const float *rows, size_t n, size_t count,
+                          float bound, float *out)
+{
+    kernelsFor(n).ssdBatchBounded(query, rows, n, count, bound, out);
+}
+
+void kernelIntersectionBatchBounded(const float *query, const float *rows, size_t n, size_t count,
+                                    float minIntersection, float *out)
+{
+    kernelsFor(n).intersectionBatchBounded(query, rows, n, count, minIntersection, out);
+}
+
+void kernelL1Batch(const float *query, const float *rows, size_t n, size_t count, float *out)
+{
+    kernelsFor(n).l1Batch(query, rows, n, count, out);
+}
+
+void kernelL1BatchBounded(const float *query, const float *rows, size_t n, size_t count,
+                          float bound, float *out)
+{
+    kernelsFor(n).l1BatchBounded(query, rows, n, count, bound, out);
+}
+
+void kernelDotBatch(const float *query, const float *rows, size_t n, size_t count, float *out)
+{
+    kernelsFor(n).dotBatch(query, rows, n, count, out);
+}
+
+int32_t kernelDotInt8(const int8_t *a, const int8_t *b, size_t n)
+{
+    return kernels().dotInt8(a, b, n);
+}
+
+void kernelDotInt8Batch(const int8_t *query, const int8_t *rows, size_t n, size_t count, int32_t *out)
+{
+    int32_t (*dot)(const int8_t *, const int8_t *, size_t) = kernels().dotInt8;
+    for (size_t r = 0; r < count; r++)
+    {
+        if (r + PREFETCH_ROWS < count)
+            prefetchBytes(rows + (r + PREFETCH_ROWS) * n, n);
+        out[r] = dot(query, rows + r * n, n);
+    }
+}
+
+const char *distanceKernelName()
+{
+    return kernels().name;
+}
+
+// ========================================
+// Validation
+// ========================================
+
+/**
+ * Check one result against the reference, relative to the magnitude of the sum
+ */
+static bool closeEnough(float value, float reference, float magnitude)
+{
+    return std::fabs(value - reference) <= 1e-4f * std::max(1.0f, magnitude);
+}
+
+/**
+ * Compare the selected kernels with the scalar reference
+ */
+int checkDistanceKernels()
+{
+    // Feature lengths in use, plus ragged ones that exercise every tail path
+    const size_t lengths[] = {1, 3, 7, 15, 16, 17, 33, 63, 64, 65, 128, 147, 209, 256, 272, 512, 1344, 4096};
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> pixel(0.0f, 255.0f);
+    std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> code(-128, 127);
+
+    int failures = 0;
+    for (size_t n : lengths)
+    {
+        std::vector<float> a(n), b(n), ha(n), hb(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            a[i] = signedUnit(rng);
+            b[i] = signedUnit(rng);
+            ha[i] = pixel(rng) / (255.0f * n);
+            hb[i] = pixel(rng) / (255.0f * n);
+        }
+
+        float ssd = kernelSSD(a.data(), b.data(), n);
+        float refSSD = referenceSSD(a.data(), b.data(), n);
+
+        float inter = kernelIntersection(ha.data(), hb.data(), n);
+        float refInter = referenceIntersection(ha.data(), hb.data(), n);
+
+        float l1 = kernelL1(a.data(), b.data(), n);
+        float refL1 = referenceL1(a.data(), b.data(), n);
+
+        float dot, na, nb, refDot, refNa, refNb;
+        kernelDotNorms(a.data(), b.data(), n, dot, na, nb);
+        referenceDotNorms(a.data(), b.data(), n, refDot, refNa, refNb);
+
+        // The batch entry points over rows {b, a}: row 0 must match the pairwise kernels
+        std::vector<float> rows(b);
+        rows.insert(rows.end(), a.begin(), a.end());
+        float batchSSD[2];
+        kernelSSDBatch(a.data(), rows.data(), n, 2, batchSSD);
+        bool batchOk = batchSSD[0] == ssd && batchSSD[1] == 0.0f;
+
+        // Bounded: row 1 (a itself) survives any bound, row 0 only a loose one
+        float bounded[2];
+        kernelSSDBatchBounded(a.data(), rows.data(), n, 2, ssd * 0.5f, bounded);
+        batchOk = batchOk && bounded[1] == 0.0f && (ssd == 0.0f || bounded[0] == INFINITY);
+        kernelSSDBatchBounded(a.data(), rows.data(), n, 2, ssd * 2.0f, bounded);
+        batchOk = batchOk && bounded[0] == ssd;
+
+        float batchL1[2];
+        kernelL1Batch(a.data(), rows.data(), n, 2, batchL1);
+        batchOk = batchOk && batchL1[0] == l1 && batchL1[1] == 0.0f;
+        kernelL1BatchBounded(a.data(), rows.data(), n, 2, l1 * 0.5f, bounded);
+        batchOk = batchOk && bounded[1] == 0.0f && (l1 == 0.0f || bounded[0] == INFINITY);
+        kernelL1BatchBounded(a.data(), rows.data(), n, 2, l1 * 2.0f, bounded);
+        batchOk = batchOk && bounded[0] == l1;
+
+        std::vector<float> hrows(hb);
+        hrows.insert(hrows.end(), ha.begin(), ha.end());
+        kernelIntersectionBatchBounded(ha.data(), hrows.data(), n, 2, inter * 0.5f, bounded);
+        batchOk = batchOk && bounded[0] == inter;
+
+        // A dot product can cancel to ~0, so compare it against the norms
+        float dotScale = std::sqrt(refNa * refNb);
+        float dotOnly = kernelDot(a.data(), b.data(), n);
+        float batchDotOnly[2];
+        kernelDotBatch(a.data(), rows.data(), n, 2, batchDotOnly);
+        batchOk = batchOk && batchDotOnly[0] == dotOnly && dotOnly == dot &&
+                  batchDotOnly[1] == na && kernelDot(b.data(), b.data(), n) == nb;
+
+        // The fixed-length copies (used above for shipped lengths) must match the runtime kernels exactly
+        const LengthKernels &any = kernels().any;
+        float anyDot, anyNa, anyNb;
+        any.dotNorms(a.data(), b.data(), n, anyDot, anyNa, anyNb);
+        bool fixedOk = any.ssd(a.data(), b.data(), n) == ssd &&
+                       any.intersection(ha.data(), hb.data(), n) == inter &&
+                       any.l1(a.data(), b.data(), n) == l1 &&
+                       any.dot(a.data(), b.data(), n) == dotOnly &&
+                       anyDot == dot && anyNa == na && anyNb == nb;
+        batchOk = batchOk && fixedOk;
+
+        // Integer sums have no rounding: the int8 kernels must match exactly,
+        // including the -128 * -128 extreme
+        std::vector<int8_t> qa(n), qrows(2 * n);
+        for (size_t i = 0; i < n; i++)
+        {
+            qa[i] = static_cast<int8_t>(code(rng));
+            qrows[i] = static_cast<int8_t>(code(rng));
+            qrows[n + i] = -128;
+        }
+        qa[0] = -128;
+        int32_t batchInt8[2];
+        kernelDotInt8Batch(qa.data(), qrows.data(), n, 2, batchInt8);
+        batchOk = batchOk && batchInt8[0] == referenceDotInt8(qa.data(), qrows.data(), n) &&
+                  batchInt8[1] == referenceDotInt8(qa.data(), qrows.data() + n, n) &&
+                  kernelDotInt8(qa.data(), qrows.data(), n) == batchInt8[0];
+
+        bool ok = closeEnough(ssd, refSSD, refSSD) &&
+                  closeEnough(inter, refInter, refInter) &&
+                  closeEnough(l1, refL1, refL1) &&
+                  closeEnough(dot, refDot, dotScale) &&
+                  closeEnough(dotOnly, refDot, dotScale) &&
+                  closeEnough(na, refNa, refNa) &&
+                  closeEnough(nb, refNb, refNb) && batchOk;
+
+        if (!ok)
+        {
+            std::cerr << "Error: " << distanceKernelName() << " distance kernels disagree with the reference at n = " << n
+                      << " (ssd " << ssd << " vs " << refSSD << ", intersection " << inter << " vs " << refInter
+                      << ", dot " << dot << " vs " << refDot << (batchOk ? ")" : "; batch differs)") << std::endl;
+            failures++;
+        }
+    }
+
+    return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,110 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: embedding.cpp
+ *
+ * Purpose:
+ * Implementation of ResNet18 embedding extraction (see embedding.h).
+ */
+
+#include "embedding.h"
+#include <iostream>
+
+/**
+ * Load the ResNet18 ONNX model
+ */
+int loadEmbeddingNet(const std::string &modelPath, cv::dnn::Net &net)
+{
+    net = cv::dnn::readNet(modelPath);
+
+    if (net.empty())
+    {
+        std::cerr << "Error: Failed to load network from " << modelPath << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Get embedding from ResNet18 for a single image
+ */
+int getEmbedding(const cv::Mat &src, cv::Mat &embedding, cv::dnn::Net &net)
+{
+    if (src.empty())
+    {
+        std::cerr << "Error: Empty image passed to getEmbedding" << std::endl;
+        return -1;
+    }
+
+    cv::Mat blob;
+
+    // ImageNet preprocessing:
+    // - Scale to [0,1] then normalize by std (0.226)
+    // - Subtract mean (124, 116, 104) in BGR order
+    // - Resize to 224x224
+    // - Swap R and B channels (BGR -> RGB)
+    cv::dnn::blobFromImage(src,
+                           blob,
+                           (1.0 / 255.0) * (1.0 / 0.226), // scale factor
+                           cv::Size(NET_SIZE, NET_SIZE),  // target size
+                           cv::Scalar(124, 116, 104),     // mean subtraction
+                           true,                          // swapRB
+                           false,                         // no center crop
+                           CV_32F);                       // output type
+
+    net.setInput(blob);
+
+    // Forward pass to the flatten layer (512-D embedding)
+    embedding = net.forward(EMBEDDING_LAYER);
+
+    return 0;
+}
+
+/**
+ * Get embeddings from ResNet18 for a batch of images in one forward pass
+ */
+int getEmbeddingsBatch(const std::vector<cv::Mat> &images, cv::Mat &embeddings, cv::dnn::Net &net)
+{
+    if (images.empty())
+    {
+        std::cerr << "Error: Empty batch passed to getEmbeddingsBatch" << std::endl;
+        return -1;
+    }
+
+    // Callers run this on worker threads, so a backend/target mismatch or
+    // an allocation failure must come back as -1 rather than escape
+    try
+    {
+        cv::Mat blob;
+
+        cv::dnn::blobFromImages(images,
+                                blob,
+                                (1.0 / 255.0) * (1.0 / 0.226), // scale factor
+                                cv::Size(NET_SIZE, NET_SIZE),  // target size
+                                cv::Scalar(124, 116, 104),     // mean subtraction
+                                true,                          // swapRB
+                                false,                         // no center crop
+                                CV_32F);                       // output type
+
+        net.setInput(blob);
+
+        // Forward pass to the flatten layer (N x 512 embeddings)
+        embeddings = net.forward(EMBEDDING_LAYER);
+    }
+    catch (const cv::Exception &e)
+    {
+        std::cerr << "Error: DNN forward pass failed: " << e.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Resize an image to the network input size
+ */
+void resizeForEmbedding(const cv::Mat &src, cv::Mat &dst)
+{
+    cv::resize(src, dst, cv::Size(NET_SIZE, NET_SIZE), 0, 0, cv::INTER_LINEAR);
+}
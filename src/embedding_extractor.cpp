@@ -9,76 +9,143 @@
  * This lets us compare our own embeddings vs the provided ones.
  *
  * Usage:
- *   ./compute_embeddings <model_path> <image_directory> <output_csv>
+ *   ./compute_embeddings <model_path> <image_directory> <output_csv> [options]
+ *
+ * Options:
+ *   --batch N       Images per forward pass (default: 16)
+ *   --decoders N    Image decode/resize threads (default: 4)
+ *   --replicas N    Independent cv::dnn::Net copies, one worker thread each (default: 1)
+ *   --threads N     OpenCV worker threads used inside each forward pass (default: OpenCV's choice)
+ *   --backend B     default | opencv | openvino | cuda | vulkan (default: default)
+ *   --target T      cpu | opencl | opencl_fp16 | cuda | cuda_fp16 | vulkan (default: cpu)
+ *   --profile       Dump per-layer timings from net.getPerfProfile() after the run
+ *   --checkpoint N  Rows between checkpoints of the output CSV (default: 500)
+ *   --resume        Continue an interrupted run, skipping images already written
  *
  * Example:
  *   ./compute_embeddings data/resnet18-v2-7.onnx data/olympus/ data/my_dnn_features.csv
+ *   ./compute_embeddings data/resnet18-v2-7.onnx data/olympus/ data/my_dnn_features.csv --batch 32 --decoders 6
+ *   ./compute_embeddings data/resnet18-v2-7.onnx data/olympus/ data/my_dnn_features.csv --replicas 4 --threads 2 --profile
+ *
+ * Tuning:
+ *   Every replica runs a warm-up forward pass before the clock starts, so
+ *   the reported images/sec compares replicas x threads layouts fairly.
+ *   Try e.g. 1x8, 2x4, 4x2 and 8x1 on a new machine and keep the fastest.
+ *
+ * Memory:
+ *   Embeddings are streamed to the CSV through a fixed-size reorder buffer
+ *   as batches complete, so memory use does not grow with the number of
+ *   images and rows are still written in directory order.
  */
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/dnn.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 #include <iomanip>
+#include <map>
+#include <mutex>
+#include "embedding.h"
+#include "pipeline.h"
 #include "utils.h"
 
+// Once a replica has at least one image, how long it waits for the rest of
+// its batch before running a partial batch
+const int BATCH_FILL_WAIT_MS = 50;
+
 /**
- * Get embedding from ResNet18 for a single image
- *
- * @param src Source image (BGR)
- * @param embedding Output Mat (1x512 float)
- * @param net The loaded ResNet18 network
- * @return 0 on success, -1 on error
- *
- * What it does:
- *  1. Preprocess image: resize to 224x224, normalize with ImageNet mean/std
- *  2. Forward pass through network
- *  3. Extract output from the flatten layer (512-D embedding)
+ * Map a --backend name to a cv::dnn backend id
+ * @return 0 on success, -1 for an unknown name
  */
-int getEmbedding(const cv::Mat &src, cv::Mat &embedding, cv::dnn::Net &net)
+int parseBackend(const std::string &name, int &backend)
 {
-    if (src.empty())
-    {
-        std::cerr << "Error: Empty image passed to getEmbedding" << std::endl;
+    static const std::map<std::string, int> backends = {
+        {"default", cv::dnn::DNN_BACKEND_DEFAULT},
+        {"opencv", cv::dnn::DNN_BACKEND_OPENCV},
+        {"openvino", cv::dnn::DNN_BACKEND_INFERENCE_ENGINE},
+        {"cuda", cv::dnn::DNN_BACKEND_CUDA},
+        {"vulkan", cv::dnn::DNN_BACKEND_VKCOM}};
+
+    auto it = backends.find(name);
+    if (it == backends.end())
         return -1;
-    }
-
-    const int NET_SIZE = 224;
-    cv::Mat blob;
-
-    // ImageNet preprocessing:
-    // - Scale to [0,1] then normalize by std (0.226)
-    // - Subtract mean (124, 116, 104) in BGR order
-    // - Resize to 224x224
-    // - Swap R and B channels (BGR -> RGB)
-    cv::dnn::blobFromImage(src,
-                           blob,
-                           (1.0 / 255.0) * (1.0 / 0.226), // scale factor
-                           cv::Size(NET_SIZE, NET_SIZE),  // target size
-                           cv::Scalar(124, 116, 104),     // mean subtraction
-                           true,                          // swapRB
-                           false,                         // no center crop
-                           CV_32F);                       // output type
-
-    net.setInput(blob);
-
-    // Forward pass to the flatten layer (512-D embedding)
-    embedding = net.forward("onnx_node!resnetv22_flatten0_reshape0");
+    backend = it->second;
+    return 0;
+}
 
+/**
+ * Map a --target name to a cv::dnn target id
+ * @return 0 on success, -1 for an unknown name
+ */
+int parseTarget(const std::string &name, int &target)
+{
+    static const std::map<std::string, int> targets = {
+        {"cpu", cv::dnn::DNN_TARGET_CPU},
+        {"opencl", cv::dnn::DNN_TARGET_OPENCL},
+        {"opencl_fp16", cv::dnn::DNN_TARGET_OPENCL_FP16},
+        {"cuda", cv::dnn::DNN_TARGET_CUDA},
+        {"cuda_fp16", cv::dnn::DNN_TARGET_CUDA_FP16},
+        {"vulkan", cv::dnn::DNN_TARGET_VULKAN}};
+
+    auto it = targets.find(name);
+    if (it == targets.end())
+        return -1;
+    target = it->second;
     return 0;
 }
 
+/**
+ * Per-replica counters, merged after all workers finish
+ * layerMs accumulates getPerfProfile() timings when profiling
+ */
+struct ReplicaStats
+{
+    int success = 0;
+    int failed = 0;
+    int batches = 0;
+    double totalBatchMs = 0.0;
+    double minBatchMs = 0.0;
+    double maxBatchMs = 0.0;
+    std::vector<double> layerMs;
+};
+
+/**
+ * One decoded image travelling from the decoder pool to the batcher
+ * An empty image means the file failed to load
+ */
+struct DecodedImage
+{
+    size_t index;
+    cv::Mat image;
+};
+
 int main(int argc, char *argv[])
 {
     // === Step 1: Parse arguments ===
 
-    if (argc != 4)
+    if (argc < 4)
     {
-        std::cerr << "Usage: " << argv[0] << " <model_path> <image_directory> <output_csv>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <model_path> <image_directory> <output_csv> [options]" << std::endl;
+        std::cerr << "\nOptions:" << std::endl;
+        std::cerr << "  --batch N       images per forward pass (default: 16)" << std::endl;
+        std::cerr << "  --decoders N    decode/resize threads (default: 4)" << std::endl;
+        std::cerr << "  --replicas N    network copies, one worker thread each (default: 1)" << std::endl;
+        std::cerr << "  --threads N     OpenCV threads inside each forward pass" << std::endl;
+        std::cerr << "  --backend B     default | opencv | openvino | cuda | vulkan" << std::endl;
+        std::cerr << "  --target T      cpu | opencl | opencl_fp16 | cuda | cuda_fp16 | vulkan" << std::endl;
+        std::cerr << "  --profile       dump per-layer timings after the run" << std::endl;
+        std::cerr << "  --checkpoint N  rows between CSV checkpoints (default: 500)" << std::endl;
+        std::cerr << "  --resume        continue an interrupted run" << std::endl;
         std::cerr << "\nExample:" << std::endl;
         std::cerr << "  " << argv[0] << " data/resnet18-v2-7.onnx data/olympus/ data/my_dnn_features.csv" << std::endl;
+        std::cerr << "  " << argv[0] << " data/resnet18-v2-7.onnx data/olympus/ data/my_dnn_features.csv --replicas 4 --threads 2 --profile" << std::endl;
         return -1;
     }
 
@@ -86,32 +153,126 @@ int main(int argc, char *argv[])
     std::string imageDir = argv[2];
     std::string outputCSV = argv[3];
 
+    int batchSize = 16;
+    int numDecoders = 4;
+    int numReplicas = 1;
+    int threadsPerNet = 0;  // 0 = leave OpenCV's default
+    std::string backendName = "default";
+    std::string targetName = "cpu";
+    bool profile = false;
+    int checkpointEvery = 500;
+    bool resume = false;
+
+    for (int i = 4; i < argc; i++)
+    {
+        std::string option = argv[i];
+
+        if (option == "--batch" && i + 1 < argc)
+            batchSize = std::stoi(argv[++i]);
+        else if (option == "--decoders" && i + 1 < argc)
+            numDecoders = std::stoi(argv[++i]);
+        else if (option == "--replicas" && i + 1 < argc)
+            numReplicas = std::stoi(argv[++i]);
+        else if (option == "--threads" && i + 1 < argc)
+            threadsPerNet = std::stoi(argv[++i]);
+        else if (option == "--backend" && i + 1 < argc)
+            backendName = argv[++i];
+        else if (option == "--target" && i + 1 < argc)
+            targetName = argv[++i];
+        else if (option == "--profile")
+            profile = true;
+        else if (option == "--checkpoint" && i + 1 < argc)
+            checkpointEvery = std::stoi(argv[++i]);
+        else if (option == "--resume")
+            resume = true;
+        else
+        {
+            std::cerr << "Error: Unknown or incomplete option: " << option << std::endl;
+            return -1;
+        }
+    }
+
+    if (batchSize < 1 || numDecoders < 1 || numReplicas < 1 || checkpointEvery < 1)
+    {
+        std::cerr << "Error: --batch, --decoders, --replicas and --checkpoint must be at least 1" << std::endl;
+        return -1;
+    }
+
+    int backend = 0;
+    int target = 0;
+    if (parseBackend(backendName, backend) != 0)
+    {
+        std::cerr << "Error: Unknown backend: " << backendName << std::endl;
+        return -1;
+    }
+    if (parseTarget(targetName, target) != 0)
+    {
+        std::cerr << "Error: Unknown target: " << targetName << std::endl;
+        return -1;
+    }
+
     std::cout << "========================================" << std::endl;
     std::cout << "Custom DNN Embedding Extractor" << std::endl;
     std::cout << "========================================" << std::endl;
     std::cout << "Model: " << modelPath << std::endl;
     std::cout << "Image directory: " << imageDir << std::endl;
     std::cout << "Output CSV: " << outputCSV << std::endl;
+    std::cout << "Batch size: " << batchSize << std::endl;
+    std::cout << "Decode threads: " << numDecoders << std::endl;
+    std::cout << "Replicas: " << numReplicas << std::endl;
+    std::cout << "Threads per net: " << (threadsPerNet > 0 ? std::to_string(threadsPerNet) : "default") << std::endl;
+    std::cout << "Backend / target: " << backendName << " / " << targetName << std::endl;
     std::cout << "========================================\n"
               << std::endl;
 
-    // === Step 2: Load the network ===
+    // OpenCV's parallel backend has a single, process-wide thread count;
+    // every replica's forward pass draws its workers from that pool
+    if (threadsPerNet > 0)
+    {
+        cv::setNumThreads(threadsPerNet);
+    }
 
-    std::cout << "Loading ResNet18 model..." << std::endl;
+    // === Step 2: Load and warm up the network replicas ===
 
-    cv::dnn::Net net = cv::dnn::readNet(modelPath);
+    std::cout << "Loading ResNet18 model (" << numReplicas << " replicas)..." << std::endl;
 
-    if (net.empty())
+    std::vector<cv::dnn::Net> nets;
+
+    for (int r = 0; r < numReplicas; r++)
     {
-        std::cerr << "Error: Failed to load network from " << modelPath << std::endl;
-        return -1;
+        cv::dnn::Net net;
+        if (loadEmbeddingNet(modelPath, net) != 0)
+        {
+            return -1;
+        }
+
+        net.setPreferableBackend(backend);
+        net.setPreferableTarget(target);
+        nets.push_back(net);
     }
 
     std::cout << "Network loaded successfully" << std::endl;
 
     // Print layer names for verification
-    std::vector<cv::String> layerNames = net.getLayerNames();
+    std::vector<cv::String> layerNames = nets[0].getLayerNames();
     std::cout << "Total layers: " << layerNames.size() << std::endl;
+
+    // The first forward pass allocates buffers and picks kernels; run it
+    // on a full dummy batch per replica so it stays out of the timings
+    std::cout << "Warming up..." << std::endl;
+    {
+        std::vector<cv::Mat> dummyBatch(batchSize, cv::Mat(NET_SIZE, NET_SIZE, CV_8UC3, cv::Scalar(0, 0, 0)));
+        cv::Mat dummyOut;
+        for (auto &net : nets)
+        {
+            // A backend/target the build cannot run fails here, before any row is written
+            if (getEmbeddingsBatch(dummyBatch, dummyOut, net) != 0)
+            {
+                std::cerr << "Error: Warm-up failed; check --backend/--target" << std::endl;
+                return -1;
+            }
+        }
+    }
     std::cout << std::endl;
 
     // === Step 3: Get all image filenames ===
@@ -123,89 +284,337 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    std::cout << "Found " << filenames.size() << " images\n"
-              << std::endl;
+    std::cout << "Found " << filenames.size() << " images" << std::endl;
 
-    // === Step 4: Extract embeddings for each image ===
+    if (imageDir.back() != '/')
+    {
+        imageDir += '/';
+    }
 
-    std::vector<FeatureData> allFeatures;
-    allFeatures.reserve(filenames.size());
+    // Rows are streamed to the CSV as they complete and checkpointed, so an
+    // interrupted run can continue with --resume instead of starting over
+    FeatureCSVWriter writer;
+    std::unordered_set<std::string> committed;
+    writer.checkpointEvery = checkpointEvery;
 
-    int successCount = 0;
-    int failCount = 0;
+    if (writer.open(outputCSV, resume, committed) != 0)
+    {
+        return -1;
+    }
 
-    std::cout << "Extracting embeddings..." << std::endl;
+    if (!committed.empty())
+    {
+        filenames.erase(std::remove_if(filenames.begin(), filenames.end(),
+                                       [&](const std::string &name) { return committed.count(name) > 0; }),
+                        filenames.end());
+        std::cout << "Remaining after resume: " << filenames.size() << " images" << std::endl;
+    }
 
-    for (size_t i = 0; i < filenames.size(); i++)
+    std::cout << std::endl;
+
+    auto runStart = std::chrono::steady_clock::now();
+
+    // === Step 4: Decode and resize on a thread pool ===
+
+    // Decoders claim images in order and push 224x224 inputs to the replicas.
+    // The queue holds a few batches per replica so decode never waits on inference.
+    BoundedQueue<DecodedImage> decoded(static_cast<size_t>(batchSize) * numReplicas * 2);
+    std::atomic<size_t> nextImage(0);
+    std::atomic<int> activeDecoders(numDecoders);
+    std::vector<std::thread> decoders;
+
+    // Replicas finish batches out of order; the reorder buffer writes rows
+    // in input order. Decoders claim an image only once it fits in the
+    // window, so no more than this many images are ever in flight.
+    ReorderBuffer<FeatureData> ordered(static_cast<size_t>(batchSize) * numReplicas * 4);
+    std::atomic<bool> writeFailed(false);
+    std::atomic<int> embeddingDim(0);
+
+    for (int d = 0; d < numDecoders; d++)
     {
-        // Build full path
-        std::string fullPath = imageDir;
-        if (fullPath.back() != '/')
+        decoders.emplace_back([&]()
         {
-            fullPath += '/';
-        }
-        fullPath += filenames[i];
+            for (size_t i = nextImage++; i < filenames.size() && ordered.acquire(i); i = nextImage++)
+            {
+                DecodedImage item;
+                item.index = i;
+
+                cv::Mat image = cv::imread(imageDir + filenames[i]);
+                if (!image.empty())
+                {
+                    resizeForEmbedding(image, item.image);
+                }
+
+                if (!decoded.push(std::move(item)))
+                    break;
+            }
+
+            // Last decoder out tells the replicas no more images are coming
+            if (--activeDecoders == 0)
+            {
+                decoded.close();
+            }
+        });
+    }
+
+    // === Step 5: Replica workers batch decoded images through their net ===
 
-        // Load image
-        cv::Mat image = cv::imread(fullPath);
-        if (image.empty())
+    std::vector<ReplicaStats> stats(numReplicas);
+    std::atomic<int> processed(0);
+    std::mutex progressMutex;
+
+    std::cout << "Extracting embeddings..." << std::endl;
+
+    auto replicaWorker = [&](int r)
+    {
+        cv::dnn::Net &net = nets[r];
+        ReplicaStats &st = stats[r];
+        std::vector<cv::Mat> batchImages;
+        std::vector<size_t> batchIndices;
+        std::vector<double> layerTicks;
+        batchImages.reserve(batchSize);
+        batchIndices.reserve(batchSize);
+
+        // Rows go out to the CSV in input order from whichever thread
+        // completes the next one
+        auto emitRow = [&](FeatureData &row) { return writer.write(row); };
+
+        // Write every row that is next in order. Called after each skip as
+        // well as after each batch: a window of failed loads must not wait
+        // for a batch to finish, or the decoders block in acquire() while
+        // this replica waits on an empty queue.
+        auto drainRows = [&]()
+        {
+            if (ordered.drain(emitRow) != 0)
+            {
+                // Stop everyone; rows up to the last checkpoint are kept
+                writeFailed = true;
+                ordered.close();
+                decoded.close();
+            }
+        };
+
+        bool open = true;
+        while (open)
         {
-            std::cerr << "\nWarning: Failed to load " << filenames[i] << std::endl;
-            failCount++;
-            continue;
+            // Fill one batch (a short final batch when the queue drains).
+            // Only the first image is waited for indefinitely: if decode
+            // stalls, e.g. because the reorder window is waiting on an image
+            // another replica holds, a partial batch runs instead.
+            DecodedImage item;
+            while (static_cast<int>(batchImages.size()) < batchSize)
+            {
+                if (batchImages.empty() ? !decoded.pop(item)
+                                        : !decoded.popFor(item, std::chrono::milliseconds(BATCH_FILL_WAIT_MS)))
+                {
+                    open = !batchImages.empty() || !decoded.closed();
+                    break;
+                }
+
+                if (item.image.empty())
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(progressMutex);
+                        std::cerr << "\nWarning: Failed to load " << filenames[item.index] << std::endl;
+                    }
+                    st.failed++;
+                    processed++;
+                    ordered.skip(item.index);
+                    drainRows();
+                    continue;
+                }
+
+                batchImages.push_back(std::move(item.image));
+                batchIndices.push_back(item.index);
+            }
+
+            if (batchImages.empty())
+                continue;
+
+            auto batchStart = std::chrono::steady_clock::now();
+
+            cv::Mat embeddings;
+            if (getEmbeddingsBatch(batchImages, embeddings, net) != 0)
+            {
+                st.failed += static_cast<int>(batchImages.size());
+                for (size_t i : batchIndices)
+                {
+                    ordered.skip(i);
+                }
+                drainRows();
+            }
+            else
+            {
+                // Convert each row of the N x 512 output to vector<float>
+                // and move it into the reorder buffer
+                int dim = static_cast<int>(embeddings.total() / batchImages.size());
+                const float *rows = embeddings.ptr<float>(0);
+                embeddingDim = dim;
+
+                for (size_t b = 0; b < batchIndices.size(); b++)
+                {
+                    size_t i = batchIndices[b];
+                    FeatureData row;
+                    row.filename = filenames[i];
+                    row.feature.assign(rows + b * dim, rows + (b + 1) * dim);
+                    ordered.put(i, std::move(row));
+                    st.success++;
+                }
+            }
+
+            double batchMs = std::chrono::duration<double, std::milli>(
+                                 std::chrono::steady_clock::now() - batchStart).count();
+            st.totalBatchMs += batchMs;
+            st.minBatchMs = (st.batches == 0) ? batchMs : std::min(st.minBatchMs, batchMs);
+            st.maxBatchMs = std::max(st.maxBatchMs, batchMs);
+            st.batches++;
+
+            // getPerfProfile() only covers the last forward, so accumulate it
+            if (profile)
+            {
+                net.getPerfProfile(layerTicks);
+                st.layerMs.resize(layerTicks.size(), 0.0);
+                for (size_t l = 0; l < layerTicks.size(); l++)
+                {
+                    st.layerMs[l] += layerTicks[l] * 1000.0 / cv::getTickFrequency();
+                }
+            }
+
+            int done = (processed += static_cast<int>(batchImages.size()));
+            {
+                std::lock_guard<std::mutex> lock(progressMutex);
+                std::cout << "\rProgress: " << done << "/" << filenames.size() << std::flush;
+            }
+
+            batchImages.clear();
+            batchIndices.clear();
+
+            drainRows();
         }
 
-        // Get embedding
-        cv::Mat embedding;
-        if (getEmbedding(image, embedding, net) != 0)
+        // Failed loads may be the last items in order
+        if (ordered.drain(emitRow) != 0)
         {
-            std::cerr << "\nWarning: Failed to get embedding for " << filenames[i] << std::endl;
-            failCount++;
-            continue;
+            writeFailed = true;
         }
+    };
 
-        // Convert cv::Mat embedding (1x512) to vector<float>
-        FeatureData data;
-        data.filename = filenames[i];
-        data.feature.resize(embedding.cols);
+    std::vector<std::thread> replicas;
+    for (int r = 0; r < numReplicas; r++)
+    {
+        replicas.emplace_back(replicaWorker, r);
+    }
 
-        for (int j = 0; j < embedding.cols; j++)
-        {
-            data.feature[j] = embedding.at<float>(0, j);
-        }
+    for (auto &replica : replicas)
+    {
+        replica.join();
+    }
 
-        allFeatures.push_back(data);
-        successCount++;
+    for (auto &decoder : decoders)
+    {
+        decoder.join();
+    }
+
+    double totalSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
 
-        // Progress
-        if ((i + 1) % 50 == 0 || (i + 1) == filenames.size())
+    // Merge per-replica counters
+    ReplicaStats total;
+    for (const auto &st : stats)
+    {
+        if (st.batches > 0)
         {
-            std::cout << "\rProgress: " << (i + 1) << "/" << filenames.size() << std::flush;
+            total.minBatchMs = (total.batches == 0) ? st.minBatchMs : std::min(total.minBatchMs, st.minBatchMs);
+            total.maxBatchMs = std::max(total.maxBatchMs, st.maxBatchMs);
         }
+        total.success += st.success;
+        total.failed += st.failed;
+        total.batches += st.batches;
+        total.totalBatchMs += st.totalBatchMs;
     }
 
     std::cout << "\n"
               << std::endl;
 
-    // === Step 5: Summary ===
+    if (writeFailed)
+    {
+        std::cerr << "Error: Failed writing " << outputCSV
+                  << "; rerun with --resume to continue from the last checkpoint" << std::endl;
+        return -1;
+    }
+
+    // === Step 6: Summary ===
 
     std::cout << "========================================" << std::endl;
     std::cout << "Extraction Summary:" << std::endl;
     std::cout << "  Total images: " << filenames.size() << std::endl;
-    std::cout << "  Success: " << successCount << std::endl;
-    std::cout << "  Failed: " << failCount << std::endl;
-    if (!allFeatures.empty())
+    std::cout << "  Success: " << total.success << std::endl;
+    std::cout << "  Failed: " << total.failed << std::endl;
+    if (embeddingDim > 0)
     {
-        std::cout << "  Embedding size: " << allFeatures[0].feature.size() << " values" << std::endl;
+        std::cout << "  Embedding size: " << embeddingDim << " values" << std::endl;
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "  Layout: " << numReplicas << " replicas x "
+              << (threadsPerNet > 0 ? std::to_string(threadsPerNet) : "default") << " threads" << std::endl;
+    std::cout << "  Throughput: " << (totalSec > 0 ? total.success / totalSec : 0.0) << " images/sec" << std::endl;
+    if (total.batches > 0)
+    {
+        std::cout << "  Batch latency: mean " << total.totalBatchMs / total.batches
+                  << " ms, min " << total.minBatchMs << " ms, max " << total.maxBatchMs
+                  << " ms (" << total.batches << " batches)" << std::endl;
     }
     std::cout << "========================================\n"
               << std::endl;
 
-    // === Step 6: Write to CSV ===
+    // === Step 6b: Per-layer profile ===
 
-    std::cout << "Writing embeddings to CSV..." << std::endl;
+    if (profile)
+    {
+        // Sum every replica's accumulated layer times
+        std::vector<double> layerMs;
+        for (const auto &st : stats)
+        {
+            layerMs.resize(std::max(layerMs.size(), st.layerMs.size()), 0.0);
+            for (size_t l = 0; l < st.layerMs.size(); l++)
+            {
+                layerMs[l] += st.layerMs[l];
+            }
+        }
 
-    if (writeFeaturesToCSV(outputCSV, allFeatures) != 0)
+        double profiledMs = 0.0;
+        for (double ms : layerMs)
+        {
+            profiledMs += ms;
+        }
+
+        std::cout << "========================================" << std::endl;
+        std::cout << "Per-layer profile (mean ms per batch, net.getPerfProfile):" << std::endl;
+        std::cout << "========================================" << std::endl;
+
+        for (size_t l = 0; l < layerMs.size() && l < layerNames.size(); l++)
+        {
+            double meanMs = (total.batches > 0) ? layerMs[l] / total.batches : 0.0;
+            double share = (profiledMs > 0) ? 100.0 * layerMs[l] / profiledMs : 0.0;
+            std::cout << std::setw(8) << std::right << meanMs << " ms "
+                      << std::setw(6) << share << "%  " << layerNames[l] << std::endl;
+        }
+
+        std::cout << std::setw(8) << std::right
+                  << ((total.batches > 0) ? profiledMs / total.batches : 0.0)
+                  << " ms total per batch" << std::endl;
+        std::cout << "========================================\n"
+                  << std::endl;
+    }
+
+    // === Step 7: Final checkpoint of the CSV ===
+
+    if (writer.rows() == 0)
+    {
+        std::cerr << "Error: No embeddings extracted successfully" << std::endl;
+        return -1;
+    }
+
+    if (writer.close() != 0)
     {
         std::cerr << "Error: Failed to write CSV" << std::endl;
         return -1;
@@ -218,4 +627,4 @@ int main(int argc, char *argv[])
     std::cout << "========================================" << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
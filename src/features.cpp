@@ -10,6 +10,27 @@
 
 #include "features.h"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Get a rows x cols view of a workspace plane
+ * Grows the backing plane only when a larger image (or new type) arrives
+ */
+cv::Mat workspacePlane(cv::Mat &buffer, int rows, int cols, int type)
+{
+    bool sameType = !buffer.empty() && buffer.type() == type;
+    
+    if (!sameType || buffer.rows < rows || buffer.cols < cols)
+    {
+        buffer.create(std::max(rows, sameType ? buffer.rows : 0),
+                      std::max(cols, sameType ? buffer.cols : 0),
+                      type);
+    }
+    
+    return buffer(cv::Rect(0, 0, cols, rows));
+}
 
 /**
  * Extract baseline feature: center 7x7 square as feature vector
@@ -140,42 +161,34 @@ int extractBaselineFeature(const cv::Mat &src, std::vector<float> &feature)
 }
 
 /**
- * Extract rg chromaticity histogram as feature vector
+ * Extract baseline feature using a reusable workspace
+ * The 7x7 sample needs no scratch planes; this overload exists so that
+ * callers can drive every extractor through the same interface.
  */
-int extractRGChromaticityHistogram(const cv::Mat &src, 
-                                    std::vector<float> &feature,
-                                    int binsPerChannel)
+int extractBaselineFeature(const cv::Mat &src, std::vector<float> &feature,
+                           ExtractionWorkspace &)
+{
+    return extractBaselineFeature(src, feature);
+}
+
+/**
+ * Count rg chromaticity bins for rows [rowStart, rowEnd) of src
+ * Generic version for any bin count (see RGHist for the shipped ones)
+ *
+ * @param src Source image or region view (BGR)
+ * @param rowStart First row to count
+ * @param rowEnd One past the last row to count
+ * @param binsPerChannel Number of bins for r and g
+ * @param histogram Flattened count buffer (bins² values, already zeroed)
+ * @return Number of pixels counted (near-black pixels are skipped)
+ */
+static int accumulateRGCounts(const cv::Mat &src, int rowStart, int rowEnd,
+                              int binsPerChannel, float *histogram)
 {
-    // Clear any existing feature data
-    feature.clear();
-    
-    // === Step 1: Validate input ===
-    
-    if (src.empty())
-    {
-        std::cerr << "Error: Source image is empty" << std::endl;
-        return -1;
-    }
-    
-    if (src.channels() != 3)
-    {
-        std::cerr << "Error: Image must be 3-channel color (BGR)" << std::endl;
-        return -1;
-    }
-    
-    // === Step 2: Initialize 2D histogram ===
-    
-    // Create 2D histogram with zeros
-    // histogram[r_bin][g_bin] = count
-    std::vector<std::vector<float>> histogram(binsPerChannel, 
-                                               std::vector<float>(binsPerChannel, 0.0f));
-    
     int totalPixels = 0;
     
-    // === Step 3: Compute histogram ===
-    
-    // Loop through every pixel in the image
-    for (int row = 0; row < src.rows; row++)
+    // Loop through every pixel in the row range
+    for (int row = rowStart; row < rowEnd; row++)
     {
         // Get pointer to current row for faster access
         const cv::Vec3b *rowPtr = src.ptr<cv::Vec3b>(row);
@@ -208,46 +221,250 @@ int extractRGChromaticityHistogram(const cv::Mat &src,
             if (g_bin >= binsPerChannel) g_bin = binsPerChannel - 1;
             
             // Increment bin count
-            histogram[r_bin][g_bin] += 1.0f;
+            histogram[r_bin * binsPerChannel + g_bin] += 1.0f;
             totalPixels++;
         }
     }
     
-    // === Step 4: Normalize histogram ===
-    
-    // Convert counts to percentages
-    for (int r_bin = 0; r_bin < binsPerChannel; r_bin++)
+    return totalPixels;
+}
+
+/**
+ * rg chromaticity counting with the bin count fixed at compile time
+ *
+ * Same arithmetic as accumulateRGCounts, so the bins are identical, but
+ * with Bins a constant the compiler folds the bin scaling, clamps and
+ * r_bin * Bins indexing, and the counts live in a small local array that
+ * stays in L1 instead of going through the caller's float buffer.
+ * Instantiated for the configurations we ship: RGHist<16> (histogram,
+ * texture colour) and RGHist<8> (multihistogram halves, custom thirds).
+ */
+template <int Bins>
+struct RGHist
+{
+    static int accumulate(const cv::Mat &src, int rowStart, int rowEnd, float *histogram)
     {
-        for (int g_bin = 0; g_bin < binsPerChannel; g_bin++)
+        // Row ranges are at most one image (< TILE_PARALLEL_MIN_PIXELS) or
+        // one tile, so 32-bit counts cannot overflow
+        uint32_t counts[Bins * Bins] = {};
+        int totalPixels = 0;
+        
+        for (int row = rowStart; row < rowEnd; row++)
         {
-            if (totalPixels > 0)
+            const cv::Vec3b *rowPtr = src.ptr<cv::Vec3b>(row);
+            
+            for (int col = 0; col < src.cols; col++)
             {
-                histogram[r_bin][g_bin] /= totalPixels;
+                float b = static_cast<float>(rowPtr[col][0]);
+                float g = static_cast<float>(rowPtr[col][1]);
+                float r = static_cast<float>(rowPtr[col][2]);
+                float sum = r + g + b;
+                
+                // Skip black or near-black pixels to avoid division by zero
+                if (sum < 1.0f)
+                    continue;
+                
+                int r_bin = static_cast<int>((r / sum) * Bins);
+                int g_bin = static_cast<int>((g / sum) * Bins);
+                r_bin = std::min(r_bin, Bins - 1);
+                g_bin = std::min(g_bin, Bins - 1);
+                
+                counts[r_bin * Bins + g_bin]++;
+                totalPixels++;
             }
         }
+        
+        for (int i = 0; i < Bins * Bins; i++)
+        {
+            histogram[i] += static_cast<float>(counts[i]);
+        }
+        
+        return totalPixels;
     }
+};
+
+/**
+ * Count rg chromaticity bins, using a fixed-size kernel when one exists
+ */
+static int countRGBins(const cv::Mat &src, int rowStart, int rowEnd,
+                       int binsPerChannel, float *histogram)
+{
+    switch (binsPerChannel)
+    {
+    case 16:
+        return RGHist<16>::accumulate(src, rowStart, rowEnd, histogram);
+    case 8:
+        return RGHist<8>::accumulate(src, rowStart, rowEnd, histogram);
+    default:
+        return accumulateRGCounts(src, rowStart, rowEnd, binsPerChannel, histogram);
+    }
+}
+
+/**
+ * Check whether an image is large enough for tile-parallel extraction
+ */
+static bool useTiles(const cv::Mat &src, const ExtractionWorkspace &ws)
+{
+    return ws.tileMinPixels > 0 &&
+           static_cast<long long>(src.rows) * src.cols >= ws.tileMinPixels &&
+           src.rows > TILE_ROWS;
+}
+
+/**
+ * Run countTile(rowStart, rowEnd, partial, tileWs) for every row tile of
+ * src in parallel, then merge the per-tile partial histograms into out
+ *
+ * Each tile owns its slice of ws.tileHistograms, so tiles never share a
+ * counter. Tiles are split into one contiguous stripe per thread, and each
+ * stripe gets its own scratch workspace from ws.tileWorkspaces, which
+ * keeps its planes across tiles and images. Partials are merged in tile
+ * order in double precision, which keeps the result deterministic and
+ * avoids float count saturation on 100+ megapixel images.
+ */
+template <typename CountTile>
+static void mergeTileHistograms(const cv::Mat &src, int numBins, float *out,
+                                ExtractionWorkspace &ws, CountTile countTile)
+{
+    int numTiles = (src.rows + TILE_ROWS - 1) / TILE_ROWS;
+    
+    ws.tileHistograms.assign(static_cast<size_t>(numTiles) * numBins, 0.0f);
+    ws.tilePixels.assign(numTiles, 0);
+    
+    int numStripes = std::max(1, std::min(numTiles, cv::getNumThreads()));
+    if (static_cast<int>(ws.tileWorkspaces.size()) < numStripes)
+    {
+        ws.tileWorkspaces.resize(numStripes);
+    }
+    
+    cv::parallel_for_(cv::Range(0, numStripes), [&](const cv::Range &range)
+    {
+        for (int s = range.start; s < range.end; s++)
+        {
+            ExtractionWorkspace &tileWs = ws.tileWorkspaces[s];
+            int tileEnd = (s + 1) * numTiles / numStripes;
+            
+            for (int t = s * numTiles / numStripes; t < tileEnd; t++)
+            {
+                int rowStart = t * TILE_ROWS;
+                int rowEnd = std::min(src.rows, rowStart + TILE_ROWS);
+                float *partial = ws.tileHistograms.data() + static_cast<size_t>(t) * numBins;
+                ws.tilePixels[t] = countTile(rowStart, rowEnd, partial, tileWs);
+            }
+        }
+    });
     
-    // === Step 5: Flatten 2D histogram into 1D feature vector ===
+    // === Merge partial histograms ===
     
-    // Reserve space for efficiency
-    feature.reserve(binsPerChannel * binsPerChannel);
+    double totalPixels = 0.0;
+    for (int t = 0; t < numTiles; t++)
+    {
+        totalPixels += ws.tilePixels[t];
+    }
     
-    // Read histogram row by row
-    for (int r_bin = 0; r_bin < binsPerChannel; r_bin++)
+    for (int i = 0; i < numBins; i++)
     {
-        for (int g_bin = 0; g_bin < binsPerChannel; g_bin++)
+        double count = 0.0;
+        for (int t = 0; t < numTiles; t++)
         {
-            feature.push_back(histogram[r_bin][g_bin]);
+            count += ws.tileHistograms[static_cast<size_t>(t) * numBins + i];
         }
+        out[i] = (totalPixels > 0) ? static_cast<float>(count / totalPixels) : 0.0f;
     }
+}
+
+/**
+ * Accumulate a normalized rg chromaticity histogram into out
+ *
+ * Shared by every extractor that needs an rg histogram (whole image,
+ * halves, thirds). Bin counts go through ws.histogram and the normalized
+ * result is written straight into the caller's buffer, so concatenated
+ * features are filled in place without temporary vectors. Regions of at
+ * least ws.tileMinPixels are counted tile-parallel.
+ *
+ * @param src Source image or region view (BGR)
+ * @param out Destination for binsPerChannel * binsPerChannel values
+ * @param binsPerChannel Number of bins for r and g
+ * @param ws Workspace providing the count buffer
+ * @return 0 on success, -1 on error
+ */
+static int computeRGHistogram(const cv::Mat &src, float *out,
+                              int binsPerChannel, ExtractionWorkspace &ws)
+{
+    // === Step 1: Validate input ===
     
-    // === Step 6: Verify result ===
+    if (src.empty())
+    {
+        std::cerr << "Error: Source image is empty" << std::endl;
+        return -1;
+    }
     
-    int expectedSize = binsPerChannel * binsPerChannel;
-    if (feature.size() != static_cast<size_t>(expectedSize))
+    if (src.channels() != 3)
     {
-        std::cerr << "Error: Expected " << expectedSize 
-                  << " features, got " << feature.size() << std::endl;
+        std::cerr << "Error: Image must be 3-channel color (BGR)" << std::endl;
+        return -1;
+    }
+    
+    int numBins = binsPerChannel * binsPerChannel;
+    
+    // === Step 2: Large images - count row tiles in parallel ===
+    
+    if (useTiles(src, ws))
+    {
+        mergeTileHistograms(src, numBins, out, ws,
+            [&](int rowStart, int rowEnd, float *partial, ExtractionWorkspace &)
+            {
+                return countRGBins(src, rowStart, rowEnd, binsPerChannel, partial);
+            });
+        return 0;
+    }
+    
+    // === Step 3: Initialize 2D histogram ===
+    
+    // Flattened 2D histogram with zeros: histogram[r_bin * bins + g_bin] = count
+    // assign() keeps the existing capacity, so this only allocates the first time
+    ws.histogram.assign(numBins, 0.0f);
+    float *histogram = ws.histogram.data();
+    
+    // === Step 4: Compute histogram ===
+    
+    int totalPixels = countRGBins(src, 0, src.rows, binsPerChannel, histogram);
+    
+    // === Step 5: Normalize histogram into the output ===
+    
+    // Convert counts to percentages
+    for (int i = 0; i < numBins; i++)
+    {
+        out[i] = (totalPixels > 0) ? histogram[i] / totalPixels : histogram[i];
+    }
+    
+    return 0;
+}
+
+/**
+ * Extract rg chromaticity histogram as feature vector
+ */
+int extractRGChromaticityHistogram(const cv::Mat &src, 
+                                    std::vector<float> &feature,
+                                    int binsPerChannel)
+{
+    ExtractionWorkspace ws;
+    return extractRGChromaticityHistogram(src, feature, ws, binsPerChannel);
+}
+
+/**
+ * Extract rg chromaticity histogram using a reusable workspace
+ */
+int extractRGChromaticityHistogram(const cv::Mat &src,
+                                    std::vector<float> &feature,
+                                    ExtractionWorkspace &ws,
+                                    int binsPerChannel)
+{
+    // resize() reuses the caller's capacity when the vector is recycled
+    feature.resize(binsPerChannel * binsPerChannel);
+    
+    if (computeRGHistogram(src, feature.data(), binsPerChannel, ws) != 0)
+    {
+        feature.clear();
         return -1;
     }
     
@@ -260,6 +477,18 @@ int extractRGChromaticityHistogram(const cv::Mat &src,
 int extractMultiHistogram(const cv::Mat &src, 
                           std::vector<float> &feature,
                           int binsPerChannel)
+{
+    ExtractionWorkspace ws;
+    return extractMultiHistogram(src, feature, ws, binsPerChannel);
+}
+
+/**
+ * Extract multi-histogram feature using a reusable workspace
+ */
+int extractMultiHistogram(const cv::Mat &src,
+                          std::vector<float> &feature,
+                          ExtractionWorkspace &ws,
+                          int binsPerChannel)
 {
     // Clear any existing feature data
     feature.clear();
@@ -290,45 +519,224 @@ int extractMultiHistogram(const cv::Mat &src,
     cv::Mat topHalf = src(topRegion);
     cv::Mat bottomHalf = src(bottomRegion);
     
-    // === Step 3: Compute histogram for top half ===
+    // === Step 3: Size the output for both histograms ===
+    
+    // Layout: [top (bins²), bottom (bins²)]
+    int histSize = binsPerChannel * binsPerChannel;
+    feature.resize(2 * histSize);
     
-    std::vector<float> topHistogram;
-    if (extractRGChromaticityHistogram(topHalf, topHistogram, binsPerChannel) != 0)
+    // === Step 4: Compute histogram for top half ===
+    
+    if (computeRGHistogram(topHalf, feature.data(), binsPerChannel, ws) != 0)
     {
         std::cerr << "Error: Failed to extract histogram from top half" << std::endl;
+        feature.clear();
         return -1;
     }
     
-    // === Step 4: Compute histogram for bottom half ===
+    // === Step 5: Compute histogram for bottom half ===
     
-    std::vector<float> bottomHistogram;
-    if (extractRGChromaticityHistogram(bottomHalf, bottomHistogram, binsPerChannel) != 0)
+    if (computeRGHistogram(bottomHalf, feature.data() + histSize, binsPerChannel, ws) != 0)
     {
         std::cerr << "Error: Failed to extract histogram from bottom half" << std::endl;
+        feature.clear();
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Count rg chromaticity bins for every cell of a grid in one sweep
+ */
+int extractRGGridCounts(const cv::Mat &src, int gridRows, int gridCols,
+                        int binsPerChannel, std::vector<uint32_t> &counts,
+                        ExtractionWorkspace &ws)
+{
+    // === Step 1: Validate input ===
+    
+    if (src.empty())
+    {
+        std::cerr << "Error: Source image is empty" << std::endl;
+        return -1;
+    }
+    
+    if (src.channels() != 3)
+    {
+        std::cerr << "Error: Image must be 3-channel color (BGR)" << std::endl;
+        return -1;
+    }
+    
+    if (gridRows <= 0 || gridCols <= 0 || binsPerChannel <= 0)
+    {
+        std::cerr << "Error: Grid size and bins must be positive" << std::endl;
+        return -1;
+    }
+    
+    int numBins = binsPerChannel * binsPerChannel;
+    
+    // === Step 2: Map image columns to grid columns once ===
+    
+    ws.colCells.resize(src.cols);
+    for (int col = 0; col < src.cols; col++)
+    {
+        ws.colCells[col] = static_cast<int>(static_cast<long long>(col) * gridCols / src.cols);
+    }
+    
+    // assign() keeps the existing capacity, so this only allocates the first time
+    counts.assign(static_cast<size_t>(gridRows) * gridCols * numBins, 0);
+    
+    // === Step 3: Count every pixel into its cell ===
+    
+    for (int row = 0; row < src.rows; row++)
+    {
+        const cv::Vec3b *rowPtr = src.ptr<cv::Vec3b>(row);
+        int cellRow = static_cast<int>(static_cast<long long>(row) * gridRows / src.rows);
+        uint32_t *rowCells = counts.data() + static_cast<size_t>(cellRow) * gridCols * numBins;
+        
+        for (int col = 0; col < src.cols; col++)
+        {
+            float b = static_cast<float>(rowPtr[col][0]);
+            float g = static_cast<float>(rowPtr[col][1]);
+            float r = static_cast<float>(rowPtr[col][2]);
+            float sum = r + g + b;
+            
+            // Skip black or near-black pixels to avoid division by zero
+            if (sum < 1.0f)
+                continue;
+            
+            int r_bin = static_cast<int>((r / sum) * binsPerChannel);
+            int g_bin = static_cast<int>((g / sum) * binsPerChannel);
+            r_bin = std::min(r_bin, binsPerChannel - 1);
+            g_bin = std::min(g_bin, binsPerChannel - 1);
+            
+            rowCells[ws.colCells[col] * numBins + r_bin * binsPerChannel + g_bin]++;
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * Extract spatial pyramid feature: rg histograms over 1x1, 2x2, 4x4 grids
+ */
+int extractSpatialPyramid(const cv::Mat &src,
+                          std::vector<float> &feature,
+                          int levels,
+                          int binsPerChannel)
+{
+    ExtractionWorkspace ws;
+    return extractSpatialPyramid(src, feature, ws, levels, binsPerChannel);
+}
+
+/**
+ * Extract spatial pyramid feature using a reusable workspace
+ */
+int extractSpatialPyramid(const cv::Mat &src,
+                          std::vector<float> &feature,
+                          ExtractionWorkspace &ws,
+                          int levels,
+                          int binsPerChannel)
+{
+    // === Step 1: Validate input ===
+    
+    if (levels <= 0)
+    {
+        std::cerr << "Error: Spatial pyramid needs at least one level" << std::endl;
+        feature.clear();
         return -1;
     }
     
-    // === Step 5: Concatenate histograms ===
+    int grid = 1 << (levels - 1);  // Finest grid: 1, 2, 4, ...
+    int numBins = binsPerChannel * binsPerChannel;
     
-    // Reserve space for efficiency
-    int expectedSize = 2 * binsPerChannel * binsPerChannel;
-    feature.reserve(expectedSize);
+    // === Step 2: One pixel sweep into the finest grid ===
     
-    // Add top histogram
-    feature.insert(feature.end(), topHistogram.begin(), topHistogram.end());
+    if (extractRGGridCounts(src, grid, grid, binsPerChannel, ws.gridCounts, ws) != 0)
+    {
+        feature.clear();
+        return -1;
+    }
+    
+    buildCellSAT(ws.gridCounts.data(), grid, grid, numBins, ws.cellSAT);
     
-    // Add bottom histogram
-    feature.insert(feature.end(), bottomHistogram.begin(), bottomHistogram.end());
+    // === Step 3: Size the output for every level ===
+    
+    // Level l has 4^l cells
+    size_t numCells = 0;
+    for (int level = 0; level < levels; level++)
+    {
+        numCells += static_cast<size_t>(1) << (2 * level);
+    }
+    feature.resize(numCells * numBins);
     
-    // === Step 6: Verify result ===
+    // === Step 4: Read each level's cells from the table ===
     
-    if (feature.size() != static_cast<size_t>(expectedSize))
+    float *out = feature.data();
+    for (int level = 0; level < levels; level++)
     {
-        std::cerr << "Error: Expected " << expectedSize 
-                  << " features, got " << feature.size() << std::endl;
+        int cellsPerSide = 1 << level;
+        int span = grid / cellsPerSide;  // Finest cells per level cell
+        
+        for (int r = 0; r < cellsPerSide; r++)
+        {
+            for (int c = 0; c < cellsPerSide; c++)
+            {
+                cellRegionHistogram(ws.cellSAT, grid, numBins,
+                                    r * span, c * span, (r + 1) * span, (c + 1) * span, out);
+                out += numBins;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * Extract grid histogram feature: an rg histogram for every cell of a grid
+ */
+int extractRGGridHistogram(const cv::Mat &src,
+                           std::vector<float> &feature,
+                           int gridSize,
+                           int binsPerChannel)
+{
+    ExtractionWorkspace ws;
+    return extractRGGridHistogram(src, feature, ws, gridSize, binsPerChannel);
+}
+
+/**
+ * Extract grid histogram feature using a reusable workspace
+ */
+int extractRGGridHistogram(const cv::Mat &src,
+                           std::vector<float> &feature,
+                           ExtractionWorkspace &ws,
+                           int gridSize,
+                           int binsPerChannel)
+{
+    // === Step 1: One pixel sweep into the grid ===
+    
+    if (extractRGGridCounts(src, gridSize, gridSize, binsPerChannel, ws.gridCounts, ws) != 0)
+    {
+        feature.clear();
         return -1;
     }
     
+    // === Step 2: Normalize by the whole image's pixel count ===
+    
+    // Dividing every cell by the same total keeps cells additive, so any
+    // block of cells can be summed into a region histogram at query time
+    double totalPixels = 0.0;
+    for (uint32_t count : ws.gridCounts)
+    {
+        totalPixels += count;
+    }
+    
+    feature.resize(ws.gridCounts.size());
+    for (size_t i = 0; i < ws.gridCounts.size(); i++)
+    {
+        feature[i] = (totalPixels > 0) ? static_cast<float>(ws.gridCounts[i] / totalPixels) : 0.0f;
+    }
+    
     return 0;
 }
 
@@ -353,9 +761,18 @@ int extractMultiHistogram(const cv::Mat &src,
  */
 int sobelX3x3(cv::Mat &src, cv::Mat &dst)
 {
-    // Create temporary image to store intermediate vertical smoothing result
-    cv::Mat temp;
-    temp.create(src.size(), CV_16SC3);
+    ExtractionWorkspace ws;
+    return sobelX3x3(src, dst, ws);
+}
+
+/**
+ * 3x3 Sobel X Filter using a reusable workspace
+ * The intermediate vertical smoothing plane is a view into ws.sobelTemp
+ */
+int sobelX3x3(cv::Mat &src, cv::Mat &dst, ExtractionWorkspace &ws)
+{
+    // Temporary image to store intermediate vertical smoothing result
+    cv::Mat temp = workspacePlane(ws.sobelTemp, src.rows, src.cols, CV_16SC3);
 
     // Vertical smoothing kernel: [1, 2, 1]
     int vKernel[3] = {1, 2, 1};
@@ -451,9 +868,18 @@ int sobelX3x3(cv::Mat &src, cv::Mat &dst)
  */
 int sobelY3x3(cv::Mat &src, cv::Mat &dst)
 {
-    // Create temporary image to store intermediate horizontal smoothing result
-    cv::Mat temp;
-    temp.create(src.size(), CV_16SC3);
+    ExtractionWorkspace ws;
+    return sobelY3x3(src, dst, ws);
+}
+
+/**
+ * 3x3 Sobel Y Filter using a reusable workspace
+ * The intermediate horizontal smoothing plane is a view into ws.sobelTemp
+ */
+int sobelY3x3(cv::Mat &src, cv::Mat &dst, ExtractionWorkspace &ws)
+{
+    // Temporary image to store intermediate horizontal smoothing result
+    cv::Mat temp = workspacePlane(ws.sobelTemp, src.rows, src.cols, CV_16SC3);
 
     // Horizontal smoothing kernel: [1, 2, 1]
     int hKernel[3] = {1, 2, 1};
@@ -588,26 +1014,124 @@ int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat &dst)
 }
 
 /**
- * Extract histogram of gradient magnitudes (texture feature)
- * Helper function for extractTextureColorFeature
+ * Bin gradient magnitudes (0-255) of rows [rowStart, rowEnd) of magGray
+ * Generic version for any bin count (see GradHist for the shipped one)
+ *
+ * @return Number of pixels counted
  */
-int extractGradientMagnitudeHistogram(const cv::Mat &src, 
-                                       std::vector<float> &feature,
-                                       int bins)
+static int accumulateGradientBins(const cv::Mat &magGray, int rowStart, int rowEnd,
+                                  int bins, float *histogram)
 {
-    feature.clear();
+    int totalPixels = 0;
+    
+    for (int i = rowStart; i < rowEnd; i++)
+    {
+        const unsigned char *row = magGray.ptr<unsigned char>(i);
+        
+        for (int j = 0; j < magGray.cols; j++)
+        {
+            // Get magnitude value (0-255)
+            unsigned char value = row[j];
+            
+            // Determine which bin (0 to bins-1)
+            int bin = (value * bins) / 256;
+            
+            // Clamp to valid range
+            if (bin >= bins) bin = bins - 1;
+            
+            histogram[bin] += 1.0f;
+            totalPixels++;
+        }
+    }
+    
+    return totalPixels;
+}
+
+/**
+ * Gradient magnitude binning with the bin count fixed at compile time
+ *
+ * (value * Bins) / 256 is a constant shift for power-of-two Bins and can
+ * never reach Bins, so the clamp disappears. Instantiated as GradHist<16>
+ * (texture and custom).
+ */
+template <int Bins>
+struct GradHist
+{
+    static_assert(Bins > 0 && Bins <= 256, "GradHist bins must be in 1..256");
+    
+    static int accumulate(const cv::Mat &magGray, int rowStart, int rowEnd, float *histogram)
+    {
+        uint32_t counts[Bins] = {};
+        
+        for (int i = rowStart; i < rowEnd; i++)
+        {
+            const unsigned char *row = magGray.ptr<unsigned char>(i);
+            
+            for (int j = 0; j < magGray.cols; j++)
+            {
+                counts[(row[j] * Bins) / 256]++;
+            }
+        }
+        
+        for (int b = 0; b < Bins; b++)
+        {
+            histogram[b] += static_cast<float>(counts[b]);
+        }
+        
+        return (rowEnd - rowStart) * magGray.cols;
+    }
+};
+
+/**
+ * Bin gradient magnitudes, using a fixed-size kernel when one exists
+ */
+static int countGradientBins(const cv::Mat &magGray, int rowStart, int rowEnd,
+                             int bins, float *histogram)
+{
+    if (bins == 16)
+        return GradHist<16>::accumulate(magGray, rowStart, rowEnd, histogram);
+    return accumulateGradientBins(magGray, rowStart, rowEnd, bins, histogram);
+}
+
+/**
+ * Count gradient magnitude bins for rows [rowStart, rowEnd) of src
+ *
+ * The Sobel planes are computed over the requested rows plus one halo row
+ * above and below (clamped to the image), and only the requested rows are
+ * counted. Interior rows therefore see exactly the same 3x3 neighbourhood
+ * as in a whole-image pass, and the image's own top/bottom rows keep their
+ * boundary handling, so tiled and untiled counts are identical.
+ *
+ * @param src Source image (BGR)
+ * @param rowStart First row to count
+ * @param rowEnd One past the last row to count
+ * @param bins Number of magnitude bins
+ * @param histogram Count buffer (bins values, already zeroed)
+ * @param ws Workspace providing the Sobel/magnitude planes
+ * @return Number of pixels counted, or -1 on error
+ */
+static int accumulateGradientCounts(const cv::Mat &src, int rowStart, int rowEnd,
+                                    int bins, float *histogram,
+                                    ExtractionWorkspace &ws)
+{
+    // Extend the tile by one halo row on each side for the 3x3 kernels
+    int haloStart = std::max(0, rowStart - 1);
+    int haloEnd = std::min(src.rows, rowEnd + 1);
+    cv::Mat region = src.rowRange(haloStart, haloEnd);
+    int rows = region.rows;
     
     // === Step 1: Compute Sobel gradients ===
     
-    cv::Mat sobelX, sobelY;
+    cv::Mat sobelX = workspacePlane(ws.sobelX, rows, src.cols, CV_16SC3);
+    cv::Mat sobelY = workspacePlane(ws.sobelY, rows, src.cols, CV_16SC3);
     
-    if (sobelX3x3(const_cast<cv::Mat&>(src), sobelX) != 0)
+    if (sobelX3x3(region, sobelX, ws) != 0)
     {
         std::cerr << "Error: Failed to compute Sobel X" << std::endl;
         return -1;
     }
     
-    if (sobelY3x3(const_cast<cv::Mat&>(src), sobelY) != 0)
+    if (sobelY3x3(region, sobelY, ws) != 0)
     {
         std::cerr << "Error: Failed to compute Sobel Y" << std::endl;
         return -1;
@@ -615,7 +1139,7 @@ int extractGradientMagnitudeHistogram(const cv::Mat &src,
     
     // === Step 2: Compute gradient magnitude ===
     
-    cv::Mat mag;
+    cv::Mat mag = workspacePlane(ws.gradMag, rows, src.cols, CV_8UC3);
     if (magnitude(sobelX, sobelY, mag) != 0)
     {
         std::cerr << "Error: Failed to compute magnitude" << std::endl;
@@ -625,47 +1149,68 @@ int extractGradientMagnitudeHistogram(const cv::Mat &src,
     // === Step 3: Convert to grayscale for histogram ===
     
     // Convert BGR magnitude to single-channel grayscale
-    cv::Mat magGray;
+    // dst already has the right size and type, so cvtColor writes in place
+    cv::Mat magGray = workspacePlane(ws.gradGray, rows, src.cols, CV_8UC1);
     cv::cvtColor(mag, magGray, cv::COLOR_BGR2GRAY);
     
     // === Step 4: Build histogram of gradient magnitudes ===
     
-    std::vector<float> histogram(bins, 0.0f);
-    int totalPixels = 0;
+    // Skip the halo rows: they were only needed as kernel support
+    return countGradientBins(magGray, rowStart - haloStart, rowEnd - haloStart, bins, histogram);
+}
+
+/**
+ * Extract histogram of gradient magnitudes (texture feature)
+ * Helper for extractTextureColorFeature and extractCustomBlueSceneFeature
+ *
+ * Writes bins normalized values into out. All intermediate planes
+ * (Sobel X/Y, magnitude, grayscale) are views into the workspace.
+ * Images of at least ws.tileMinPixels are processed as parallel row
+ * tiles, each stripe of tiles with its own pooled scratch planes.
+ */
+static int computeGradientMagnitudeHistogram(const cv::Mat &src,
+                                             float *out,
+                                             int bins,
+                                             ExtractionWorkspace &ws)
+{
+    // === Large images: one halo-padded row tile per parallel task ===
     
-    for (int i = 0; i < magGray.rows; i++)
+    if (useTiles(src, ws))
     {
-        unsigned char *row = magGray.ptr<unsigned char>(i);
+        std::atomic<bool> failed(false);
         
-        for (int j = 0; j < magGray.cols; j++)
-        {
-            // Get magnitude value (0-255)
-            unsigned char value = row[j];
-            
-            // Determine which bin (0 to bins-1)
-            int bin = (value * bins) / 256;
-            
-            // Clamp to valid range
-            if (bin >= bins) bin = bins - 1;
-            
-            histogram[bin] += 1.0f;
-            totalPixels++;
-        }
+        mergeTileHistograms(src, bins, out, ws,
+            [&](int rowStart, int rowEnd, float *partial, ExtractionWorkspace &tileWs)
+            {
+                int count = accumulateGradientCounts(src, rowStart, rowEnd, bins, partial, tileWs);
+                if (count < 0)
+                {
+                    failed = true;
+                    return 0;
+                }
+                return count;
+            });
+        
+        return failed ? -1 : 0;
     }
     
-    // === Step 5: Normalize histogram ===
+    // === Regular images: whole-image pass ===
     
-    for (int i = 0; i < bins; i++)
+    ws.histogram.assign(bins, 0.0f);
+    float *histogram = ws.histogram.data();
+    
+    int totalPixels = accumulateGradientCounts(src, 0, src.rows, bins, histogram, ws);
+    if (totalPixels < 0)
     {
-        if (totalPixels > 0)
-        {
-            histogram[i] /= totalPixels;
-        }
+        return -1;
     }
     
-    // === Step 6: Copy to feature vector ===
+    // === Normalize histogram into the output ===
     
-    feature = histogram;
+    for (int i = 0; i < bins; i++)
+    {
+        out[i] = (totalPixels > 0) ? histogram[i] / totalPixels : histogram[i];
+    }
     
     return 0;
 }
@@ -678,6 +1223,19 @@ int extractTextureColorFeature(const cv::Mat &src,
                                 std::vector<float> &feature,
                                 int colorBins,
                                 int textureBins)
+{
+    ExtractionWorkspace ws;
+    return extractTextureColorFeature(src, feature, ws, colorBins, textureBins);
+}
+
+/**
+ * Extract combined texture and color feature using a reusable workspace
+ */
+int extractTextureColorFeature(const cv::Mat &src,
+                                std::vector<float> &feature,
+                                ExtractionWorkspace &ws,
+                                int colorBins,
+                                int textureBins)
 {
     feature.clear();
     
@@ -695,41 +1253,27 @@ int extractTextureColorFeature(const cv::Mat &src,
         return -1;
     }
     
-    // === Step 2: Extract color histogram ===
+    // === Step 2: Size the output ===
     
-    std::vector<float> colorFeature;
-    if (extractRGChromaticityHistogram(src, colorFeature, colorBins) != 0)
-    {
-        std::cerr << "Error: Failed to extract color histogram" << std::endl;
-        return -1;
-    }
+    // Layout: [color (colorBins²), texture (textureBins)]
+    int colorSize = colorBins * colorBins;
+    feature.resize(colorSize + textureBins);
     
-    // === Step 3: Extract texture histogram ===
+    // === Step 3: Extract color histogram ===
     
-    std::vector<float> textureFeature;
-    if (extractGradientMagnitudeHistogram(src, textureFeature, textureBins) != 0)
+    if (computeRGHistogram(src, feature.data(), colorBins, ws) != 0)
     {
-        std::cerr << "Error: Failed to extract texture histogram" << std::endl;
+        std::cerr << "Error: Failed to extract color histogram" << std::endl;
+        feature.clear();
         return -1;
     }
     
-    // === Step 4: Concatenate features ===
-    
-    int expectedSize = (colorBins * colorBins) + textureBins;
-    feature.reserve(expectedSize);
-    
-    // Add color histogram
-    feature.insert(feature.end(), colorFeature.begin(), colorFeature.end());
+    // === Step 4: Extract texture histogram ===
     
-    // Add texture histogram
-    feature.insert(feature.end(), textureFeature.begin(), textureFeature.end());
-    
-    // === Step 5: Verify result ===
-    
-    if (feature.size() != static_cast<size_t>(expectedSize))
+    if (computeGradientMagnitudeHistogram(src, feature.data() + colorSize, textureBins, ws) != 0)
     {
-        std::cerr << "Error: Expected " << expectedSize 
-                  << " features, got " << feature.size() << std::endl;
+        std::cerr << "Error: Failed to extract texture histogram" << std::endl;
+        feature.clear();
         return -1;
     }
     
@@ -737,21 +1281,18 @@ int extractTextureColorFeature(const cv::Mat &src,
 }
 
 /**
- * Helper: Calculate blue dominance in image
+ * Count blue pixels in rows [rowStart, rowEnd) of src
+ * Converts just those rows to HSV in a workspace plane
  */
-float calculateBlueDominance(const cv::Mat &src)
+static int countBluePixels(const cv::Mat &src, int rowStart, int rowEnd,
+                           ExtractionWorkspace &ws)
 {
-    if (src.empty() || src.channels() != 3)
-    {
-        return 0.0f;
-    }
-    
     // Convert to HSV for better color detection
-    cv::Mat hsv;
-    cv::cvtColor(src, hsv, cv::COLOR_BGR2HSV);
+    cv::Mat rows = src.rowRange(rowStart, rowEnd);
+    cv::Mat hsv = workspacePlane(ws.hsv, rows.rows, rows.cols, CV_8UC3);
+    cv::cvtColor(rows, hsv, cv::COLOR_BGR2HSV);
     
     int bluePixels = 0;
-    int totalPixels = src.rows * src.cols;
     
     // Blue hue range in OpenCV HSV: approximately 100-130 (out of 180)
     // High saturation (> 30) to avoid grayish blues
@@ -776,6 +1317,37 @@ float calculateBlueDominance(const cv::Mat &src)
         }
     }
     
+    return bluePixels;
+}
+
+/**
+ * Helper: Calculate blue dominance in image
+ */
+static float calculateBlueDominance(const cv::Mat &src, ExtractionWorkspace &ws)
+{
+    if (src.empty() || src.channels() != 3)
+    {
+        return 0.0f;
+    }
+    
+    // Large images: count blue pixels per row tile in parallel
+    if (useTiles(src, ws))
+    {
+        float dominance = 0.0f;
+        
+        mergeTileHistograms(src, 1, &dominance, ws,
+            [&](int rowStart, int rowEnd, float *partial, ExtractionWorkspace &tileWs)
+            {
+                partial[0] = static_cast<float>(countBluePixels(src, rowStart, rowEnd, tileWs));
+                return (rowEnd - rowStart) * src.cols;
+            });
+        
+        return dominance;
+    }
+    
+    int bluePixels = countBluePixels(src, 0, src.rows, ws);
+    int totalPixels = src.rows * src.cols;
+    
     // Return percentage of blue pixels
     return static_cast<float>(bluePixels) / static_cast<float>(totalPixels);
 }
@@ -785,6 +1357,17 @@ float calculateBlueDominance(const cv::Mat &src)
  */
 int extractCustomBlueSceneFeature(const cv::Mat &src, 
                                    std::vector<float> &feature)
+{
+    ExtractionWorkspace ws;
+    return extractCustomBlueSceneFeature(src, feature, ws);
+}
+
+/**
+ * Extract custom blue scene feature using a reusable workspace
+ */
+int extractCustomBlueSceneFeature(const cv::Mat &src,
+                                   std::vector<float> &feature,
+                                   ExtractionWorkspace &ws)
 {
     feature.clear();
     
@@ -802,70 +1385,63 @@ int extractCustomBlueSceneFeature(const cv::Mat &src,
         return -1;
     }
     
+    // Layout: [blue (1), texture (16), top (64), middle (64), bottom (64)]
+    const int textureBins = 16;
+    const int spatialBins = 8;
+    const int spatialSize = spatialBins * spatialBins;
+    int expectedSize = 1 + textureBins + (3 * spatialSize); // 1 + 16 + 192 = 209
+    feature.resize(expectedSize);
+    float *out = feature.data();
+    
     // === Step 2: Component 1 - Blue dominance (1 value) ===
     
-    float blueDominance = calculateBlueDominance(src);
-    feature.push_back(blueDominance);
+    out[0] = calculateBlueDominance(src, ws);
     
     // === Step 3: Component 2 - Texture smoothness (16 values) ===
     
-    std::vector<float> textureFeature;
-    if (extractGradientMagnitudeHistogram(src, textureFeature, 16) != 0)
+    if (computeGradientMagnitudeHistogram(src, out + 1, textureBins, ws) != 0)
     {
         std::cerr << "Error: Failed to extract texture histogram" << std::endl;
+        feature.clear();
         return -1;
     }
     
-    feature.insert(feature.end(), textureFeature.begin(), textureFeature.end());
-    
     // === Step 4: Component 3 - Spatial layout (3 regions × 64 bins = 192 values) ===
     
     // Divide image into top (sky), middle (horizon), bottom (foreground/water)
     int regionHeight = src.rows / 3;
+    float *spatial = out + 1 + textureBins;
     
     // Top region (sky)
     cv::Rect topRect(0, 0, src.cols, regionHeight);
     cv::Mat topRegion = src(topRect);
     
-    std::vector<float> topHist;
-    if (extractRGChromaticityHistogram(topRegion, topHist, 8) != 0)
+    if (computeRGHistogram(topRegion, spatial, spatialBins, ws) != 0)
     {
         std::cerr << "Error: Failed to extract top region histogram" << std::endl;
+        feature.clear();
         return -1;
     }
-    feature.insert(feature.end(), topHist.begin(), topHist.end());
     
     // Middle region (horizon/transition)
     cv::Rect middleRect(0, regionHeight, src.cols, regionHeight);
     cv::Mat middleRegion = src(middleRect);
     
-    std::vector<float> middleHist;
-    if (extractRGChromaticityHistogram(middleRegion, middleHist, 8) != 0)
+    if (computeRGHistogram(middleRegion, spatial + spatialSize, spatialBins, ws) != 0)
     {
         std::cerr << "Error: Failed to extract middle region histogram" << std::endl;
+        feature.clear();
         return -1;
     }
-    feature.insert(feature.end(), middleHist.begin(), middleHist.end());
     
     // Bottom region (foreground/water)
     cv::Rect bottomRect(0, 2 * regionHeight, src.cols, src.rows - 2 * regionHeight);
     cv::Mat bottomRegion = src(bottomRect);
     
-    std::vector<float> bottomHist;
-    if (extractRGChromaticityHistogram(bottomRegion, bottomHist, 8) != 0)
+    if (computeRGHistogram(bottomRegion, spatial + 2 * spatialSize, spatialBins, ws) != 0)
     {
         std::cerr << "Error: Failed to extract bottom region histogram" << std::endl;
-        return -1;
-    }
-    feature.insert(feature.end(), bottomHist.begin(), bottomHist.end());
-    
-    // === Step 5: Verify result ===
-    
-    int expectedSize = 1 + 16 + (3 * 8 * 8); // 1 + 16 + 192 = 209
-    if (feature.size() != static_cast<size_t>(expectedSize))
-    {
-        std::cerr << "Error: Expected " << expectedSize 
-                  << " features, got " << feature.size() << std::endl;
+        feature.clear();
         return -1;
     }
     
@@ -20,7 +20,9 @@
  *   Use trackbar to switch feature type
  *   's' - Activate search mode (type filename, Enter to select, Esc to cancel)
  *   'n'/'p' - Next/Previous page of browser images
- *   '1'-'6' - Switch feature type
+ *   '1', '2', ... - Switch feature type (one key per registered type)
+ *   Drag on the target - Search for the selected region anywhere (grid features)
+ *   'r' - Clear the region and go back to whole-image queries
  *   'q'/ESC - Quit (when not in search mode)
  */
 
@@ -30,6 +32,7 @@
 #include <vector>
 #include <algorithm>
 #include <map>
+#include "feature_registry.h"
 #include "features.h"
 #include "distance.h"
 #include "utils.h"
@@ -63,24 +66,40 @@ const cv::Scalar BOTTOM_LABEL(0, 100, 255);
 // Feature type names
 // ========================================
 
-const std::vector<std::string> FEATURE_NAMES = {
-    "baseline", "histogram", "multihistogram", "texture", "dnn", "custom"};
-
-const std::vector<std::string> FEATURE_LABELS = {
-    "1: Baseline (7x7 SSD)",
-    "2: Histogram (rg Chrom)",
-    "3: Multi-Hist (Top/Bot)",
-    "4: Texture + Color",
-    "5: DNN Embeddings",
-    "6: Custom (Blue Scene)"};
-
-const std::vector<std::string> CSV_FILES = {
-    "../data/baseline_features.csv",
-    "../data/histogram_features.csv",
-    "../data/multihistogram_features.csv",
-    "../data/texture_features.csv",
-    "", // DNN loaded separately
-    "../data/custom_features.csv"};
+// Built from the feature registry, in its menu order
+
+static std::vector<std::string> registryNames()
+{
+    std::vector<std::string> names;
+    forEachFeatureType([&](auto type) { names.push_back(decltype(type)::name); });
+    return names;
+}
+
+static std::vector<std::string> registryLabels()
+{
+    std::vector<std::string> labels;
+    forEachFeatureType([&](auto type)
+    {
+        labels.push_back(std::to_string(labels.size() + 1) + ": " + decltype(type)::label);
+    });
+    return labels;
+}
+
+static std::vector<std::string> registryCSVFiles()
+{
+    std::vector<std::string> files;
+    forEachFeatureType([&](auto type)
+    {
+        using Type = decltype(type);
+        // DNN loaded separately (from the command line)
+        files.push_back(Type::extractable ? std::string("../data/") + Type::defaultCSV : "");
+    });
+    return files;
+}
+
+const std::vector<std::string> FEATURE_NAMES = registryNames();
+const std::vector<std::string> FEATURE_LABELS = registryLabels();
+const std::vector<std::string> CSV_FILES = registryCSVFiles();
 
 // ========================================
 // Helper Functions
@@ -112,126 +131,170 @@ void drawBorder(cv::Mat &img, const cv::Scalar &color, int t = 2)
     cv::rectangle(img, cv::Point(0, 0), cv::Point(img.cols - 1, img.rows - 1), color, t);
 }
 
-int extractFeature(const cv::Mat &img, const std::string &type, std::vector<float> &feat)
+/**
+ * Area of a w x h thumbnail covered by the image (makeThumbnail letterboxes)
+ */
+cv::Rect thumbImageArea(const cv::Size &imgSize, int w, int h)
 {
-    if (type == "baseline")
-        return extractBaselineFeature(img, feat);
-    if (type == "histogram")
-        return extractRGChromaticityHistogram(img, feat);
-    if (type == "multihistogram")
-        return extractMultiHistogram(img, feat);
-    if (type == "texture")
-        return extractTextureColorFeature(img, feat);
-    if (type == "custom")
-        return extractCustomBlueSceneFeature(img, feat);
-    return -1;
+    float s = std::min((float)w / imgSize.width, (float)h / imgSize.height);
+    int nw = (int)(imgSize.width * s);
+    int nh = (int)(imgSize.height * s);
+    return cv::Rect((w - nw) / 2, (h - nh) / 2, nw, nh);
 }
 
-float computeDist(const std::string &type,
-                  const std::vector<float> &f1, const std::vector<float> &f2,
-                  const std::vector<float> &d1 = {}, const std::vector<float> &d2 = {})
+/**
+ * Map a rectangle in image pixels onto its thumbnail
+ */
+cv::Rect imageToThumb(const cv::Rect &r, const cv::Size &imgSize, int w, int h)
 {
-    if (type == "baseline")
-        return distanceSSD(f1, f2);
-    if (type == "histogram")
-        return distanceHistogramIntersection(f1, f2);
-    if (type == "multihistogram")
-        return distanceMultiHistogram(f1, f2, 2, {0.5f, 0.5f});
-    if (type == "texture")
-        return distanceTextureColor(f1, f2, 256, 16, 0.5f, 0.5f);
-    if (type == "dnn")
-        return distanceCosine(f1, f2);
-    if (type == "custom")
-        return distanceCustomBlueScene(f1, f2, d1, d2);
-    return -1.0f;
+    cv::Rect area = thumbImageArea(imgSize, w, h);
+    float s = (float)area.width / imgSize.width;
+    return cv::Rect(area.x + (int)(r.x * s), area.y + (int)(r.y * s),
+                    std::max(1, (int)(r.width * s)), std::max(1, (int)(r.height * s)));
 }
 
-std::vector<MatchResult> runQuery(const std::string &targetFile,
-                                  const std::string &featureType,
-                                  const std::string &imageDir,
-                                  const std::vector<FeatureData> &db,
-                                  const std::vector<FeatureData> &dnnDb,
-                                  const cv::Mat &targetImg)
+/**
+ * Map a rectangle on a thumbnail back to image pixels (clipped to the image)
+ */
+cv::Rect thumbToImage(const cv::Rect &r, const cv::Size &imgSize, int w, int h)
 {
-    std::vector<MatchResult> results;
-    std::vector<float> tFeat, tDNN;
+    cv::Rect area = thumbImageArea(imgSize, w, h);
+    cv::Rect inside = r & area;
+    if (inside.area() <= 0)
+        return cv::Rect();
+    float s = (float)imgSize.width / area.width;
+    cv::Rect mapped((int)((inside.x - area.x) * s), (int)((inside.y - area.y) * s),
+                    (int)(inside.width * s), (int)(inside.height * s));
+    return mapped & cv::Rect(0, 0, imgSize.width, imgSize.height);
+}
 
-    // Validate database is not empty
-    if (db.empty())
-        return results;
+/**
+ * Rank a feature database against one target, for a known feature type
+ *
+ * Instantiated per type through dispatchFeatureType, so the scan calls
+ * the type's distance function directly.
+ */
+template <typename Type>
+MatchSelection runTypedQuery(const std::string &targetFile,
+                             const std::vector<FeatureData> &db,
+                             const FeatureMatrix &matrix,
+                             const DNNIndex &dnnIndex,
+                             const cv::Mat &targetImg)
+{
+    MatchSelection results;
+    std::vector<float> tFeat, tDNN;
+    std::vector<const std::vector<float> *> dbDNN;
 
-    if (featureType == "dnn")
+    if constexpr (Type::extractable)
     {
-        for (const auto &d : db)
-            if (d.filename == targetFile)
-            {
-                tFeat = d.feature;
-                break;
-            }
+        if (targetImg.empty())
+            return results;
+        ExtractionWorkspace ws;
+        Type::extract(targetImg, tFeat, ws);
     }
-    else if (featureType == "custom")
+    else
     {
-        extractFeature(targetImg, featureType, tFeat);
-        for (const auto &d : dnnDb)
+        for (const auto &d : db)
             if (d.filename == targetFile)
             {
-                tDNN = d.feature;
+                tFeat = d.feature;
                 break;
             }
     }
-    else
-    {
-        extractFeature(targetImg, featureType, tFeat);
-    }
 
     if (tFeat.empty())
         return results;
 
     // For custom features, validate both feature vectors exist with correct sizes
-    if (featureType == "custom")
+    if constexpr (Type::needsDNN)
     {
-        if (tDNN.empty() || tFeat.size() != 209 || tDNN.size() != 512)
+        auto it = dnnIndex.find(targetFile);
+        if (it != dnnIndex.end())
+            tDNN = *it->second;
+
+        if (tDNN.empty() || tFeat.size() != static_cast<size_t>(Type::dim) ||
+            tDNN.size() != static_cast<size_t>(DNN_EMBEDDING_DIM))
         {
-            std::cerr << "Warning: Invalid custom query features. "
-                      << "Custom: " << tFeat.size() << " DNN: " << tDNN.size() << std::endl;
+            std::cerr << "Warning: Invalid " << Type::name << " query features. "
+                      << "Features: " << tFeat.size() << " DNN: " << tDNN.size() << std::endl;
             return results;
         }
+
+        alignDNNRows(db, dnnIndex, dbDNN);
     }
 
-    for (size_t i = 0; i < db.size(); i++)
+    // Rows with the wrong length were left out when packing; rows without
+    // a DNN embedding are skipped by the scan. Only the top matches are
+    // shown (+1: the target itself is skipped), and for custom the bottom 3.
+    size_t keepBest = static_cast<size_t>(NUM_MATCHES + 1);
+    size_t keepWorst = Type::needsDNN ? 4 : 0;
+    selectFeatureMatches<Type>(tFeat, matrix, db, keepBest, keepWorst, results, tDNN, dbDNN);
+    return results;
+}
+
+MatchSelection runQuery(const std::string &targetFile,
+                        const std::string &featureType,
+                        const std::string &imageDir,
+                        const std::vector<FeatureData> &db,
+                        const FeatureMatrix &matrix,
+                        const DNNIndex &dnnIndex,
+                        const cv::Mat &targetImg)
+{
+    MatchSelection results;
+
+    // Validate database is not empty
+    if (db.empty())
+        return results;
+
+    dispatchFeatureType(featureType, [&](auto type)
     {
-        float dist;
-        if (featureType == "custom")
-        {
-            // Verify database entry has correct size
-            if (db[i].feature.size() != 209)
-                continue;
+        results = runTypedQuery<decltype(type)>(targetFile, db, matrix, dnnIndex, targetImg);
+    });
+    return results;
+}
 
-            std::vector<float> dbDNN;
-            for (const auto &d : dnnDb)
-                if (d.filename == db[i].filename)
-                {
-                    dbDNN = d.feature;
-                    break;
-                }
-            if (dbDNN.size() != 512)
-                continue;
+/**
+ * Rank a grid feature database against a region of the target image
+ *
+ * @param targetImg Target image
+ * @param roi Region of the target in image pixels
+ * @param gridDb Grid feature database
+ * @param gridMatrix gridDb packed by packFeatureDatabase<GridType>
+ * @param windows Output: best matching cell window of the top results
+ * @return The top results, sorted by distance (empty on error)
+ */
+MatchSelection runROIQuery(const cv::Mat &targetImg,
+                           const cv::Rect &roi,
+                           const std::vector<FeatureData> &gridDb,
+                           const FeatureMatrix &gridMatrix,
+                           std::map<std::string, GridWindow> &windows)
+{
+    MatchSelection results;
+    std::vector<float> query;
+    windows.clear();
 
-            dist = computeDist(featureType, tFeat, db[i].feature, tDNN, dbDNN);
-        }
-        else
-        {
-            dist = computeDist(featureType, tFeat, db[i].feature);
-        }
-        if (dist >= 0)
+    if (targetImg.empty())
+        return results;
+
+    ExtractionWorkspace ws;
+    if (extractGridROIQuery(targetImg, roi, query, ws) != 0)
+        return results;
+
+    // Only the displayed matches are kept (the target is skipped, hence +1)
+    selectFeatureMatches<GridType>(query, gridMatrix, gridDb, NUM_MATCHES + 1, 0, results);
+
+    for (const MatchResult &match : results.best)
+    {
+        for (const auto &d : gridDb)
         {
-            MatchResult m;
-            m.filename = db[i].filename;
-            m.distance = dist;
-            results.push_back(m);
+            if (d.filename == match.filename)
+            {
+                distanceGridWindow(query, d.feature, GridType::gridSize, GridType::cellBins,
+                                   &windows[d.filename]);
+                break;
+            }
         }
     }
-    std::sort(results.begin(), results.end());
     return results;
 }
 
@@ -254,13 +317,59 @@ struct AppState
     std::string searchText;
     bool searchActive;
     std::vector<std::string> searchResults;
+
+    // Region-of-interest selection on the target thumbnail
+    cv::Rect targetThumbRect;                   // Target thumbnail on the canvas
+    cv::Size targetSize;                        // Target image size
+    bool dragging = false;
+    cv::Point dragStart, dragEnd;               // Canvas coordinates
+    cv::Rect roi;                               // Selected region in image pixels (empty = none)
+    bool roiChanged = false;
+    std::map<std::string, GridWindow> roiWindows;  // Best window of each displayed match
 };
 
 void onMouse(int event, int x, int y, int, void *userdata)
 {
+    AppState *state = (AppState *)userdata;
+    cv::Point pt(x, y);
+
+    // === Drag on the target thumbnail selects a region ===
+    if (state->dragging)
+    {
+        const cv::Rect &t = state->targetThumbRect;
+        state->dragEnd = cv::Point(std::min(std::max(x, t.x), t.x + t.width - 1),
+                                   std::min(std::max(y, t.y), t.y + t.height - 1));
+
+        if (event == cv::EVENT_LBUTTONUP)
+        {
+            state->dragging = false;
+            cv::Rect sel(state->dragStart, state->dragEnd);
+
+            // Ignore tiny drags (a plain click on the target)
+            if (sel.width >= 4 && sel.height >= 4 && state->targetSize.area() > 0)
+            {
+                cv::Rect local(sel.x - t.x, sel.y - t.y, sel.width, sel.height);
+                cv::Rect roi = thumbToImage(local, state->targetSize, t.width, t.height);
+                if (roi.area() > 0)
+                {
+                    state->roi = roi;
+                    state->roiChanged = true;
+                }
+            }
+        }
+        return;
+    }
+
     if (event != cv::EVENT_LBUTTONDOWN)
         return;
-    AppState *state = (AppState *)userdata;
+
+    if (state->targetThumbRect.contains(pt))
+    {
+        state->dragging = true;
+        state->dragStart = state->dragEnd = pt;
+        return;
+    }
+
     for (auto &r : state->regions)
     {
         if (r.rect.contains(cv::Point(x, y)))
@@ -284,7 +393,7 @@ void onTrackbar(int pos, void *userdata)
 
 cv::Mat buildDisplay(const std::string &targetFile,
                      const std::string &featureType,
-                     const std::vector<MatchResult> &results,
+                     const MatchSelection &selection,
                      const std::string &imageDir,
                      const std::vector<std::string> &allImages,
                      int browserPage,
@@ -319,6 +428,12 @@ cv::Mat buildDisplay(const std::string &targetFile,
                 cv::FONT_HERSHEY_SIMPLEX, 0.55, HEADER, 1);
 
     std::string info = "Feature: " + featureType + " | Target: " + targetFile;
+    if (state.roi.area() > 0)
+    {
+        info = "Feature: " + std::string(GridType::name) + " | Target: " + targetFile +
+               " | ROI " + std::to_string(state.roi.x) + "," + std::to_string(state.roi.y) + " " +
+               std::to_string(state.roi.width) + "x" + std::to_string(state.roi.height) + " (r: clear)";
+    }
     cv::putText(canvas, info, cv::Point(PAD, 38),
                 cv::FONT_HERSHEY_SIMPLEX, 0.4, GRAY, 1);
 
@@ -331,6 +446,12 @@ cv::Mat buildDisplay(const std::string &targetFile,
     cv::Mat tImg = cv::imread(tPath);
     cv::Mat tThumb = makeThumbnail(tImg, THUMB_W, THUMB_H);
     drawBorder(tThumb, TARGET_BORDER, 3);
+    state.targetThumbRect = cv::Rect(PAD, tY, THUMB_W, THUMB_H);
+    state.targetSize = tImg.size();
+    if (state.roi.area() > 0 && !tImg.empty())
+    {
+        cv::rectangle(tThumb, imageToThumb(state.roi, tImg.size(), THUMB_W, THUMB_H), HEADER, 2);
+    }
     tThumb.copyTo(canvas(cv::Rect(PAD, tY, THUMB_W, THUMB_H)));
 
     cv::putText(canvas, "TARGET", cv::Point(PAD + THUMB_W / 2 - 25, tY + THUMB_H + 15),
@@ -350,6 +471,7 @@ cv::Mat buildDisplay(const std::string &targetFile,
     int mStartX = leftW;
     int mStartY = topH + PAD;
     int displayed = 0;
+    const std::vector<MatchResult> &results = selection.best;
 
     for (size_t i = 0; i < results.size() && displayed < NUM_MATCHES; i++)
     {
@@ -369,6 +491,14 @@ cv::Mat buildDisplay(const std::string &targetFile,
         cv::Mat mImg = cv::imread(mPath);
         cv::Mat mThumb = makeThumbnail(mImg, THUMB_W, THUMB_H);
         drawBorder(mThumb, MATCH_BORDER, 2);
+
+        // For ROI queries, outline where the region was found
+        auto window = state.roiWindows.find(results[i].filename);
+        if (state.roi.area() > 0 && window != state.roiWindows.end() && !mImg.empty())
+        {
+            cv::Rect found = gridWindowRect(window->second, mImg.size());
+            cv::rectangle(mThumb, imageToThumb(found, mImg.size(), THUMB_W, THUMB_H), HEADER, 2);
+        }
         mThumb.copyTo(canvas(cv::Rect(x, y, THUMB_W, THUMB_H)));
 
         // Rank + filename
@@ -395,7 +525,7 @@ cv::Mat buildDisplay(const std::string &targetFile,
     // === Bottom matches (least similar) for custom ===
     int bottomEndY = topH + matchAreaH;
 
-    if (featureType == "custom" && results.size() > 6)
+    if (featureType == "custom" && selection.ranked > 6)
     {
         int bmY = topH + matchAreaH;
         cv::line(canvas, cv::Point(PAD, bmY), cv::Point(canvasW - PAD, bmY), DIVIDER, 1);
@@ -407,9 +537,10 @@ cv::Mat buildDisplay(const std::string &targetFile,
         int bmImgY = bmY + 22;
         int bmCount = 0;
 
-        for (int i = (int)results.size() - 1; i >= 0 && bmCount < 3; i--)
+        const std::vector<MatchResult> &farthest = selection.worst;
+        for (int i = (int)farthest.size() - 1; i >= 0 && bmCount < 3; i--)
         {
-            if (results[i].filename == targetFile)
+            if (farthest[i].filename == targetFile)
                 continue;
 
             int bx = PAD + bmCount * (THUMB_W + PAD);
@@ -417,7 +548,7 @@ cv::Mat buildDisplay(const std::string &targetFile,
             std::string bmPath = imageDir;
             if (bmPath.back() != '/')
                 bmPath += '/';
-            bmPath += results[i].filename;
+            bmPath += farthest[i].filename;
 
             cv::Mat bmImg = cv::imread(bmPath);
             cv::Mat bmThumb = makeThumbnail(bmImg, THUMB_W, THUMB_H);
@@ -426,12 +557,12 @@ cv::Mat buildDisplay(const std::string &targetFile,
 
             char bmLabel[64];
             snprintf(bmLabel, sizeof(bmLabel), "#%d %s",
-                     (int)results.size() - bmCount, results[i].filename.c_str());
+                     (int)selection.ranked - bmCount, farthest[i].filename.c_str());
             cv::putText(canvas, bmLabel, cv::Point(bx, bmImgY + THUMB_H + 12),
                         cv::FONT_HERSHEY_SIMPLEX, 0.28, WHITE, 1);
 
             char bmDist[32];
-            snprintf(bmDist, sizeof(bmDist), "d=%.4f", results[i].distance);
+            snprintf(bmDist, sizeof(bmDist), "d=%.4f", farthest[i].distance);
             cv::putText(canvas, bmDist, cv::Point(bx, bmImgY + THUMB_H + 24),
                         cv::FONT_HERSHEY_SIMPLEX, 0.26, GRAY, 1);
 
@@ -540,8 +671,8 @@ cv::Mat buildDisplay(const std::string &targetFile,
 
     char statusStr[128];
     snprintf(statusStr, sizeof(statusStr),
-             "Page %d/%d | Images: %d | Click image to query | 1-6: feature | s: search | n/p: page | q: quit",
-             browserPage + 1, (int)(allImages.size() / BROWSER_COLS + 1), (int)allImages.size());
+             "Page %d/%d | Images: %d | Click image to query | 1-%d: feature | s: search | n/p: page | q: quit",
+             browserPage + 1, (int)(allImages.size() / BROWSER_COLS + 1), (int)allImages.size(), NUM_FEATURE_TYPES);
     cv::putText(canvas, statusStr, cv::Point(PAD, sY + 18),
                 cv::FONT_HERSHEY_SIMPLEX, 0.32, GRAY, 1);
 
@@ -565,6 +696,7 @@ int main(int argc, char *argv[])
         std::cerr << "  ./extract_features data/olympus/ data/multihistogram_features.csv multihistogram" << std::endl;
         std::cerr << "  ./extract_features data/olympus/ data/texture_features.csv texture" << std::endl;
         std::cerr << "  ./extract_features data/olympus/ data/custom_features.csv custom" << std::endl;
+        std::cerr << "  ./extract_features data/olympus/ data/grid_features.csv grid   (region search)" << std::endl;
         return -1;
     }
  
@@ -577,26 +709,29 @@ int main(int argc, char *argv[])
 
     // === Load all feature databases ===
     std::map<std::string, std::vector<FeatureData>> databases;
+    std::map<std::string, FeatureMatrix> matrices;  // databases packed once for scanning
 
     for (size_t i = 0; i < FEATURE_NAMES.size(); i++)
     {
         std::string name = FEATURE_NAMES[i];
         std::string csv = CSV_FILES[i];
 
-        if (name == "dnn")
+        // Types without a default CSV (dnn) use the one given on the command line
+        if (csv.empty())
         {
             csv = dnnCSV;
         }
 
-        if (csv.empty())
-            continue;
-
         std::cout << "Loading " << name << " features from " << csv << "..." << std::endl;
         std::vector<FeatureData> db;
         if (readFeaturesFromCSV(csv, db) == 0 && !db.empty())
         {
             databases[name] = db;
             std::cout << "  Loaded " << db.size() << " vectors (" << db[0].feature.size() << "D)" << std::endl;
+            dispatchFeatureType(name, [&](auto type)
+            {
+                packFeatureDatabase<decltype(type)>(databases[name], matrices[name]);
+            });
         }
         else
         {
@@ -605,10 +740,12 @@ int main(int argc, char *argv[])
         }
     }
 
-    // Load DNN database separately for custom features
+    // Load DNN database separately for custom features, indexed by filename
     std::vector<FeatureData> dnnDb;
+    DNNIndex dnnIndex;
     if (readFeaturesFromCSV(dnnCSV, dnnDb) == 0)
     {
+        buildDNNIndex(dnnDb, dnnIndex);
         std::cout << "DNN database loaded for custom features (" << dnnDb.size() << " vectors)" << std::endl;
     }
 
@@ -642,13 +779,14 @@ int main(int argc, char *argv[])
     cv::setMouseCallback(winName, onMouse, &state);
 
     // Trackbar for feature type
-    cv::createTrackbar("Feature", winName, NULL, 5, onTrackbar, &state);
+    cv::createTrackbar("Feature", winName, NULL, NUM_FEATURE_TYPES - 1, onTrackbar, &state);
     cv::setTrackbarPos("Feature", winName, 0);
 
     std::cout << "\n========================================" << std::endl;
     std::cout << "GUI Ready! Controls:" << std::endl;
     std::cout << "  Click any image to query it" << std::endl;
-    std::cout << "  Trackbar or 1-6: switch feature type" << std::endl;
+    std::cout << "  Trackbar or 1-" << NUM_FEATURE_TYPES << ": switch feature type" << std::endl;
+    std::cout << "  Drag on the target: search for that region (grid features), r: clear" << std::endl;
     std::cout << "  s: search by filename" << std::endl;
     std::cout << "  n/p: next/prev browser page" << std::endl;
     std::cout << "  q/ESC: quit" << std::endl;
@@ -656,6 +794,7 @@ int main(int argc, char *argv[])
               << std::endl;
 
     int lastFeatureIdx = -1;
+    cv::Mat display;
 
     while (true)
     {
@@ -664,6 +803,14 @@ int main(int argc, char *argv[])
         {
             currentFeature = FEATURE_NAMES[state.featureIdx];
             lastFeatureIdx = state.featureIdx;
+            state.roi = cv::Rect();
+            needsUpdate = true;
+        }
+
+        // New region selected on the target
+        if (state.roiChanged)
+        {
+            state.roiChanged = false;
             needsUpdate = true;
         }
 
@@ -698,24 +845,56 @@ int main(int argc, char *argv[])
             tPath += currentTarget;
             cv::Mat tImg = cv::imread(tPath);
 
-            // Run query
-            auto results = runQuery(currentTarget, currentFeature, imageDir,
-                                    databases[currentFeature], dnnDb, tImg);
+            // Run query: a selected region searches the grid features
+            MatchSelection results;
+            if (state.roi.area() > 0)
+            {
+                auto grid = databases.find(GridType::name);
+                if (grid != databases.end())
+                {
+                    std::cout << "  Region " << state.roi.x << "," << state.roi.y << " "
+                              << state.roi.width << "x" << state.roi.height << std::endl;
+                    results = runROIQuery(tImg, state.roi, grid->second,
+                                          matrices[GridType::name], state.roiWindows);
+                }
+                else
+                {
+                    std::cerr << "Warning: Region search needs data/" << GridType::defaultCSV
+                              << " (./extract_features data/olympus/ data/" << GridType::defaultCSV
+                              << " " << GridType::name << ")" << std::endl;
+                    state.roi = cv::Rect();
+                }
+            }
+            if (state.roi.area() <= 0)
+            {
+                results = runQuery(currentTarget, currentFeature, imageDir,
+                                   databases[currentFeature], matrices[currentFeature],
+                                   dnnIndex, tImg);
+            }
 
             // Build and show display
-            cv::Mat display = buildDisplay(currentTarget, currentFeature, results,
-                                           imageDir, allImages, browserPage, state);
+            display = buildDisplay(currentTarget, currentFeature, results,
+                                   imageDir, allImages, browserPage, state);
             cv::imshow(winName, display);
             needsUpdate = false;
         }
 
         int key = cv::waitKey(50);
 
+        // Rubber band while a region is being dragged on the target
+        if (state.dragging && !display.empty())
+        {
+            cv::Mat band = display.clone();
+            cv::rectangle(band, state.dragStart, state.dragEnd, HEADER, 1);
+            cv::imshow(winName, band);
+        }
+
         // Mouse click
         if (state.clicked)
         {
             currentTarget = state.clickedFile;
             state.clicked = false;
+            state.roi = cv::Rect();
             state.searchActive = false;
             state.searchText.clear();
             state.searchResults.clear();
@@ -739,6 +918,7 @@ int main(int argc, char *argv[])
                 if (!state.searchResults.empty())
                 {
                     currentTarget = state.searchResults[0];
+                    state.roi = cv::Rect();
                     state.searchActive = false;
                     state.searchText.clear();
                     state.searchResults.clear();
@@ -794,6 +974,11 @@ int main(int argc, char *argv[])
                 state.searchResults.clear();
                 needsUpdate = true;
             }
+            else if (key == 'r' && state.roi.area() > 0)
+            {
+                state.roi = cv::Rect();
+                needsUpdate = true;
+            }
             else if (key == 'n')
             {
                 browserPage = (browserPage + 1) % maxPages;
@@ -804,7 +989,7 @@ int main(int argc, char *argv[])
                 browserPage = (browserPage - 1 + maxPages) % maxPages;
                 needsUpdate = true;
             }
-            else if (key >= '1' && key <= '6')
+            else if (key >= '1' && key < '1' + NUM_FEATURE_TYPES)
             {
                 state.featureIdx = key - '1';
                 cv::setTrackbarPos("Feature", winName, state.featureIdx);
@@ -0,0 +1,393 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: jpeg_fast.cpp
+ *
+ * Purpose:
+ * Implementation of the partial JPEG decode paths (see jpeg_fast.h).
+ */
+
+#include "jpeg_fast.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef CBIR_HAVE_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+// ========================================
+// EXIF
+// ========================================
+
+// TIFF tags we read
+static const uint16_t EXIF_TAG_ORIENTATION = 0x0112;
+static const uint16_t EXIF_TAG_THUMBNAIL_OFFSET = 0x0201;
+static const uint16_t EXIF_TAG_THUMBNAIL_LENGTH = 0x0202;
+
+// JPEG markers
+static const uint8_t JPEG_MARKER_SOI = 0xD8;
+static const uint8_t JPEG_MARKER_EOI = 0xD9;
+static const uint8_t JPEG_MARKER_SOS = 0xDA;
+static const uint8_t JPEG_MARKER_APP1 = 0xE1;
+
+/**
+ * Byte-order aware reads from a TIFF block
+ */
+struct TiffReader
+{
+    const uint8_t *base;
+    size_t size;
+    bool bigEndian;
+
+    bool has(size_t offset, size_t length) const
+    {
+        return offset <= size && length <= size - offset;
+    }
+
+    uint32_t u16(size_t offset) const
+    {
+        const uint8_t *p = base + offset;
+        return bigEndian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+    }
+
+    uint32_t u32(size_t offset) const
+    {
+        return bigEndian ? (u16(offset) << 16) | u16(offset + 2)
+                         : u16(offset) | (u16(offset + 2) << 16);
+    }
+};
+
+/**
+ * Parse an EXIF APP1 segment
+ */
+int parseExif(const uint8_t *data, size_t size, ExifInfo &info)
+{
+    // === Step 1: "Exif\0\0" followed by a TIFF header ===
+
+    if (size < 6 + 8 || std::memcmp(data, "Exif\0\0", 6) != 0)
+        return -1;
+
+    TiffReader tiff{data + 6, size - 6, false};
+
+    if (tiff.base[0] == 'M' && tiff.base[1] == 'M')
+        tiff.bigEndian = true;
+    else if (!(tiff.base[0] == 'I' && tiff.base[1] == 'I'))
+        return -1;
+
+    if (tiff.u16(2) != 42)
+        return -1;
+
+    // === Step 2: Walk IFD0 (main image), then IFD1 (thumbnail) ===
+
+    size_t ifd = tiff.u32(4);
+    size_t thumbOffset = 0;
+    size_t thumbLength = 0;
+
+    for (int level = 0; level < 2; level++)
+    {
+        if (!tiff.has(ifd, 2))
+            return level == 0 ? -1 : 0;
+
+        size_t numEntries = tiff.u16(ifd);
+        if (!tiff.has(ifd + 2, numEntries * 12 + 4))
+            return level == 0 ? -1 : 0;
+
+        for (size_t e = 0; e < numEntries; e++)
+        {
+            size_t entry = ifd + 2 + e * 12;
+            uint32_t tag = tiff.u16(entry);
+
+            if (level == 0 && tag == EXIF_TAG_ORIENTATION)
+            {
+                // SHORT value, stored in the first two bytes of the value field
+                info.orientation = static_cast<int>(tiff.u16(entry + 8));
+            }
+            else if (level == 1 && tag == EXIF_TAG_THUMBNAIL_OFFSET)
+            {
+                thumbOffset = tiff.u32(entry + 8);
+            }
+            else if (level == 1 && tag == EXIF_TAG_THUMBNAIL_LENGTH)
+            {
+                thumbLength = tiff.u32(entry + 8);
+            }
+        }
+
+        // Offset of the next IFD follows the entries; 0 ends the chain
+        ifd = tiff.u32(ifd + 2 + numEntries * 12);
+        if (ifd == 0)
+            break;
+    }
+
+    // === Step 3: Thumbnail range, relative to the APP1 payload ===
+
+    if (thumbLength > 0 && thumbOffset > 0 && tiff.has(thumbOffset, thumbLength))
+    {
+        info.thumbnailOffset = 6 + thumbOffset;
+        info.thumbnailLength = thumbLength;
+    }
+
+    return 0;
+}
+
+/**
+ * Rotate/flip an image the way imread applies an EXIF orientation
+ */
+void applyExifOrientation(cv::Mat &image, int orientation)
+{
+    switch (orientation)
+    {
+    case 2:
+        cv::flip(image, image, 1);
+        break;
+    case 3:
+        cv::rotate(image, image, cv::ROTATE_180);
+        break;
+    case 4:
+        cv::flip(image, image, 0);
+        break;
+    case 5:
+        cv::transpose(image, image);
+        break;
+    case 6:
+        cv::rotate(image, image, cv::ROTATE_90_CLOCKWISE);
+        break;
+    case 7:
+        cv::rotate(image, image, cv::ROTATE_180);
+        cv::transpose(image, image);
+        break;
+    case 8:
+        cv::rotate(image, image, cv::ROTATE_90_COUNTERCLOCKWISE);
+        break;
+    default:
+        break;
+    }
+}
+
+// ========================================
+// EXIF thumbnail
+// ========================================
+
+/**
+ * Decode the EXIF thumbnail embedded in a JPEG file
+ */
+int readExifThumbnail(const std::string &path, cv::Mat &thumbnail)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return -1;
+
+    // === Step 1: Walk the marker segments up to the image data ===
+
+    uint8_t header[4];
+    if (!file.read(reinterpret_cast<char *>(header), 2) || header[0] != 0xFF || header[1] != JPEG_MARKER_SOI)
+        return -1;
+
+    std::vector<uint8_t> app1;
+    while (file.read(reinterpret_cast<char *>(header), 4))
+    {
+        if (header[0] != 0xFF)
+            return -1;
+
+        uint8_t marker = header[1];
+        if (marker == JPEG_MARKER_SOS || marker == JPEG_MARKER_EOI)
+            break;
+
+        // Segment length includes its own two bytes
+        size_t length = (static_cast<size_t>(header[2]) << 8) | header[3];
+        if (length < 2)
+            return -1;
+
+        if (marker != JPEG_MARKER_APP1)
+        {
+            file.seekg(static_cast<std::streamoff>(length - 2), std::ios::cur);
+            continue;
+        }
+
+        app1.resize(length - 2);
+        if (!file.read(reinterpret_cast<char *>(app1.data()), app1.size()))
+            return -1;
+
+        // APP1 is also used for XMP; keep looking if this is not EXIF
+        if (app1.size() >= 6 && std::memcmp(app1.data(), "Exif\0\0", 6) == 0)
+            break;
+        app1.clear();
+    }
+
+    // === Step 2: Locate and decode the thumbnail ===
+
+    ExifInfo exif;
+    if (app1.empty() || parseExif(app1.data(), app1.size(), exif) != 0 || exif.thumbnailLength == 0)
+        return -1;
+
+    cv::Mat encoded(1, static_cast<int>(exif.thumbnailLength), CV_8U, app1.data() + exif.thumbnailOffset);
+    thumbnail = cv::imdecode(encoded, cv::IMREAD_COLOR);
+
+    if (thumbnail.empty() || std::min(thumbnail.cols, thumbnail.rows) < EXIF_THUMB_MIN_SIDE)
+        return -1;
+
+    // === Step 3: Upright, like the full image from imread ===
+
+    applyExifOrientation(thumbnail, exif.orientation);
+    return 0;
+}
+
+// ========================================
+// Baseline ROI decode
+// ========================================
+
+#ifdef CBIR_HAVE_LIBJPEG
+
+/**
+ * libjpeg error handler that returns to extractBaselineFromJPEG instead of
+ * calling exit(); warnings are not printed (the caller falls back)
+ */
+struct JpegErrorManager
+{
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void onJpegError(j_common_ptr cinfo)
+{
+    longjmp(reinterpret_cast<JpegErrorManager *>(cinfo->err)->jump, 1);
+}
+
+static void onJpegMessage(j_common_ptr)
+{
+}
+
+bool haveROIDecode()
+{
+    return true;
+}
+
+/**
+ * Extract the baseline feature decoding only the centre of a JPEG
+ */
+int extractBaselineFromJPEG(const std::string &path, std::vector<float> &feature)
+{
+    // Everything with a destructor lives above setjmp, so a longjmp from
+    // libjpeg never skips one
+    std::vector<JSAMPLE> rowBuffer;
+    feature.assign(147, 0.0f);
+
+    FILE *fp = std::fopen(path.c_str(), "rb");
+    if (fp == nullptr)
+        return -1;
+
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager err;
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = onJpegError;
+    err.pub.output_message = onJpegMessage;
+
+    if (setjmp(err.jump))
+    {
+        // Not a JPEG, corrupt data, or a feature libjpeg cannot crop
+        jpeg_destroy_decompress(&cinfo);
+        std::fclose(fp);
+        feature.clear();
+        return -1;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, fp);
+    jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_read_header(&cinfo, TRUE);
+
+    // === Step 1: Only files imread would hand over untouched ===
+
+    bool usable = cinfo.num_components == 3 && cinfo.jpeg_color_space == JCS_YCbCr &&
+                  cinfo.image_width >= 7 && cinfo.image_height >= 7;
+
+    for (jpeg_saved_marker_ptr m = cinfo.marker_list; usable && m != nullptr; m = m->next)
+    {
+        ExifInfo exif;
+        if (m->marker == JPEG_APP0 + 1 && parseExif(m->data, m->data_length, exif) == 0)
+        {
+            // imread applies the orientation, which moves the centre patch
+            usable = exif.orientation == 1;
+        }
+    }
+
+    if (!usable)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        std::fclose(fp);
+        feature.clear();
+        return -1;
+    }
+
+    // === Step 2: Same patch as extractBaselineFeature ===
+
+    int startRow = static_cast<int>(cinfo.image_height) / 2 - 3;
+    int startCol = static_cast<int>(cinfo.image_width) / 2 - 3;
+
+    // Same output as imread: BGR, default (islow) IDCT and fancy upsampling
+    cinfo.out_color_space = JCS_EXT_BGR;
+    jpeg_start_decompress(&cinfo);
+
+    // === Step 3: Crop columns and skip rows, one iMCU of margin each side ===
+
+    int mcuWidth = cinfo.max_h_samp_factor * DCTSIZE;
+    int mcuHeight = cinfo.max_v_samp_factor * DCTSIZE;
+
+    JDIMENSION cropStart = static_cast<JDIMENSION>(std::max(0, startCol - mcuWidth));
+    JDIMENSION cropEnd = std::min(cinfo.output_width, static_cast<JDIMENSION>(startCol + 7 + mcuWidth));
+    JDIMENSION cropWidth = cropEnd - cropStart;
+
+    // Rounds cropStart down and cropWidth up to iMCU boundaries
+    jpeg_crop_scanline(&cinfo, &cropStart, &cropWidth);
+
+    JDIMENSION skipRows = static_cast<JDIMENSION>(std::max(0, startRow - mcuHeight));
+    jpeg_skip_scanlines(&cinfo, skipRows);
+
+    // === Step 4: Read down to the last patch row ===
+
+    rowBuffer.resize(static_cast<size_t>(cropWidth) * 3);
+    JSAMPROW row = rowBuffer.data();
+    int patchCol = startCol - static_cast<int>(cropStart);
+
+    while (static_cast<int>(cinfo.output_scanline) < startRow + 7)
+    {
+        int y = static_cast<int>(cinfo.output_scanline);
+        jpeg_read_scanlines(&cinfo, &row, 1);
+
+        if (y < startRow)
+            continue;
+
+        const JSAMPLE *pixel = row + patchCol * 3;
+        float *out = feature.data() + (y - startRow) * 7 * 3;
+        for (int i = 0; i < 7 * 3; i++)
+        {
+            out[i] = static_cast<float>(pixel[i]);
+        }
+    }
+
+    // The rest of the image is never decoded
+    jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    std::fclose(fp);
+    return 0;
+}
+
+#else
+
+bool haveROIDecode()
+{
+    return false;
+}
+
+/**
+ * Built without libjpeg: always fall back to a full decode
+ */
+int extractBaselineFromJPEG(const std::string &, std::vector<float> &feature)
+{
+    feature.clear();
+    return -1;
+}
+
+#endif // CBIR_HAVE_LIBJPEG
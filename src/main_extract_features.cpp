@@ -8,32 +8,494 @@
  * This is run ONCE to build the feature database, then can be reused for many queries.
  *
  * Usage:
- *   ./extract_features <image_directory> <output_csv> <feature_type>
+ *   ./extract_features <image_directory|video_file|thumbnail_cache> <output_csv|output_dir> <feature_type[,feature_type...]> [options]
+ *
+ * Options:
+ *   --video-stride N       Sample every Nth video frame (default: 30)
+ *   --scene-threshold T    Keep a sampled frame only when the scene changed by
+ *                          more than T (histogram intersection distance, 0 = off)
+ *   --model PATH           ResNet18 ONNX model, required for the dnn type
+ *   --batch N              Images per DNN forward pass (default: 16)
+ *   --checkpoint N         Rows between checkpoints of each CSV (default: 500)
+ *   --resume               Continue an interrupted run, skipping committed images
+ *   --workers N            Image decode/extraction threads (default: all cores)
+ *   --thumb-cache PATH     Also write a 128 px thumbnail of every image to PATH
+ *   --from-cache           The input is a thumbnail cache, not a directory
+ *   --compare-with CSV     With --from-cache or --exif-thumb: compare against this full-resolution
+ *                          CSV of the same type and report ranking agreement
+ *   --no-roi-decode        Always decode whole images, even for baseline alone
+ *   --exif-thumb           Extract from each JPEG's embedded EXIF thumbnail
+ *                          (coarse colour types only), full decode as fallback
  *
  * Example:
  *   ./extract_features data/olympus/ data/baseline_features.csv baseline
  *   ./extract_features data/olympus/ data/histogram_features.csv histogram
+ *   ./extract_features data/archive/harbor.mp4 data/harbor_histogram.csv histogram --video-stride 15
+ *   ./extract_features data/olympus/ data/dnn_features.csv dnn --model data/resnet18-v2-7.onnx
+ *   ./extract_features data/olympus/ data/ custom,dnn --model data/resnet18-v2-7.onnx
+ *
+ * Several feature types:
+ *   A comma-separated list extracts every type from a single decode of each
+ *   image. The output argument is then a directory and each type is written
+ *   to <output_dir>/<type>_features.csv (e.g. data/custom_features.csv and
+ *   data/dnn_features.csv, the pair the custom query needs).
+ *
+ * Thumbnail cache:
+ *   --thumb-cache stores a small uncompressed copy of every decoded image
+ *   (thumb_cache.h). Later, --from-cache recomputes features from it without
+ *   decoding a single JPEG. Only types marked thumbnailSafe in the registry
+ *   are allowed, since others (baseline, texture) change with scale; any
+ *   type can be measured with --compare-with, which ranks the collection
+ *   with both CSVs and reports how often the top 10 agree.
+ *
+ * EXIF thumbnails:
+ *   --exif-thumb is a cheap first-pass ingest tier: features come from the
+ *   ~160x120 thumbnail cameras embed in the EXIF block (jpeg_fast.h), so
+ *   only a few KB of each file are read and decoded. Images without one
+ *   are fully decoded. Only types marked exifThumbnailSafe are allowed;
+ *   --compare-with measures any type as for the thumbnail cache.
+ *
+ * Baseline ROI decode:
+ *   The baseline feature only reads the 7x7 centre patch. When it is the
+ *   only requested type and the build has libjpeg-turbo, each JPEG is
+ *   decoded just around its centre (jpeg_fast.h) with identical output;
+ *   files that path cannot take (EXIF-rotated, grayscale, not JPEG) fall
+ *   back to imread.
  *
  * What it does:
- *   1. Read all image filenames from directory
- *   2. For each image:
- *      - Load the image
- *      - Extract features based on feature type
- *      - Store in memory
- *   3. Write all features to CSV file
+ *   1. Read all image (and video) filenames from directory
+ *   2. For each image, on a pool of worker threads:
+ *      - Load the image once
+ *      - Extract every requested feature type from it (the dnn type is
+ *        resized to 224x224 and batched through the network)
+ *      - Hand the rows to a fixed-size reorder buffer, which writes them
+ *        in input order, so memory stays flat for any collection size
+ *   3. For each video, decode on a separate thread and extract features
+ *      from the sampled frames (rows keyed as file#frame)
+ *   4. Rows are appended to each type's CSV as they are produced and
+ *      checkpointed every N rows in <csv>.progress (see FeatureCSVWriter)
+ *
+ * Resuming:
+ *   A run killed part way (crash, preemption) keeps every row up to its
+ *   last checkpoint. Rerunning the same command with --resume truncates
+ *   each CSV back to that checkpoint and skips images already in it.
  *
  * Output CSV format:
  *   pic.0001.jpg,120.5,130.2,125.8,...,118.3
  *   pic.0002.jpg,115.1,128.9,130.5,...,122.7
+ *   harbor.mp4#0,0.012,0.045,...,0.003
+ *   harbor.mp4#30,0.011,0.046,...,0.004
  *   ...
  */
 
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include "embedding.h"
+#include "feature_registry.h"
 #include "features.h"
+#include "jpeg_fast.h"
+#include "pipeline.h"
+#include "thumb_cache.h"
 #include "utils.h"
+#include "video.h"
+
+// Ranking agreement a type needs to be marked thumbnailSafe / exifThumbnailSafe
+const float CACHE_AGREEMENT_THRESHOLD = 0.8f;
+
+// Matches compared per query, and at most this many queries, in the report
+const int CACHE_REPORT_TOP_K = 10;
+const int CACHE_REPORT_MAX_QUERIES = 200;
+
+// Full DNN batches that may wait for the inference thread before the
+// writer side blocks
+const size_t DNN_QUEUED_BATCHES = 2;
+
+/**
+ * Rows collected for one requested feature type
+ */
+struct TypeOutput
+{
+    std::string type;               // e.g. "histogram"
+    std::string csvPath;            // where the rows are written
+    FeatureExtractFn extract = nullptr;  // from the registry; nullptr for dnn
+    FeatureCSVWriter writer;
+    std::unordered_set<std::string> committed;  // keys written by an earlier run
+    int extracted = 0;
+    int failed = 0;
+    size_t dim = 0;
+};
+
+/**
+ * One full batch of DNN inputs, handed to the inference thread
+ */
+struct DnnJob
+{
+    std::vector<std::string> keys;
+    std::vector<cv::Mat> images;    // already resized to 224x224
+};
+
+/**
+ * DNN inputs waiting for the next batched forward pass
+ *
+ * The writer side only collects keys and inputs here; full batches go
+ * through `jobs` to a single inference thread, which runs the network and
+ * appends the rows in the order the batches were queued.
+ */
+struct DnnBatch
+{
+    cv::dnn::Net net;               // only used by the inference thread
+    int batchSize = 16;
+    std::vector<std::string> keys;  // pending batch
+    std::vector<cv::Mat> images;
+    BoundedQueue<DnnJob> jobs{DNN_QUEUED_BATCHES};
+    std::atomic<bool> failed{false};    // set by the inference thread on write error
+};
+
+/**
+ * Per-type outcome for one image in an ImageResult
+ */
+enum RowStatus : char
+{
+    ROW_COMMITTED,  // already in the CSV from an earlier run
+    ROW_OK,         // feature (or DNN input) ready
+    ROW_FAILED      // extractor returned an error
+};
+
+/**
+ * Everything extracted from one decoded image, waiting to be written
+ *
+ * Workers fill these in parallel and move them into the reorder buffer;
+ * the writer side then moves the DNN input into the batch and writes the
+ * feature vectors straight from here, so no row is copied on the way.
+ */
+struct ImageResult
+{
+    std::string key;                            // filename, or file#frame for video
+    bool loaded = false;                        // false if imread failed
+    bool committed = false;                     // every type has it from an earlier run
+    bool fromExif = false;                      // decoded from the EXIF thumbnail (--exif-thumb)
+    std::vector<RowStatus> status;              // one per requested type
+    std::vector<std::vector<float>> features;   // one per requested type
+    cv::Mat dnnInput;                           // 224x224 copy for the dnn type
+    cv::Mat thumbnail;                          // for the thumbnail cache, if requested
+};
+
+/**
+ * Append one row to a type's CSV
+ * @return 0 on success, -1 on write error
+ */
+static int emitRow(TypeOutput &output, const std::string &key, const std::vector<float> &feature)
+{
+    output.extracted++;
+    output.dim = feature.size();
+    return output.writer.write(key, feature);
+}
+
+/**
+ * Run one batch of DNN inputs through the network and append their rows
+ *
+ * @param job Keys and 224x224 images of the batch
+ * @param net Loaded ResNet18 network
+ * @param output Rows of the dnn type
+ * @return 0 on success (a failed forward pass only counts as failures),
+ *         -1 on write error
+ */
+static int runDnnJob(const DnnJob &job, cv::dnn::Net &net, TypeOutput &output)
+{
+    if (job.images.empty())
+        return 0;
+
+    cv::Mat embeddings;
+    int status = 0;
+
+    if (getEmbeddingsBatch(job.images, embeddings, net) != 0)
+    {
+        std::cerr << "\nWarning: DNN batch of " << job.images.size() << " images failed" << std::endl;
+        output.failed += static_cast<int>(job.images.size());
+    }
+    else
+    {
+        // Convert each row of the N x 512 output to vector<float>
+        int dim = static_cast<int>(embeddings.total() / job.images.size());
+        const float *rows = embeddings.ptr<float>(0);
+        std::vector<float> feature;
+
+        for (size_t b = 0; b < job.keys.size(); b++)
+        {
+            feature.assign(rows + b * dim, rows + (b + 1) * dim);
+            if (emitRow(output, job.keys[b], feature) != 0)
+                status = -1;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Hand the pending DNN inputs to the inference thread
+ *
+ * Only moves the keys and images out, so the caller (which may hold the
+ * reorder buffer's lock) never waits on a forward pass; it waits only if
+ * DNN_QUEUED_BATCHES batches are already queued.
+ *
+ * @param batch Pending inputs (emptied on return)
+ * @return 0 on success, -1 if the inference thread hit a write error
+ */
+static int submitDnnBatch(DnnBatch &batch)
+{
+    if (batch.failed)
+        return -1;
+
+    if (batch.images.empty())
+        return 0;
+
+    DnnJob job;
+    job.keys = std::move(batch.keys);
+    job.images = std::move(batch.images);
+    batch.keys.clear();
+    batch.images.clear();
+
+    return batch.jobs.push(std::move(job)) ? 0 : -1;
+}
+
+/**
+ * Extract every requested feature type from one decoded image
+ *
+ * @param image Decoded image (BGR)
+ * @param outputs Requested types (only read, so workers may share it)
+ * @param result Output; result.key must already be set
+ * @param ws This thread's workspace
+ *
+ * The classic types are extracted straight into result.features; the dnn
+ * type only keeps a 224x224 copy, which is batched on the writer side.
+ * Types that already have this key from an earlier run are skipped.
+ */
+static void extractImageResult(const cv::Mat &image,
+                               const std::vector<TypeOutput> &outputs,
+                               ImageResult &result,
+                               ExtractionWorkspace &ws)
+{
+    result.loaded = true;
+    result.status.assign(outputs.size(), ROW_COMMITTED);
+    result.features.resize(outputs.size());
+
+    for (size_t t = 0; t < outputs.size(); t++)
+    {
+        if (outputs[t].committed.count(result.key))
+            continue;
+
+        if (outputs[t].extract == nullptr)
+        {
+            resizeForEmbedding(image, result.dnnInput);
+            result.status[t] = ROW_OK;
+            continue;
+        }
+
+        bool ok = outputs[t].extract(image, result.features[t], ws) == 0;
+        result.status[t] = ok ? ROW_OK : ROW_FAILED;
+    }
+}
+
+/**
+ * Write one image's rows to every type's CSV (called in input order)
+ *
+ * @param result Extracted rows; the DNN input is moved out
+ * @param outputs One entry per requested type
+ * @param dnn Pending DNN batch, queued for inference once it is full
+ * @return 0 on success (extraction failures are only counted), -1 on write error
+ */
+static int emitImageResult(ImageResult &result,
+                           std::vector<TypeOutput> &outputs,
+                           DnnBatch &dnn)
+{
+    for (size_t t = 0; t < outputs.size(); t++)
+    {
+        TypeOutput &output = outputs[t];
+
+        if (result.status[t] == ROW_FAILED)
+        {
+            std::cerr << "\nWarning: Failed to extract " << output.type << " features from: " << result.key << std::endl;
+            output.failed++;
+            continue;
+        }
+
+        if (result.status[t] != ROW_OK)
+            continue;
+
+        if (output.extract == nullptr)
+        {
+            dnn.keys.push_back(result.key);
+            dnn.images.push_back(std::move(result.dnnInput));
+
+            if (static_cast<int>(dnn.images.size()) >= dnn.batchSize &&
+                submitDnnBatch(dnn) != 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        if (emitRow(output, result.key, result.features[t]) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Compare features extracted from thumbnails with full-resolution ones
+ *
+ * @param fullDb Rows extracted from the original images
+ * @param thumbDb Rows extracted from thumbnails
+ * @param exifThumbnails true if thumbDb came from EXIF thumbnails
+ *                       (--exif-thumb), false for the thumbnail cache
+ * @param exifKeys With exifThumbnails: the keys this run really read from
+ *                 an EXIF thumbnail. Other rows of thumbDb are full decodes
+ *                 (no usable thumbnail, or written by an earlier run) and
+ *                 would agree with fullDb trivially, so they are left out
+ *                 of both the pairs and the queries.
+ * @return 0 on success, -1 if the two databases share no images
+ *
+ * Prints the mean distance between each image's two feature vectors and,
+ * for up to CACHE_REPORT_MAX_QUERIES evenly spaced query images, how many
+ * of the top CACHE_REPORT_TOP_K matches are the same under both
+ * databases. That agreement is what decides thumbnailSafe and
+ * exifThumbnailSafe.
+ */
+template <typename Type>
+static int reportCacheAgreement(const std::vector<FeatureData> &fullDb,
+                                const std::vector<FeatureData> &thumbDb,
+                                bool exifThumbnails,
+                                const std::unordered_set<std::string> &exifKeys)
+{
+    if constexpr (Type::needsDNN)
+    {
+        std::cout << Type::name << " also needs DNN embeddings; compare it through query instead" << std::endl;
+        return 0;
+    }
+    else
+    {
+        // === Pair up the rows both databases have ===
+
+        std::unordered_map<std::string, size_t> thumbIndex;
+        for (size_t i = 0; i < thumbDb.size(); i++)
+        {
+            thumbIndex.emplace(thumbDb[i].filename, i);
+        }
+
+        std::vector<FeatureData> full, thumb;
+        size_t fullDecodes = 0;
+        for (const auto &row : fullDb)
+        {
+            // Only rows of the right length, so the distance needs no checks
+            auto it = thumbIndex.find(row.filename);
+            if (it != thumbIndex.end() && featureRowFits<Type>(row.feature) &&
+                featureRowFits<Type>(thumbDb[it->second].feature))
+            {
+                if (exifThumbnails && !exifKeys.count(row.filename))
+                {
+                    fullDecodes++;
+                    continue;
+                }
+                full.push_back(row);
+                thumb.push_back(thumbDb[it->second]);
+            }
+        }
+
+        if (full.size() <= static_cast<size_t>(CACHE_REPORT_TOP_K))
+        {
+            std::cerr << "Error: Too few images in both CSVs to compare (" << full.size() << ")" << std::endl;
+            return -1;
+        }
+
+        // === Distance between each image's two vectors ===
+
+        typename Type::Distance distance;
+        double selfDistance = 0.0;
+        for (size_t i = 0; i < full.size(); i++)
+        {
+            selfDistance += distance(full[i].feature, thumb[i].feature);
+        }
+        selfDistance /= full.size();
+
+        // === Top-k agreement over evenly spaced queries ===
+
+        size_t numQueries = std::min(full.size(), static_cast<size_t>(CACHE_REPORT_MAX_QUERIES));
+        FeatureMatrix fullMatrix, thumbMatrix;
+        packFeatureDatabase<Type>(full, fullMatrix);
+        packFeatureDatabase<Type>(thumb, thumbMatrix);
+        MatchSelection fullResults, thumbResults;
+        double agreement = 0.0;
+
+        auto topK = [](const MatchSelection &results, const std::string &self)
+        {
+            std::unordered_set<std::string> top;
+            for (size_t r = 0; r < results.best.size() && top.size() < static_cast<size_t>(CACHE_REPORT_TOP_K); r++)
+            {
+                if (results.best[r].filename != self)
+                    top.insert(results.best[r].filename);
+            }
+            return top;
+        };
+
+        for (size_t q = 0; q < numQueries; q++)
+        {
+            size_t i = q * full.size() / numQueries;
+
+            // Top K plus the query itself
+            size_t keepBest = static_cast<size_t>(CACHE_REPORT_TOP_K + 1);
+            selectFeatureMatches<Type>(full[i].feature, fullMatrix, full, keepBest, 0, fullResults);
+            selectFeatureMatches<Type>(thumb[i].feature, thumbMatrix, thumb, keepBest, 0, thumbResults);
+
+            std::unordered_set<std::string> fullTop = topK(fullResults, full[i].filename);
+            std::unordered_set<std::string> thumbTop = topK(thumbResults, full[i].filename);
+
+            int shared = 0;
+            for (const auto &name : thumbTop)
+            {
+                shared += static_cast<int>(fullTop.count(name));
+            }
+            agreement += static_cast<double>(shared) / CACHE_REPORT_TOP_K;
+        }
+        agreement /= numQueries;
+
+        // === Report ===
+
+        bool passes = agreement >= CACHE_AGREEMENT_THRESHOLD;
+
+        std::cout << "========================================" << std::endl;
+        std::cout << (exifThumbnails ? "EXIF thumbnail" : "Thumbnail cache")
+                  << " vs full resolution: " << Type::name << std::endl;
+        std::cout << "========================================" << std::endl;
+        std::cout << "Images compared: " << full.size() << std::endl;
+        if (exifThumbnails)
+        {
+            std::cout << "Excluded (full decode, no EXIF thumbnail this run): " << fullDecodes << std::endl;
+        }
+        std::cout << "Mean distance thumbnail -> full: " << std::fixed << std::setprecision(6)
+                  << selfDistance << std::endl;
+        std::cout << "Top-" << CACHE_REPORT_TOP_K << " agreement over " << numQueries << " queries: "
+                  << std::setprecision(1) << agreement * 100.0 << "% (needs "
+                  << CACHE_AGREEMENT_THRESHOLD * 100.0f << "%)" << std::endl;
+        bool registrySafe = exifThumbnails ? Type::exifThumbnailSafe : Type::thumbnailSafe;
+        std::cout << "Verdict: " << (passes ? "eligible" : "not eligible")
+                  << " for thumbnail extraction (registry: "
+                  << (exifThumbnails ? "exifThumbnailSafe" : "thumbnailSafe") << " = "
+                  << (registrySafe ? "true" : "false") << ")" << std::endl;
+        std::cout << "========================================\n" << std::endl;
+        return 0;
+    }
+}
 
 /**
  * Main function: Extract features from all images and save to CSV
@@ -42,201 +504,718 @@ int main(int argc, char *argv[])
 {
     // === Step 1: Parse command line arguments ===
 
-    if (argc != 4)
+    if (argc < 4)
     {
-        std::cerr << "Usage: " << argv[0] << " <image_directory> <output_csv> <feature_type>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <image_directory|video_file|thumbnail_cache> <output_csv|output_dir> <feature_type[,feature_type...]> [options]" << std::endl;
         std::cerr << "\nFeature types:" << std::endl;
         std::cerr << "  baseline       - 7x7 center square (Task 1)" << std::endl;
         std::cerr << "  histogram      - rg chromaticity histogram (Task 2)" << std::endl;
         std::cerr << "  multihistogram - top/bottom histograms (Task 3)" << std::endl;
         std::cerr << "  texture        - color + texture histograms (Task 4)" << std::endl;
-        std::cerr << "  dnn            - NOT NEEDED (features provided by assignment)" << std::endl;
+        std::cerr << "  dnn            - ResNet18 embeddings, needs --model (Task 5)" << std::endl;
         std::cerr << "  custom         - custom blue scene detector (Task 7)" << std::endl;
+        std::cerr << "  pyramid        - 1x1/2x2/4x4 spatial pyramid of rg histograms" << std::endl;
+        std::cerr << "  grid           - 8x8 grid of rg histograms, for region queries" << std::endl;
+        std::cerr << "\nSeveral types (e.g. custom,dnn) share one decode per image; the output" << std::endl;
+        std::cerr << "is then a directory and each type goes to <output_dir>/<type>_features.csv" << std::endl;
+        std::cerr << "\nOptions:" << std::endl;
+        std::cerr << "  --video-stride N       sample every Nth frame (default: 30)" << std::endl;
+        std::cerr << "  --scene-threshold T    keep a sampled frame only on scene change (0 = off)" << std::endl;
+        std::cerr << "  --model PATH           ResNet18 ONNX model for the dnn type" << std::endl;
+        std::cerr << "  --batch N              images per DNN forward pass (default: 16)" << std::endl;
+        std::cerr << "  --checkpoint N         rows between CSV checkpoints (default: 500)" << std::endl;
+        std::cerr << "  --resume               continue an interrupted run" << std::endl;
+        std::cerr << "  --workers N            decode/extraction threads (default: all cores)" << std::endl;
+        std::cerr << "  --thumb-cache PATH     also write a 128 px thumbnail cache of the images" << std::endl;
+        std::cerr << "  --from-cache           the input is a thumbnail cache (histogram-type features)" << std::endl;
+        std::cerr << "  --compare-with CSV     with --from-cache/--exif-thumb: report agreement with a full-resolution CSV" << std::endl;
+        std::cerr << "  --no-roi-decode        decode whole JPEGs even when only baseline is requested" << std::endl;
+        std::cerr << "  --exif-thumb           extract from embedded EXIF thumbnails (histogram, multihistogram)" << std::endl;
         std::cerr << "\nExamples:" << std::endl;
         std::cerr << "  " << argv[0] << " data/olympus/ data/baseline_features.csv baseline" << std::endl;
         std::cerr << "  " << argv[0] << " data/olympus/ data/histogram_features.csv histogram" << std::endl;
         std::cerr << "  " << argv[0] << " data/olympus/ data/multihistogram_features.csv multihistogram" << std::endl;
         std::cerr << "  " << argv[0] << " data/olympus/ data/texture_features.csv texture" << std::endl;
+        std::cerr << "  " << argv[0] << " data/olympus/ data/ custom,dnn --model data/resnet18-v2-7.onnx" << std::endl;
+        std::cerr << "  " << argv[0] << " data/archive/harbor.mp4 data/harbor_histogram.csv histogram --scene-threshold 0.3" << std::endl;
+        std::cerr << "  " << argv[0] << " data/olympus/ data/histogram_features.csv histogram --thumb-cache data/olympus.thumbs" << std::endl;
+        std::cerr << "  " << argv[0] << " data/olympus.thumbs data/pyramid_features.csv pyramid --from-cache" << std::endl;
         return -1;
     }
 
     std::string imageDir = argv[1];     // e.g., "data/olympus/"
-    std::string outputCSV = argv[2];    // e.g., "data/histogram_features.csv"
-    std::string featureType = argv[3];  // e.g., "histogram"
+    std::string outputPath = argv[2];   // e.g., "data/histogram_features.csv" or "data/"
+    std::string typeList = argv[3];     // e.g., "histogram" or "custom,dnn"
+
+    VideoSamplingOptions videoOptions;
+    std::string modelPath;
+    int dnnBatchSize = 16;
+    int checkpointEvery = 500;
+    bool resume = false;
+    int numWorkers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::string thumbCachePath;
+    bool fromCache = false;
+    std::string compareWith;
+    bool allowROIDecode = true;
+    bool exifThumb = false;
+
+    for (int i = 4; i < argc; i++)
+    {
+        std::string option = argv[i];
+
+        if (option == "--video-stride" && i + 1 < argc)
+        {
+            videoOptions.frameStride = std::stoi(argv[++i]);
+        }
+        else if (option == "--scene-threshold" && i + 1 < argc)
+        {
+            videoOptions.sceneThreshold = std::stof(argv[++i]);
+        }
+        else if (option == "--model" && i + 1 < argc)
+        {
+            modelPath = argv[++i];
+        }
+        else if (option == "--batch" && i + 1 < argc)
+        {
+            dnnBatchSize = std::stoi(argv[++i]);
+        }
+        else if (option == "--checkpoint" && i + 1 < argc)
+        {
+            checkpointEvery = std::stoi(argv[++i]);
+        }
+        else if (option == "--resume")
+        {
+            resume = true;
+        }
+        else if (option == "--workers" && i + 1 < argc)
+        {
+            numWorkers = std::stoi(argv[++i]);
+        }
+        else if (option == "--thumb-cache" && i + 1 < argc)
+        {
+            thumbCachePath = argv[++i];
+        }
+        else if (option == "--from-cache")
+        {
+            fromCache = true;
+        }
+        else if (option == "--compare-with" && i + 1 < argc)
+        {
+            compareWith = argv[++i];
+        }
+        else if (option == "--no-roi-decode")
+        {
+            allowROIDecode = false;
+        }
+        else if (option == "--exif-thumb")
+        {
+            exifThumb = true;
+        }
+        else
+        {
+            std::cerr << "Error: Unknown or incomplete option: " << option << std::endl;
+            return -1;
+        }
+    }
+
+    if (videoOptions.frameStride < 1 || dnnBatchSize < 1 || checkpointEvery < 1 || numWorkers < 1)
+    {
+        std::cerr << "Error: --video-stride, --batch, --checkpoint and --workers must be at least 1" << std::endl;
+        return -1;
+    }
+
+    if (fromCache && !thumbCachePath.empty())
+    {
+        std::cerr << "Error: --thumb-cache writes a cache from originals; it cannot be combined with --from-cache" << std::endl;
+        return -1;
+    }
+
+    if (exifThumb && (fromCache || !thumbCachePath.empty()))
+    {
+        std::cerr << "Error: --exif-thumb reads originals; it cannot be combined with --from-cache or --thumb-cache" << std::endl;
+        return -1;
+    }
 
-    // Validate feature type
-    if (featureType != "baseline" && featureType != "histogram" && 
-        featureType != "multihistogram" && featureType != "texture" && featureType != "dnn" && featureType != "custom")
+    if (!compareWith.empty() && !fromCache && !exifThumb)
     {
-        std::cerr << "Error: Invalid feature type: " << featureType << std::endl;
-        std::cerr << "Valid types: baseline, histogram, multihistogram, texture, dnn, custom" << std::endl;
+        std::cerr << "Error: --compare-with only applies to --from-cache and --exif-thumb runs" << std::endl;
         return -1;
     }
 
-    // Check if user tried to extract DNN features
-    if (featureType == "dnn")
+    // Split and validate the feature type list
+    std::vector<TypeOutput> outputs;
+    bool wantDnn = false;
+    {
+        std::stringstream ss(typeList);
+        std::string type;
+        while (std::getline(ss, type, ','))
+        {
+            if (!isFeatureType(type))
+            {
+                std::cerr << "Error: Invalid feature type: " << type << std::endl;
+                std::cerr << "Valid types: " << featureTypeList() << std::endl;
+                return -1;
+            }
+
+            bool duplicate = false;
+            for (const auto &output : outputs)
+            {
+                duplicate = duplicate || output.type == type;
+            }
+            if (duplicate)
+                continue;
+
+            TypeOutput output;
+            output.type = type;
+            output.extract = findFeatureExtractor(type);
+            wantDnn = wantDnn || output.extract == nullptr;
+            outputs.push_back(std::move(output));
+        }
+    }
+
+    if (outputs.empty())
     {
-        std::cerr << "\nError: DNN features are pre-computed by the assignment." << std::endl;
-        std::cerr << "You should use the provided CSV file directly with the query program." << std::endl;
-        std::cerr << "No need to run feature extraction for DNN embeddings." << std::endl;
+        std::cerr << "Error: No feature type given" << std::endl;
         return -1;
     }
 
+    // Thumbnails only stand in for originals where rankings were shown to
+    // agree; --compare-with is how a type gets measured in the first place
+    if (fromCache || exifThumb)
+    {
+        if (!compareWith.empty() && outputs.size() != 1)
+        {
+            std::cerr << "Error: --compare-with takes a single feature type" << std::endl;
+            return -1;
+        }
+
+        for (const auto &output : outputs)
+        {
+            bool safe = false;
+            dispatchFeatureType(output.type, [&](auto type)
+            {
+                safe = exifThumb ? decltype(type)::exifThumbnailSafe : decltype(type)::thumbnailSafe;
+            });
+
+            if (!safe && compareWith.empty())
+            {
+                std::cerr << "Error: " << output.type << " is not validated for thumbnail extraction" << std::endl;
+                std::cerr << "Measure it with: --compare-with <full-resolution " << output.type << " CSV>" << std::endl;
+                return -1;
+            }
+        }
+    }
+
+    // One type writes to the given CSV; several write <type>_features.csv into a directory
+    if (outputs.size() == 1)
+    {
+        outputs[0].csvPath = outputPath;
+    }
+    else
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(outputPath, ec);
+        if (ec)
+        {
+            std::cerr << "Error: Cannot create output directory: " << outputPath << std::endl;
+            return -1;
+        }
+
+        for (auto &output : outputs)
+        {
+            dispatchFeatureType(output.type, [&](auto type)
+            {
+                output.csvPath = (std::filesystem::path(outputPath) / decltype(type)::defaultCSV).string();
+            });
+        }
+    }
+
+    // Baseline alone only needs the centre of each image; anything else
+    // (another type, a thumbnail) needs the whole decode anyway
+    bool roiDecode = allowROIDecode && haveROIDecode() && !fromCache && !exifThumb && thumbCachePath.empty() &&
+                     outputs.size() == 1 && outputs[0].type == "baseline";
+
+    // Load the network once for the whole run
+    DnnBatch dnn;
+    dnn.batchSize = dnnBatchSize;
+
+    if (wantDnn)
+    {
+        if (modelPath.empty())
+        {
+            std::cerr << "Error: The dnn type needs the ResNet18 model: --model data/resnet18-v2-7.onnx" << std::endl;
+            return -1;
+        }
+
+        if (loadEmbeddingNet(modelPath, dnn.net) != 0)
+        {
+            return -1;
+        }
+    }
+
     std::cout << "========================================" << std::endl;
     std::cout << "Feature Extraction Program" << std::endl;
     std::cout << "========================================" << std::endl;
-    std::cout << "Image directory: " << imageDir << std::endl;
-    std::cout << "Output CSV: " << outputCSV << std::endl;
-    std::cout << "Feature type: " << featureType << std::endl;
+    std::cout << (fromCache ? "Thumbnail cache: " : "Image directory: ") << imageDir << std::endl;
+    if (!thumbCachePath.empty())
+    {
+        std::cout << "Writing thumbnail cache: " << thumbCachePath << std::endl;
+    }
+    for (const auto &output : outputs)
+    {
+        std::cout << "Feature type: " << output.type << " -> " << output.csvPath << std::endl;
+    }
+    if (wantDnn)
+    {
+        std::cout << "Model: " << modelPath << " (batch " << dnnBatchSize << ")" << std::endl;
+    }
+    if (roiDecode)
+    {
+        std::cout << "Decode: centre region only (libjpeg-turbo), full decode as fallback" << std::endl;
+    }
+    if (exifThumb)
+    {
+        std::cout << "Decode: EXIF thumbnails, full decode as fallback" << std::endl;
+    }
     std::cout << "========================================\n"
               << std::endl;
 
-    // === Step 2: Get all image filenames from directory ===
+    // Open every CSV up front; on --resume this also collects committed keys
+    for (auto &output : outputs)
+    {
+        output.writer.checkpointEvery = checkpointEvery;
+        if (output.writer.open(output.csvPath, resume, output.committed) != 0)
+        {
+            return -1;
+        }
+    }
+
+    // Thumbnail cache output: appended to on --resume, so images cached by
+    // the interrupted run are not downsampled again
+    ThumbnailCacheWriter thumbWriter;
+    std::unordered_set<std::string> thumbCached;
+
+    if (!thumbCachePath.empty() && thumbWriter.open(thumbCachePath, resume, thumbCached) != 0)
+    {
+        return -1;
+    }
+
+    // === Step 2: Get all image and video filenames ===
 
     std::vector<std::string> filenames;
+    std::vector<std::string> videoFilenames;
+    ThumbnailCache cache;
 
-    std::cout << "Reading image filenames from directory..." << std::endl;
+    if (fromCache)
+    {
+        // Every cached thumbnail is one input, in cache order
+        std::cout << "Loading thumbnail cache..." << std::endl;
 
-    if (getImageFilenames(imageDir, filenames) != 0)
+        if (cache.load(imageDir) != 0)
+        {
+            return -1;
+        }
+
+        for (size_t i = 0; i < cache.size(); i++)
+        {
+            filenames.push_back(cache.key(i));
+        }
+    }
+    else if (isVideoFile(imageDir) && std::filesystem::is_regular_file(imageDir))
     {
-        std::cerr << "Error: Failed to read image filenames" << std::endl;
-        return -1;
+        // A single video file: index its frames, relative to its directory
+        std::filesystem::path videoPath(imageDir);
+        videoFilenames.push_back(videoPath.filename().string());
+        imageDir = videoPath.parent_path().string();
+        if (imageDir.empty())
+        {
+            imageDir = ".";
+        }
     }
+    else
+    {
+        std::cout << "Reading image filenames from directory..." << std::endl;
 
-    if (filenames.empty())
+        if (getImageFilenames(imageDir, filenames) != 0 ||
+            getVideoFilenames(imageDir, videoFilenames) != 0)
+        {
+            std::cerr << "Error: Failed to read image filenames" << std::endl;
+            return -1;
+        }
+    }
+
+    if (filenames.empty() && videoFilenames.empty())
     {
         std::cerr << "Error: No images found in directory" << std::endl;
         return -1;
     }
 
-    std::cout << "Found " << filenames.size() << " images\n"
-              << std::endl;
+    std::cout << "Found " << filenames.size() << " images";
+    if (!videoFilenames.empty())
+    {
+        std::cout << " and " << videoFilenames.size() << " videos";
+    }
+    std::cout << "\n" << std::endl;
 
-    // === Step 3: Extract features from each image ===
+    if (!fromCache && imageDir.back() != '/')
+    {
+        imageDir += '/';
+    }
 
-    std::vector<FeatureData> allFeatures;
-    allFeatures.reserve(filenames.size()); // Reserve space for efficiency
+    // === Step 3: Extract features from each image on a worker pool ===
 
-    int successCount = 0;
-    int failCount = 0;
+    int loadFailCount = 0;
+    int skippedCount = 0;
+    size_t emittedCount = 0;
+    std::atomic<int> roiDecodedCount(0);
+    std::atomic<int> exifThumbCount(0);
+    std::unordered_set<std::string> exifKeys;   // rows read from EXIF thumbnails, for --compare-with
+    std::atomic<bool> writeFailed(false);
 
-    std::cout << "Extracting features from images..." << std::endl;
-    std::cout << "Progress: 0/" << filenames.size() << std::flush;
+    // Rows of the dnn type, which are appended batch by batch
+    TypeOutput *dnnOutput = nullptr;
+    for (auto &output : outputs)
+    {
+        if (output.extract == nullptr)
+            dnnOutput = &output;
+    }
 
-    for (size_t i = 0; i < filenames.size(); i++)
+    // Inference thread: runs the queued DNN batches one at a time, so the
+    // dnn rows keep input order while the forward pass stays off the
+    // reorder buffer's lock
+    std::thread inference;
+    if (dnnOutput)
     {
-        const std::string &filename = filenames[i];
+        inference = std::thread([&]()
+        {
+            DnnJob job;
+            while (dnn.jobs.pop(job))
+            {
+                // After a write error, keep draining so the writer side never blocks
+                if (!dnn.failed && runDnnJob(job, dnn.net, *dnnOutput) != 0)
+                {
+                    dnn.failed = true;
+                }
+            }
+        });
+    }
 
-        // Construct full path to image
-        std::string fullPath = imageDir;
-        if (fullPath.back() != '/')
+    auto stopInference = [&]()
+    {
+        dnn.jobs.close();
+        if (inference.joinable())
         {
-            fullPath += '/';
+            inference.join();
         }
-        fullPath += filename;
+    };
 
-        // Load the image
-        cv::Mat image = cv::imread(fullPath);
+    // Writer side: runs in input order under the reorder buffer's lock, so
+    // the CSVs come out identical for any worker count
+    auto emitInOrder = [&](ImageResult &result)
+    {
+        emittedCount++;
 
-        // Check if image loaded successfully
-        if (image.empty())
+        if (result.fromExif)
         {
-            std::cerr << "\nWarning: Failed to load image: " << filename << std::endl;
-            failCount++;
-            continue;
+            exifKeys.insert(result.key);
         }
 
-        // Extract features based on type
-        std::vector<float> feature;
-        int result;
-
-        if (featureType == "baseline")
+        if (result.committed)
         {
-            result = extractBaselineFeature(image, feature);
+            skippedCount++;
         }
-        else if (featureType == "histogram")
+        else if (!result.loaded)
         {
-            result = extractRGChromaticityHistogram(image, feature);
+            std::cerr << "\nWarning: Failed to load image: " << result.key << std::endl;
+            loadFailCount++;
         }
-        else if (featureType == "multihistogram")
+        else if (emitImageResult(result, outputs, dnn) != 0)
         {
-            result = extractMultiHistogram(image, feature);
+            return -1;
         }
-        else if (featureType == "texture")
+
+        if (!result.thumbnail.empty() && thumbWriter.write(result.key, result.thumbnail) != 0)
         {
-            result = extractTextureColorFeature(image, feature);
+            return -1;
         }
-        else if (featureType == "custom")
+
+        // Update progress every 50 images
+        if (emittedCount % 50 == 0 || emittedCount == filenames.size())
         {
-            result = extractCustomBlueSceneFeature(image, feature);
+            std::cout << "\rProgress: " << emittedCount << "/" << filenames.size() << std::flush;
         }
-        else
+        return 0;
+    };
+
+    // At most a few results per worker are held at once, however large
+    // the collection is
+    ReorderBuffer<ImageResult> ordered(static_cast<size_t>(numWorkers) * 4);
+    std::atomic<size_t> nextImage(0);
+
+    auto worker = [&]()
+    {
+        // Scratch planes and histogram buffers reused across this worker's
+        // images, so the extractors stop allocating once the largest is seen
+        ExtractionWorkspace workspace;
+        std::vector<float> roiFeature;
+
+        for (size_t i = nextImage++; i < filenames.size() && ordered.acquire(i); i = nextImage++)
         {
-            std::cerr << "\nError: Unknown feature type: " << featureType << std::endl;
-            failCount++;
-            continue;
+            ImageResult result;
+            result.key = filenames[i];
+
+            // Skip the decode entirely when every type already has this image
+            // (and the thumbnail cache, if one is being written)
+            bool needThumbnail = thumbWriter.isOpen() && !thumbCached.count(result.key);
+            bool needed = needThumbnail;
+            for (const auto &output : outputs)
+            {
+                needed = needed || !output.committed.count(result.key);
+            }
+
+            if (!needed)
+            {
+                result.committed = true;
+            }
+            else if (roiDecode && extractBaselineFromJPEG(imageDir + result.key, roiFeature) == 0)
+            {
+                // Same row as the imread path below, without the full decode
+                result.features.push_back(std::move(roiFeature));
+                result.loaded = true;
+                result.status.assign(1, ROW_OK);
+                roiDecodedCount++;
+            }
+            else
+            {
+                // Load the image (once, for every requested type); a cached
+                // thumbnail is already in memory
+                cv::Mat image;
+                if (fromCache)
+                {
+                    image = cache.image(i);
+                }
+                else if (exifThumb && readExifThumbnail(imageDir + result.key, image) == 0)
+                {
+                    result.fromExif = true;
+                    exifThumbCount++;
+                }
+                else
+                {
+                    image = cv::imread(imageDir + result.key);
+                }
+
+                if (!image.empty())
+                {
+                    extractImageResult(image, outputs, result, workspace);
+
+                    if (needThumbnail && makeCacheThumbnail(image, result.thumbnail) != 0)
+                    {
+                        result.thumbnail.release();
+                    }
+                }
+            }
+
+            ordered.put(i, std::move(result));
+
+            if (ordered.drain(emitInOrder) != 0)
+            {
+                writeFailed = true;
+                ordered.close();
+            }
         }
-        
-        if (result != 0)
+    };
+
+    if (!filenames.empty())
+    {
+        std::cout << "Extracting features from images (" << numWorkers << " workers)..." << std::endl;
+        std::cout << "Progress: 0/" << filenames.size() << std::flush;
+    }
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < numWorkers; w++)
+    {
+        workers.emplace_back(worker);
+    }
+
+    for (auto &thread : workers)
+    {
+        thread.join();
+    }
+
+    if (writeFailed)
+    {
+        stopInference();
+        std::cerr << "\nError: Stopping; rerun with --resume to continue from the last checkpoint" << std::endl;
+        return -1;
+    }
+
+    if (!filenames.empty())
+    {
+        std::cout << "\n"
+                  << std::endl;
+    }
+
+    // === Step 4: Extract features from sampled video frames ===
+
+    int frameCount = 0;
+
+    // Frames are already decoded on their own thread; extract them here
+    ExtractionWorkspace videoWorkspace;
+
+    for (const auto &videoFilename : videoFilenames)
+    {
+        std::cout << "Extracting features from video: " << videoFilename << std::endl;
+
+        // Decode runs on its own thread; this callback runs here, overlapped with it
+        int kept = sampleVideoFrames(imageDir + videoFilename, videoOptions,
+            [&](int frameIndex, const cv::Mat &frame)
+            {
+                ImageResult result;
+                result.key = videoFrameKey(videoFilename, frameIndex);
+                extractImageResult(frame, outputs, result, videoWorkspace);
+
+                if (thumbWriter.isOpen() && !thumbCached.count(result.key))
+                {
+                    makeCacheThumbnail(frame, result.thumbnail);
+                }
+
+                if (emitImageResult(result, outputs, dnn) != 0 ||
+                    (!result.thumbnail.empty() && thumbWriter.write(result.key, result.thumbnail) != 0))
+                {
+                    writeFailed = true;
+                    return 1;  // stop decoding
+                }
+
+                frameCount++;
+
+                if (frameCount % 50 == 0)
+                {
+                    std::cout << "\rFrames: " << frameCount << std::flush;
+                }
+                return 0;
+            });
+
+        if (kept < 0)
         {
-            std::cerr << "\nWarning: Failed to extract features from: " << filename << std::endl;
-            failCount++;
+            std::cerr << "Warning: Failed to open video: " << videoFilename << std::endl;
+            loadFailCount++;
             continue;
         }
 
-        // Store filename and feature vector
-        FeatureData data;
-        data.filename = filename;
-        data.feature = feature;
-        allFeatures.push_back(data);
+        if (writeFailed)
+            break;
 
-        successCount++;
+        std::cout << "\r  Sampled " << kept << " frames" << std::endl;
+    }
 
-        // Update progress every 50 images
-        if ((i + 1) % 50 == 0 || (i + 1) == filenames.size())
-        {
-            std::cout << "\rProgress: " << (i + 1) << "/" << filenames.size() << std::flush;
-        }
+    // Queue the last, partial DNN batch and wait for every batch to finish
+    if (!writeFailed && submitDnnBatch(dnn) != 0)
+    {
+        writeFailed = true;
     }
+    stopInference();
 
-    std::cout << "\n"
-              << std::endl;
+    if (writeFailed || dnn.failed)
+    {
+        std::cerr << "\nError: Stopping; rerun with --resume to continue from the last checkpoint" << std::endl;
+        return -1;
+    }
 
-    // === Step 4: Report extraction results ===
+    // === Step 5: Report extraction results ===
 
     std::cout << "========================================" << std::endl;
     std::cout << "Extraction Summary:" << std::endl;
     std::cout << "========================================" << std::endl;
     std::cout << "Total images found: " << filenames.size() << std::endl;
-    std::cout << "Successfully extracted: " << successCount << std::endl;
-    std::cout << "Failed: " << failCount << std::endl;
-    if (successCount > 0)
+    if (!videoFilenames.empty())
+    {
+        std::cout << "Total videos found: " << videoFilenames.size() << std::endl;
+        std::cout << "Video frames extracted: " << frameCount << std::endl;
+    }
+    if (skippedCount > 0)
+    {
+        std::cout << "Skipped (already committed): " << skippedCount << std::endl;
+    }
+    std::cout << "Failed to load: " << loadFailCount << std::endl;
+    if (roiDecode)
     {
-        std::cout << "Feature vector size: " << allFeatures[0].feature.size() << " values" << std::endl;
+        std::cout << "Centre-only JPEG decodes: " << roiDecodedCount << std::endl;
+    }
+    if (exifThumb)
+    {
+        std::cout << "From EXIF thumbnails: " << exifThumbCount << " (rest fully decoded)" << std::endl;
+    }
+    if (thumbWriter.isOpen())
+    {
+        std::cout << "Thumbnails cached: " << thumbWriter.written() << std::endl;
+    }
+    for (const auto &output : outputs)
+    {
+        std::cout << output.type << ": " << output.extracted << " extracted, "
+                  << output.failed << " failed";
+        if (output.dim > 0)
+        {
+            std::cout << ", " << output.dim << " values";
+        }
+        std::cout << std::endl;
     }
     std::cout << "========================================\n"
               << std::endl;
 
-    if (allFeatures.empty())
+    // === Step 6: Final checkpoint of each CSV file ===
+
+    for (auto &output : outputs)
     {
-        std::cerr << "Error: No features extracted successfully" << std::endl;
-        return -1;
+        if (output.writer.rows() == 0)
+        {
+            std::cerr << "Error: No " << output.type << " features extracted successfully" << std::endl;
+            return -1;
+        }
+
+        if (output.writer.close() != 0)
+        {
+            std::cerr << "Error: Failed to write features to CSV" << std::endl;
+            return -1;
+        }
     }
 
-    // === Step 5: Write features to CSV file ===
+    if (thumbWriter.close() != 0)
+    {
+        return -1;
+    }
 
-    std::cout << "Writing features to CSV file..." << std::endl;
+    // === Step 7: Thumbnail vs full-resolution report ===
 
-    if (writeFeaturesToCSV(outputCSV, allFeatures) != 0)
+    if (!compareWith.empty())
     {
-        std::cerr << "Error: Failed to write features to CSV" << std::endl;
-        return -1;
+        std::vector<FeatureData> fullDb, thumbDb;
+
+        if (readFeaturesFromCSV(compareWith, fullDb) != 0 ||
+            readFeaturesFromCSV(outputs[0].csvPath, thumbDb) != 0)
+        {
+            std::cerr << "Error: Failed to load the CSVs to compare" << std::endl;
+            return -1;
+        }
+
+        int status = 0;
+        dispatchFeatureType(outputs[0].type, [&](auto type)
+        {
+            status = reportCacheAgreement<decltype(type)>(fullDb, thumbDb, exifThumb, exifKeys);
+        });
+
+        if (status != 0)
+        {
+            return -1;
+        }
     }
 
     std::cout << "\n========================================" << std::endl;
     std::cout << "Feature extraction completed successfully!" << std::endl;
-    std::cout << "Feature database saved to: " << outputCSV << std::endl;
+    for (const auto &output : outputs)
+    {
+        std::cout << "Feature database saved to: " << output.csvPath << std::endl;
+    }
     std::cout << "========================================" << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
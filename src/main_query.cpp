@@ -8,7 +8,25 @@
  * This is run MANY times with different target images to find matches.
  * 
  * Usage:
- *   ./query <target_image> <feature_csv> <num_matches> <feature_type> [dnn_csv]
+ *   ./query <target_image> <feature_csv> <num_matches> <feature_type> [dnn_csv] [options]
+ *
+ * Options:
+ *   --roi x,y,w,h          Search for this region of the target anywhere in
+ *                          the database images (grid feature type only)
+ *   --check-kernels        Validate the SIMD distance kernels against the
+ *                          scalar reference before querying
+ *   --all-vs-all <out_csv> dnn only: use every database image as a query
+ *                          and write each one's matches to out_csv
+ *                          (blocked gemm, see batch_search.h); the target
+ *                          image argument is ignored
+ *   --int8 <R>             dnn only: score int8-quantized embeddings and
+ *                          rescore the R best candidates in float (see
+ *                          quantized_search.h)
+ *   --int8-recall          with --int8: also report recall against the
+ *                          float scan over sampled database queries
+ *   --metric emd           histogram, multihistogram and texture: rank by
+ *                          an earth mover's distance approximation instead
+ *                          of histogram intersection (see distance.h)
  * 
  * Example:
  *   ./query data/olympus/pic.1016.jpg data/baseline_features.csv 3 baseline
@@ -17,6 +35,10 @@
  *   ./query data/olympus/pic.0535.jpg data/texture_features.csv 3 texture
  *   ./query data/olympus/pic.0893.jpg data/dnn_features.csv 3 dnn
  *   ./query data/olympus/pic.0164.jpg data/custom_features.csv 5 custom data/dnn_features.csv
+ *   ./query data/olympus/pic.0274.jpg data/grid_features.csv 5 grid --roi 200,150,160,120
+ *   ./query all data/dnn_features.csv 5 dnn --all-vs-all results/dnn_all_vs_all.csv
+ *   ./query data/olympus/pic.0893.jpg data/dnn_features.csv 5 dnn --int8 50 --int8-recall
+ *   ./query data/olympus/pic.0164.jpg data/histogram_features.csv 5 histogram --metric emd
  * 
  * What it does:
  *   1. Load target image and extract its features (or load from CSV for DNN/custom)
@@ -31,10 +53,165 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <unordered_map>
+#include "batch_search.h"
+#include "feature_registry.h"
 #include "features.h"
 #include "distance.h"
+#include "distance_simd.h"
+#include "quantized_search.h"
 #include "utils.h"
 
+// Database rows used as queries when measuring int8 recall
+const size_t INT8_RECALL_QUERIES = 100;
+
+/**
+ * Parse a region of interest given as "x,y,w,h"
+ *
+ * @param text Command line value
+ * @param roi Output rectangle in target image pixels
+ * @return 0 on success, -1 if the text is malformed or the size is not positive
+ */
+static int parseROI(const std::string &text, cv::Rect &roi)
+{
+    int x, y, w, h;
+    char extra;
+    
+    if (std::sscanf(text.c_str(), "%d,%d,%d,%d%c", &x, &y, &w, &h, &extra) != 4 || w <= 0 || h <= 0)
+    {
+        std::cerr << "Error: --roi expects x,y,w,h with positive width and height, got: " << text << std::endl;
+        return -1;
+    }
+    
+    roi = cv::Rect(x, y, w, h);
+    return 0;
+}
+
+/**
+ * Match every image of a DNN database against all the others
+ *
+ * @param database DNN feature database
+ * @param numMatches Matches to write per image (the image itself excluded)
+ * @param outputCSV Output: "query,rank,match,distance" lines
+ * @return 0 on success, -1 on error
+ */
+static int runAllVsAll(const std::vector<FeatureData> &database, int numMatches,
+                       const std::string &outputCSV)
+{
+    FeatureMatrix matrix;
+    packFeatureDatabase<DnnType>(database, matrix);
+    
+    std::cout << "Scoring " << matrix.rows << " x " << matrix.rows << " pairs in blocks of "
+              << GEMM_QUERY_BLOCK << " x " << GEMM_DB_BLOCK << "..." << std::endl;
+    
+    // === Step 1: k + 1 nearest rows of every row (one of them is itself) ===
+    
+    cv::TickMeter timer;
+    timer.start();
+    
+    std::vector<std::vector<BatchMatch>> matches;
+    if (cosineTopKGemm(matrix, matrix, numMatches + 1, matches) != 0)
+        return -1;
+    
+    timer.stop();
+    std::cout << "Scored in " << std::fixed << std::setprecision(2) << timer.getTimeSec() << " s" << std::endl;
+    
+    // === Step 2: Write the matches ===
+    
+    std::ofstream out(outputCSV);
+    if (!out.is_open())
+    {
+        std::cerr << "Error: Cannot open " << outputCSV << " for writing" << std::endl;
+        return -1;
+    }
+    
+    out << "query,rank,match,distance\n";
+    out << std::fixed << std::setprecision(6);
+    
+    for (size_t q = 0; q < matches.size(); q++)
+    {
+        const std::string &query = database[matrix.source[q]].filename;
+        int rank = 0;
+        for (const BatchMatch &match : matches[q])
+        {
+            if (match.row == q || rank == numMatches)
+                continue;
+            out << query << "," << ++rank << "," << database[matrix.source[match.row]].filename
+                << "," << match.distance << "\n";
+        }
+    }
+    
+    if (!out.good())
+    {
+        std::cerr << "Error: Failed writing " << outputCSV << std::endl;
+        return -1;
+    }
+    
+    std::cout << "Wrote " << numMatches << " matches for each of " << matches.size()
+              << " images to " << outputCSV << std::endl;
+    return 0;
+}
+
+/**
+ * Nearest DNN matches from int8 embeddings, rescored in float
+ *
+ * @param target Target embedding
+ * @param database DNN feature database
+ * @param keep Matches to keep
+ * @param rescore int8 candidates rescored with the float distanceCosine
+ * @param measureRecall Also print recall@keep against the float scan
+ * @param selection Output: selection.best holds the matches, nearest first
+ * @return Number of database rows skipped (wrong length), or -1 on error
+ */
+static int runInt8Query(const std::vector<float> &target, const std::vector<FeatureData> &database,
+                        size_t keep, size_t rescore, bool measureRecall, MatchSelection &selection)
+{
+    // === Step 1: Pack and quantize the database (once per database in a long-lived program) ===
+    
+    FeatureMatrix matrix;
+    int skipped = packFeatureDatabase<DnnType>(database, matrix);
+    
+    QuantizedMatrix quantized;
+    quantizeFeatureMatrix(matrix, quantized);
+    
+    // === Step 2: int8 scan and float rescoring ===
+    
+    cv::TickMeter timer;
+    timer.start();
+    
+    std::vector<BatchMatch> matches;
+    if (cosineTopKInt8(FeatureView(target), matrix, quantized, keep, rescore, matches) != 0)
+        return -1;
+    
+    timer.stop();
+    std::cout << "int8 scan of " << matrix.rows << " embeddings, " << rescore << " rescored in float: "
+              << std::fixed << std::setprecision(3) << timer.getTimeMilli() << " ms" << std::endl;
+    
+    selection = MatchSelection();
+    selection.ranked = matrix.rows;
+    for (const BatchMatch &match : matches)
+    {
+        selection.best.push_back({database[matrix.source[match.row]].filename, match.distance});
+    }
+    
+    // === Step 3: Optional recall against the float scan ===
+    
+    if (measureRecall)
+    {
+        double recall = measureInt8Recall(matrix, quantized, keep, rescore, INT8_RECALL_QUERIES);
+        if (recall < 0.0)
+            return -1;
+        std::cout << "int8 recall@" << keep << " vs float over " << std::min(INT8_RECALL_QUERIES, matrix.rows)
+                  << " database queries: " << std::setprecision(4) << recall << std::endl;
+    }
+    
+    return skipped;
+}
+
 /**
  * Main function: Query feature database to find similar images
  */
@@ -42,12 +219,19 @@ int main(int argc, char *argv[])
 {
     // === Step 1: Parse command line arguments ===
     
+    // Positional arguments come first; options start at the first "--"
+    int numPositional = 0;
+    while (numPositional + 1 < argc && std::string(argv[numPositional + 1]).rfind("--", 0) != 0)
+    {
+        numPositional++;
+    }
+    
     // Custom feature type requires an extra argument (DNN CSV)
-    bool validArgCount = (argc == 5) || (argc == 6);
+    bool validArgCount = (numPositional == 4) || (numPositional == 5);
     
     if (!validArgCount)
     {
-        std::cerr << "Usage: " << argv[0] << " <target_image> <feature_csv> <num_matches> <feature_type> [dnn_csv]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <target_image> <feature_csv> <num_matches> <feature_type> [dnn_csv] [options]" << std::endl;
         std::cerr << "\nFeature types:" << std::endl;
         std::cerr << "  baseline       - uses SSD distance (Task 1)" << std::endl;
         std::cerr << "  histogram      - uses histogram intersection (Task 2)" << std::endl;
@@ -55,6 +239,15 @@ int main(int argc, char *argv[])
         std::cerr << "  texture        - uses color + texture histograms (Task 4)" << std::endl;
         std::cerr << "  dnn            - uses cosine distance (Task 5)" << std::endl;
         std::cerr << "  custom         - custom blue scene detector with DNN (Task 7)" << std::endl;
+        std::cerr << "  pyramid        - uses pyramid match over 1x1/2x2/4x4 rg histograms" << std::endl;
+        std::cerr << "  grid           - best matching window of 8x8 cell histograms" << std::endl;
+        std::cerr << "\nOptions:" << std::endl;
+        std::cerr << "  --roi x,y,w,h  search for this region of the target anywhere (grid only)" << std::endl;
+        std::cerr << "  --check-kernels  validate the SIMD distance kernels before querying" << std::endl;
+        std::cerr << "  --all-vs-all <out_csv>  match every database image against the rest (dnn only)" << std::endl;
+        std::cerr << "  --int8 <R>     int8 scan, R best candidates rescored in float (dnn only)" << std::endl;
+        std::cerr << "  --int8-recall  with --int8: report recall against the float scan" << std::endl;
+        std::cerr << "  --metric emd   earth mover's distance instead of intersection (histogram, multihistogram, texture)" << std::endl;
         std::cerr << "\nExamples:" << std::endl;
         std::cerr << "  " << argv[0] << " data/olympus/pic.1016.jpg data/baseline_features.csv 3 baseline" << std::endl;
         std::cerr << "  " << argv[0] << " data/olympus/pic.0164.jpg data/histogram_features.csv 3 histogram" << std::endl;
@@ -63,6 +256,8 @@ int main(int argc, char *argv[])
         std::cerr << "  " << argv[0] << " data/olympus/pic.0893.jpg data/dnn_features.csv 3 dnn" << std::endl;
         std::cerr << "\nNote: For 'custom' feature type, provide DNN CSV as 5th argument:" << std::endl;
         std::cerr << "  " << argv[0] << " data/olympus/pic.0164.jpg data/custom_features.csv 5 custom data/dnn_features.csv" << std::endl;
+        std::cerr << "\nRegion of interest (x,y,w,h in target pixels) against the grid features:" << std::endl;
+        std::cerr << "  " << argv[0] << " data/olympus/pic.0274.jpg data/grid_features.csv 5 grid --roi 200,150,160,120" << std::endl;
         return -1;
     }
     
@@ -72,29 +267,127 @@ int main(int argc, char *argv[])
     std::string featureType = argv[4];      // e.g., "custom"
     
     std::string dnnCSV = "";
-    if (argc == 6)
+    if (numPositional == 5)
     {
         dnnCSV = argv[5];  // e.g., "data/dnn_features.csv"
     }
     
+    cv::Rect roi;
+    bool useROI = false;
+    std::string allVsAllCSV;
+    int int8Rescore = 0;
+    bool int8Recall = false;
+    bool useEMD = false;
+    
+    for (int i = numPositional + 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        
+        if (option == "--roi" && i + 1 < argc)
+        {
+            if (parseROI(argv[++i], roi) != 0)
+                return -1;
+            useROI = true;
+        }
+        else if (option == "--check-kernels")
+        {
+            if (checkDistanceKernels() != 0)
+                return -1;
+            std::cout << "Distance kernels (" << distanceKernelName() << ") match the scalar reference" << std::endl;
+        }
+        else if (option == "--all-vs-all" && i + 1 < argc)
+        {
+            allVsAllCSV = argv[++i];
+        }
+        else if (option == "--int8" && i + 1 < argc)
+        {
+            int8Rescore = std::atoi(argv[++i]);
+            if (int8Rescore <= 0)
+            {
+                std::cerr << "Error: --int8 expects a positive number of candidates to rescore" << std::endl;
+                return -1;
+            }
+        }
+        else if (option == "--int8-recall")
+        {
+            int8Recall = true;
+        }
+        else if (option == "--metric" && i + 1 < argc)
+        {
+            std::string metric = argv[++i];
+            if (metric != "emd")
+            {
+                std::cerr << "Error: Unknown metric: " << metric << " (supported: emd)" << std::endl;
+                return -1;
+            }
+            useEMD = true;
+        }
+        else
+        {
+            std::cerr << "Error: Unknown or incomplete option: " << option << std::endl;
+            return -1;
+        }
+    }
+    
     // Validate feature type
-    if (featureType != "baseline" && featureType != "histogram" && 
-        featureType != "multihistogram" && featureType != "texture" && 
-        featureType != "dnn" && featureType != "custom")
+    if (!isFeatureType(featureType))
     {
         std::cerr << "Error: Invalid feature type: " << featureType << std::endl;
-        std::cerr << "Valid types: baseline, histogram, multihistogram, texture, dnn, custom" << std::endl;
+        std::cerr << "Valid types: " << featureTypeList() << std::endl;
         return -1;
     }
     
+    // What the type needs: pixels for the target, and/or DNN embeddings
+    FeatureExtractFn extractTarget = findFeatureExtractor(featureType);
+    bool needsDNN = false;
+    dispatchFeatureType(featureType, [&](auto type) { needsDNN = decltype(type)::needsDNN; });
+    
     // Custom feature type requires DNN CSV
-    if (featureType == "custom" && dnnCSV.empty())
+    if (needsDNN && dnnCSV.empty())
     {
         std::cerr << "Error: Custom feature type requires DNN CSV file as 5th argument" << std::endl;
         std::cerr << "Example: " << argv[0] << " <target> <custom_csv> <num> custom <dnn_csv>" << std::endl;
         return -1;
     }
     
+    // All-vs-all scoring is a matrix product of embeddings
+    if (!allVsAllCSV.empty() && featureType != DnnType::name)
+    {
+        std::cerr << "Error: --all-vs-all needs the " << DnnType::name << " feature type" << std::endl;
+        return -1;
+    }
+    
+    // The int8 scan quantizes embeddings
+    if (int8Rescore > 0 && featureType != DnnType::name)
+    {
+        std::cerr << "Error: --int8 needs the " << DnnType::name << " feature type" << std::endl;
+        return -1;
+    }
+    
+    if (int8Recall && int8Rescore == 0)
+    {
+        std::cerr << "Error: --int8-recall needs --int8 <R>" << std::endl;
+        return -1;
+    }
+    
+    // EMD needs a type that defines a signature for its histograms
+    bool hasEMD = false;
+    dispatchFeatureType(featureType, [&](auto type) { hasEMD = HasEmdMetric<decltype(type)>::value; });
+    if (useEMD && !hasEMD)
+    {
+        std::cerr << "Error: --metric emd needs the " << HistogramType::name << ", "
+                  << MultiHistogramType::name << " or " << TextureType::name << " feature type" << std::endl;
+        return -1;
+    }
+    
+    // ROI queries compare against stored cell grids
+    if (useROI && featureType != GridType::name)
+    {
+        std::cerr << "Error: --roi needs the grid feature type (extract it with: "
+                  << "./extract_features <dir> data/" << GridType::defaultCSV << " " << GridType::name << ")" << std::endl;
+        return -1;
+    }
+    
     std::cout << "========================================" << std::endl;
     std::cout << "Image Retrieval Query" << std::endl;
     std::cout << "========================================" << std::endl;
@@ -102,6 +395,16 @@ int main(int argc, char *argv[])
     std::cout << "Feature database: " << featureCSV << std::endl;
     std::cout << "Number of matches: " << numMatches << std::endl;
     std::cout << "Feature type: " << featureType << std::endl;
+    std::cout << "Distance kernels: " << distanceKernelName() << std::endl;
+    if (useEMD)
+    {
+        std::cout << "Metric: earth mover's distance (sliced approximation)" << std::endl;
+    }
+    if (useROI)
+    {
+        std::cout << "Region of interest: " << roi.x << "," << roi.y << " "
+                  << roi.width << "x" << roi.height << std::endl;
+    }
     if (!dnnCSV.empty())
     {
         std::cout << "DNN database: " << dnnCSV << std::endl;
@@ -122,8 +425,8 @@ int main(int argc, char *argv[])
     std::vector<float> targetFeature;
     std::vector<float> targetDNNFeature;  // For custom feature type
     
-    // For non-DNN and non-custom features, we need to load the image
-    if (featureType != "dnn" && featureType != "custom")
+    // Image-based types (everything but dnn) extract from the target image
+    if (extractTarget != nullptr)
     {
         std::cout << "Loading target image..." << std::endl;
         
@@ -137,33 +440,12 @@ int main(int argc, char *argv[])
         
         std::cout << "Target image size: " << targetImage.cols << "x" << targetImage.rows << std::endl;
         
-        std::cout << "Extracting features from target image..." << std::endl;
-        
-        int result;
+        std::cout << "Extracting " << featureType << " features from target image..." << std::endl;
         
-        if (featureType == "baseline")
-        {
-            result = extractBaselineFeature(targetImage, targetFeature);
-        }
-        else if (featureType == "histogram")
-        {
-            result = extractRGChromaticityHistogram(targetImage, targetFeature);
-        }
-        else if (featureType == "multihistogram")
-        {
-            result = extractMultiHistogram(targetImage, targetFeature);
-        }
-        else if (featureType == "texture")
-        {
-            result = extractTextureColorFeature(targetImage, targetFeature);
-        }
-        else
-        {
-            std::cerr << "Error: Unknown feature type: " << featureType << std::endl;
-            return -1;
-        }
-        
-        if (result != 0)
+        ExtractionWorkspace workspace;
+        int status = useROI ? extractGridROIQuery(targetImage, roi, targetFeature, workspace)
+                            : extractTarget(targetImage, targetFeature, workspace);
+        if (status != 0)
         {
             std::cerr << "Error: Failed to extract features from target image" << std::endl;
             return -1;
@@ -171,36 +453,13 @@ int main(int argc, char *argv[])
         
         std::cout << "Target feature size: " << targetFeature.size() << " values" << std::endl;
         std::cout << std::endl;
-    }
-    else if (featureType == "custom")
-    {
-        // For custom features, load the image and extract custom features
-        std::cout << "Loading target image..." << std::endl;
-        
-        targetImage = cv::imread(targetImagePath);
         
-        if (targetImage.empty())
-        {
-            std::cerr << "Error: Failed to load target image: " << targetImagePath << std::endl;
-            return -1;
-        }
-        
-        std::cout << "Target image size: " << targetImage.cols << "x" << targetImage.rows << std::endl;
-        
-        std::cout << "Extracting custom features from target image..." << std::endl;
-        
-        if (extractCustomBlueSceneFeature(targetImage, targetFeature) != 0)
+        if (needsDNN)
         {
-            std::cerr << "Error: Failed to extract custom features from target image" << std::endl;
-            return -1;
+            // Will load DNN features from CSV later
+            std::cout << "Will load DNN features from CSV for target image" << std::endl;
+            std::cout << std::endl;
         }
-        
-        std::cout << "Target custom feature size: " << targetFeature.size() << " values" << std::endl;
-        std::cout << std::endl;
-        
-        // Will load DNN features from CSV later
-        std::cout << "Will load DNN features from CSV for target image" << std::endl;
-        std::cout << std::endl;
     }
     else
     {
@@ -229,8 +488,13 @@ int main(int argc, char *argv[])
     std::cout << "Loaded " << database.size() << " feature vectors from database" << std::endl;
     std::cout << std::endl;
     
+    if (!allVsAllCSV.empty())
+    {
+        return runAllVsAll(database, numMatches, allVsAllCSV) == 0 ? 0 : -1;
+    }
+    
     // For DNN features, extract target feature from database
-    if (featureType == "dnn")
+    if (extractTarget == nullptr)
     {
         std::cout << "Searching for target image in database..." << std::endl;
         
@@ -261,8 +525,9 @@ int main(int argc, char *argv[])
     // === Step 4: Load DNN database for custom features ===
     
     std::vector<FeatureData> dnnDatabase;
+    std::vector<const std::vector<float> *> dnnRows;  // dnnRows[i] = DNN embedding of database[i]
     
-    if (featureType == "custom")
+    if (needsDNN)
     {
         std::cout << "Loading DNN feature database from CSV..." << std::endl;
         
@@ -281,161 +546,142 @@ int main(int argc, char *argv[])
         std::cout << "Loaded " << dnnDatabase.size() << " DNN feature vectors" << std::endl;
         std::cout << std::endl;
         
+        // Index by filename once, instead of searching the DNN database per row
+        DNNIndex dnnIndex;
+        buildDNNIndex(dnnDatabase, dnnIndex);
+        
         // Find target DNN features
         std::cout << "Searching for target image in DNN database..." << std::endl;
         
-        bool found = false;
-        
-        for (const auto &data : dnnDatabase)
-        {
-            if (data.filename == targetFilename)
-            {
-                targetDNNFeature = data.feature;
-                found = true;
-                std::cout << "Found target DNN features: " << targetFilename << std::endl;
-                std::cout << "Target DNN feature size: " << targetDNNFeature.size() << " values" << std::endl;
-                std::cout << std::endl;
-                break;
-            }
-        }
-        
-        if (!found)
+        auto target = dnnIndex.find(targetFilename);
+        if (target == dnnIndex.end())
         {
             std::cerr << "Error: Target image '" << targetFilename 
                       << "' not found in DNN feature database" << std::endl;
             return -1;
         }
+        
+        targetDNNFeature = *target->second;
+        std::cout << "Found target DNN features: " << targetFilename << std::endl;
+        std::cout << "Target DNN feature size: " << targetDNNFeature.size() << " values" << std::endl;
+        std::cout << std::endl;
+        
+        int missing = alignDNNRows(database, dnnIndex, dnnRows);
+        if (missing > 0)
+        {
+            std::cerr << "Warning: DNN features not found for " << missing << " database images" << std::endl;
+        }
     }
     
     // === Step 5: Compare target to all database images ===
     
     std::cout << "Computing distances to all database images..." << std::endl;
     
-    std::vector<MatchResult> results;
-    results.reserve(database.size());  // Reserve space for efficiency
+    MatchSelection selection;
+    int skipped = 0;
+    
+    // Only the top matches are printed (at least 4 for the pic.1016 check),
+    // plus the 3 least similar for custom features
+    size_t keepBest = static_cast<size_t>(std::max(numMatches, 4));
+    size_t keepWorst = needsDNN ? 3 : 0;
     
-    for (size_t i = 0; i < database.size(); i++)
+    if (int8Rescore > 0)
     {
-        // Compute distance based on feature type
-        float dist;
-        
-        if (featureType == "baseline")
-        {
-            // Task 1: Sum of Squared Differences
-            dist = distanceSSD(targetFeature, database[i].feature);
-        }
-        else if (featureType == "histogram")
-        {
-            // Task 2: Histogram Intersection
-            dist = distanceHistogramIntersection(targetFeature, database[i].feature);
-        }
-        else if (featureType == "multihistogram")
-        {
-            // Task 3: Weighted Multi-Histogram (2 histograms: top + bottom)
-            std::vector<float> weights = {0.5f, 0.5f};
-            dist = distanceMultiHistogram(targetFeature, database[i].feature, 2, weights);
-        }
-        else if (featureType == "texture")
-        {
-            // Task 4: Color + Texture
-            dist = distanceTextureColor(targetFeature, database[i].feature, 256, 16, 0.5f, 0.5f);
-        }
-        else if (featureType == "dnn")
-        {
-            // Task 5: Cosine Distance for DNN embeddings
-            dist = distanceCosine(targetFeature, database[i].feature);
-        }
-        else if (featureType == "custom")
+        skipped = runInt8Query(targetFeature, database, keepBest, static_cast<size_t>(int8Rescore),
+                               int8Recall, selection);
+        if (skipped < 0)
+            return -1;
+    }
+    else
+    {
+        // One scan loop per feature type, each calling its distance function directly
+        // over the rows packed back to back
+        dispatchFeatureType(featureType, [&](auto type)
         {
-            // Task 7: Custom blue scene detector
-            // Need to find corresponding DNN features for this database image
+            using Type = decltype(type);
             
-            std::vector<float> dbDNNFeature;
-            bool foundDNN = false;
-            
-            for (const auto &dnnData : dnnDatabase)
+            // EMD: scan the rows' signatures by L1 distance
+            if constexpr (HasEmdMetric<Type>::value)
             {
-                if (dnnData.filename == database[i].filename)
+                if (useEMD)
                 {
-                    dbDNNFeature = dnnData.feature;
-                    foundDNN = true;
-                    break;
+                    FeatureMatrix signatures;
+                    std::vector<float> targetSignature;
+                    packEmdSignatures<Type>(database, signatures);
+                    if (emdTargetSignature<Type>(targetFeature, targetSignature) != 0)
+                    {
+                        skipped = static_cast<int>(database.size());
+                        return;
+                    }
+                    skipped = selectFeatureMatches<EmdMetric<Type>>(targetSignature, signatures, database,
+                                                                    keepBest, keepWorst, selection);
+                    return;
                 }
             }
             
-            if (!foundDNN)
-            {
-                std::cerr << "Warning: DNN features not found for " << database[i].filename << std::endl;
-                continue;
-            }
-            
-            // Compute custom distance combining custom features + DNN
-            dist = distanceCustomBlueScene(targetFeature, database[i].feature,
-                                          targetDNNFeature, dbDNNFeature);
-        }
-        else
-        {
-            std::cerr << "Error: Unknown feature type: " << featureType << std::endl;
-            return -1;
-        }
-        
-        // Check for error (negative distance indicates error)
-        if (dist < 0)
-        {
-            std::cerr << "Warning: Error computing distance for " << database[i].filename << std::endl;
-            continue;
-        }
-        
-        // Store result
-        MatchResult match;
-        match.filename = database[i].filename;
-        match.distance = dist;
-        results.push_back(match);
-        
-        // Show progress for large databases
-        if ((i + 1) % 100 == 0)
-        {
-            std::cout << "\rProgress: " << (i + 1) << "/" << database.size() << std::flush;
-        }
+            FeatureMatrix matrix;
+            packFeatureDatabase<Type>(database, matrix);
+            skipped = selectFeatureMatches<Type>(targetFeature, matrix, database, keepBest, keepWorst,
+                                                 selection, targetDNNFeature, dnnRows);
+        });
     }
     
-    if ((database.size() >= 100))
+    if (skipped > 0)
     {
-        std::cout << "\rProgress: " << database.size() << "/" << database.size() << std::endl;
+        std::cerr << "Warning: Skipped " << skipped << " database images (wrong length, missing DNN features or distance error)" << std::endl;
     }
     
-    std::cout << "Computed " << results.size() << " distances" << std::endl;
+    std::cout << "Ranked " << selection.ranked << " database images" << std::endl;
     std::cout << std::endl;
     
-    // === Step 6: Sort results by distance (ascending) ===
+    // === Step 6: Nearest matches, sorted by distance (ascending) ===
     
-    std::cout << "Sorting results by distance..." << std::endl;
-    
-    // Sort using the comparison operator defined in MatchResult
-    // This sorts in ascending order (smallest distance first)
-    std::sort(results.begin(), results.end());
-    
-    std::cout << "Sorting complete" << std::endl;
+    // The scan kept only the best few in bounded heaps, so there is no full sort
+    const std::vector<MatchResult> &results = selection.best;
     
     // === Step 7: Display top N matches ===
     
     printTopMatches(results, numMatches);
     
+    // For ROI queries, report where in each top match the region was found
+    if (useROI)
+    {
+        std::unordered_map<std::string, const std::vector<float> *> rows;
+        for (const auto &data : database)
+        {
+            rows.emplace(data.filename, &data.feature);
+        }
+        
+        std::cout << "Best matching window (cells of the " << GridType::gridSize << "x"
+                  << GridType::gridSize << " grid, rows x columns):" << std::endl;
+        
+        for (int i = 0; i < numMatches && i < static_cast<int>(results.size()); i++)
+        {
+            GridWindow window;
+            distanceGridWindow(targetFeature, *rows[results[i].filename],
+                               GridType::gridSize, GridType::cellBins, &window);
+            std::cout << "  " << results[i].filename << ": rows " << window.row0 << "-" << window.row1 - 1
+                      << ", columns " << window.col0 << "-" << window.col1 - 1 << std::endl;
+        }
+        std::cout << std::endl;
+    }
+    
     // === Step 8: For custom features, also show some least similar (optional but helpful) ===
     
-    if (featureType == "custom" && static_cast<int>(results.size()) > numMatches)
+    if (needsDNN && static_cast<int>(selection.ranked) > numMatches)
     {
         std::cout << "\n======================================" << std::endl;
         std::cout << "Bottom 3 matches (least similar):" << std::endl;
         std::cout << "======================================" << std::endl;
         
-        int start = std::max(0, static_cast<int>(results.size()) - 3);
-        for (int i = start; i < static_cast<int>(results.size()); i++)
+        // Ranks count from the nearest match, as in a full sort
+        size_t start = selection.ranked - selection.worst.size();
+        for (size_t i = 0; i < selection.worst.size(); i++)
         {
-            std::cout << std::setw(2) << (i + 1) << ". " 
-                      << std::setw(20) << std::left << results[i].filename 
+            std::cout << std::setw(2) << (start + i + 1) << ". " 
+                      << std::setw(20) << std::left << selection.worst[i].filename 
                       << " (distance: " << std::fixed << std::setprecision(6) 
-                      << results[i].distance << ")" << std::endl;
+                      << selection.worst[i].distance << ")" << std::endl;
         }
         std::cout << "======================================\n" << std::endl;
     }
@@ -0,0 +1,197 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: quantized_search.cpp
+ *
+ * Purpose:
+ * int8 quantized cosine search with float rescoring (see quantized_search.h).
+ */
+
+#include "quantized_search.h"
+#include "distance_simd.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Rows scored per int8 batch call (scores stay in L1)
+static const size_t INT8_BLOCK_ROWS = 256;
+
+/**
+ * Quantize one vector to int8 with a symmetric per-vector scale
+ */
+float quantizeInt8(const float *values, size_t n, int8_t *codes)
+{
+    float maxAbs = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        maxAbs = std::max(maxAbs, std::fabs(values[i]));
+    }
+
+    if (maxAbs == 0.0f)
+    {
+        std::fill(codes, codes + n, static_cast<int8_t>(0));
+        return 0.0f;
+    }
+
+    float scale = maxAbs / 127.0f;
+    float inverse = 127.0f / maxAbs;
+    for (size_t i = 0; i < n; i++)
+    {
+        float code = std::nearbyint(values[i] * inverse);
+        codes[i] = static_cast<int8_t>(std::max(-127.0f, std::min(127.0f, code)));
+    }
+    return scale;
+}
+
+/**
+ * Quantize every row of a packed matrix
+ */
+void quantizeFeatureMatrix(const FeatureMatrix &matrix, QuantizedMatrix &quantized)
+{
+    quantized.rows = matrix.rows;
+    quantized.dim = matrix.dim;
+    quantized.codes.resize(matrix.rows * matrix.dim);
+    quantized.scales.resize(matrix.rows);
+
+    for (size_t r = 0; r < matrix.rows; r++)
+    {
+        quantized.scales[r] = quantizeInt8(matrix.row(r), matrix.dim, quantized.codes.data() + r * matrix.dim);
+    }
+}
+
+/**
+ * k nearest rows by cosine distance: int8 scan, then float rescoring
+ */
+int cosineTopKInt8(FeatureView query, const FeatureMatrix &matrix, const QuantizedMatrix &quantized,
+                   size_t k, size_t rescore, std::vector<BatchMatch> &matches)
+{
+    // === Step 1: Validate input ===
+
+    if (query.size != matrix.dim || quantized.dim != matrix.dim || quantized.rows != matrix.rows)
+    {
+        std::cerr << "Error: Query, embedding matrix and its int8 copy have different shapes" << std::endl;
+        return -1;
+    }
+
+    if (matrix.norms.size() != matrix.rows)
+    {
+        std::cerr << "Error: Embedding matrix needs its row norms (pack it with packFeatureDatabase)" << std::endl;
+        return -1;
+    }
+
+    matches.clear();
+    if (k == 0 || matrix.rows == 0)
+        return 0;
+
+    size_t keep = std::min(k, matrix.rows);
+    size_t candidates = std::min(std::max(rescore, keep), matrix.rows);
+
+    // === Step 2: Quantize the query ===
+
+    std::vector<int8_t> queryCodes(query.size);
+    float queryScale = quantizeInt8(query.data, query.size, queryCodes.data());
+
+    float queryNorm;
+    computeRowNorms(query.data, query.size, 1, &queryNorm);
+
+    // === Step 3: int8 scan, keeping the `candidates` nearest estimates ===
+
+    // cos = (q . r) / (|q| |r|) with q . r ~ dot(codes) * scale_q * scale_r
+    std::vector<BatchMatch> heap;
+    heap.reserve(candidates);
+    int32_t dots[INT8_BLOCK_ROWS];
+
+    for (size_t r0 = 0; r0 < matrix.rows; r0 += INT8_BLOCK_ROWS)
+    {
+        size_t count = std::min(INT8_BLOCK_ROWS, matrix.rows - r0);
+        kernelDotInt8Batch(queryCodes.data(), quantized.row(r0), matrix.dim, count, dots);
+
+        for (size_t r = 0; r < count; r++)
+        {
+            float rowNorm = matrix.norms[r0 + r];
+            float distance = 1.0f;  // Maximum distance for zero-length vectors, as in distanceCosine
+
+            if (queryNorm >= 1e-10f && rowNorm >= 1e-10f)
+            {
+                float similarity = dots[r] * (queryScale * quantized.scales[r0 + r]) / (queryNorm * rowNorm);
+                distance = 1.0f - std::max(-1.0f, std::min(1.0f, similarity));
+            }
+
+            keepNearest(heap, BatchMatch{r0 + r, distance}, candidates);
+        }
+    }
+
+    // === Step 4: Rescore the candidates in float ===
+
+    matches.reserve(keep);
+    for (const BatchMatch &candidate : heap)
+    {
+        float distance = distanceCosine(query, FeatureView(matrix.row(candidate.row), matrix.dim));
+        keepNearest(matches, BatchMatch{candidate.row, distance}, keep);
+    }
+
+    std::sort_heap(matches.begin(), matches.end(), nearerMatch);
+    return 0;
+}
+
+/**
+ * Recall@k of cosineTopKInt8 against the exact float scan
+ */
+double measureInt8Recall(const FeatureMatrix &matrix, const QuantizedMatrix &quantized,
+                         size_t k, size_t rescore, size_t numQueries)
+{
+    if (matrix.rows < 2 || k == 0 || numQueries == 0)
+    {
+        std::cerr << "Error: Recall needs at least 2 rows, k > 0 and one query" << std::endl;
+        return -1.0;
+    }
+
+    numQueries = std::min(numQueries, matrix.rows);
+    size_t keep = std::min(k, matrix.rows - 1);
+    std::vector<float> distances(matrix.rows);
+    double totalRecall = 0.0;
+
+    for (size_t q = 0; q < numQueries; q++)
+    {
+        size_t queryRow = q * matrix.rows / numQueries;
+        FeatureView query(matrix.row(queryRow), matrix.dim);
+
+        // === Float baseline: every row, the k nearest other than the query ===
+
+        distanceCosineBatch(query, matrix.data.data(), matrix.norms.data(), matrix.rows, distances.data());
+        std::vector<BatchMatch> exact;
+        exact.reserve(keep);
+        for (size_t r = 0; r < matrix.rows; r++)
+        {
+            if (r != queryRow)
+                keepNearest(exact, BatchMatch{r, distances[r]}, keep);
+        }
+
+        // === int8 search for one more, then drop the query's own row ===
+
+        std::vector<BatchMatch> approx;
+        if (cosineTopKInt8(query, matrix, quantized, keep + 1, rescore, approx) != 0)
+            return -1.0;
+
+        approx.erase(std::remove_if(approx.begin(), approx.end(),
+                                    [&](const BatchMatch &m) { return m.row == queryRow; }),
+                     approx.end());
+        approx.resize(std::min(approx.size(), keep));
+
+        size_t found = 0;
+        for (const BatchMatch &m : approx)
+        {
+            for (const BatchMatch &e : exact)
+            {
+                if (e.row == m.row)
+                {
+                    found++;
+                    break;
+                }
+            }
+        }
+        totalRecall += static_cast<double>(found) / keep;
+    }
+
+    return totalRecall / numQueries;
+}
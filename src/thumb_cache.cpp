@@ -0,0 +1,331 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: thumb_cache.cpp
+ *
+ * Purpose:
+ * Implementation of the packed thumbnail cache (see thumb_cache.h).
+ */
+
+#include "thumb_cache.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+// File header: magic, format version, long side
+static const char THUMB_CACHE_MAGIC[8] = {'C', 'B', 'I', 'R', 'T', 'H', 'M', 'B'};
+static const uint32_t THUMB_CACHE_VERSION = 1;
+static const size_t THUMB_CACHE_HEADER_SIZE = 16;
+
+// ========================================
+// Little-endian helpers
+// ========================================
+
+static void putU16(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void putU32(std::vector<uint8_t> &out, uint32_t value)
+{
+    putU16(out, value & 0xFFFF);
+    putU16(out, value >> 16);
+}
+
+static uint32_t getU16(const uint8_t *p)
+{
+    return p[0] | (static_cast<uint32_t>(p[1]) << 8);
+}
+
+static uint32_t getU32(const uint8_t *p)
+{
+    return getU16(p) | (getU16(p + 2) << 16);
+}
+
+/**
+ * Read a whole file into memory
+ * @return 0 on success, -1 on error
+ */
+static int readWholeFile(const std::string &path, std::vector<uint8_t> &data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open thumbnail cache: " << path << std::endl;
+        return -1;
+    }
+
+    file.seekg(0, std::ios::end);
+    data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0, std::ios::beg);
+
+    if (!data.empty() && !file.read(reinterpret_cast<char *>(data.data()), data.size()))
+    {
+        std::cerr << "Error: Could not read thumbnail cache: " << path << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Check the header and index every complete record
+ *
+ * @param data Whole cache file
+ * @param path File name for error messages
+ * @param entries Output: one entry per complete record
+ * @param end Output: byte offset just past the last complete record
+ * @return 0 on success, -1 if the header is not a thumbnail cache of
+ *         this version and THUMB_CACHE_LONG_SIDE
+ *
+ * A truncated last record is not an error here; it simply ends the index.
+ */
+static int indexRecords(const std::vector<uint8_t> &data, const std::string &path,
+                        std::vector<ThumbnailCacheEntry> &entries, size_t &end)
+{
+    entries.clear();
+
+    if (data.size() < THUMB_CACHE_HEADER_SIZE ||
+        !std::equal(THUMB_CACHE_MAGIC, THUMB_CACHE_MAGIC + 8, data.begin()))
+    {
+        std::cerr << "Error: Not a thumbnail cache: " << path << std::endl;
+        return -1;
+    }
+
+    if (getU32(data.data() + 8) != THUMB_CACHE_VERSION)
+    {
+        std::cerr << "Error: Unsupported thumbnail cache version in " << path << std::endl;
+        return -1;
+    }
+
+    // Thumbnails of another size would silently change every feature
+    // extracted from (or appended to) this cache
+    uint32_t longSide = getU32(data.data() + 12);
+    if (longSide != static_cast<uint32_t>(THUMB_CACHE_LONG_SIDE))
+    {
+        std::cerr << "Error: " << path << " holds " << longSide << " px thumbnails, expected "
+                  << THUMB_CACHE_LONG_SIDE << " px; rebuild the cache" << std::endl;
+        return -1;
+    }
+
+    size_t pos = THUMB_CACHE_HEADER_SIZE;
+    end = pos;
+
+    while (pos + 4 <= data.size())
+    {
+        size_t keyLength = getU32(data.data() + pos);
+        size_t headerEnd = pos + 4 + keyLength + 4;
+        if (headerEnd > data.size())
+            break;
+
+        ThumbnailCacheEntry entry;
+        entry.key.assign(reinterpret_cast<const char *>(data.data() + pos + 4), keyLength);
+        entry.width = static_cast<int>(getU16(data.data() + pos + 4 + keyLength));
+        entry.height = static_cast<int>(getU16(data.data() + pos + 4 + keyLength + 2));
+        entry.offset = headerEnd;
+
+        size_t recordEnd = headerEnd + static_cast<size_t>(entry.width) * entry.height * 3;
+        if (recordEnd > data.size())
+            break;
+
+        entries.push_back(std::move(entry));
+        pos = recordEnd;
+        end = pos;
+    }
+
+    return 0;
+}
+
+// ========================================
+// Thumbnails
+// ========================================
+
+/**
+ * Downsample an image for the thumbnail cache
+ */
+int makeCacheThumbnail(const cv::Mat &src, cv::Mat &dst)
+{
+    if (src.empty() || src.type() != CV_8UC3)
+    {
+        std::cerr << "Error: Thumbnail source must be a non-empty BGR image" << std::endl;
+        return -1;
+    }
+
+    int longSide = std::max(src.cols, src.rows);
+    if (longSide <= THUMB_CACHE_LONG_SIDE)
+    {
+        src.copyTo(dst);
+        return 0;
+    }
+
+    // INTER_AREA averages every source pixel, so colour proportions
+    // (what the histogram features measure) are preserved
+    double scale = static_cast<double>(THUMB_CACHE_LONG_SIDE) / longSide;
+    cv::Size size(std::max(1, static_cast<int>(src.cols * scale + 0.5)),
+                  std::max(1, static_cast<int>(src.rows * scale + 0.5)));
+    cv::resize(src, dst, size, 0, 0, cv::INTER_AREA);
+    return 0;
+}
+
+// ========================================
+// ThumbnailCacheWriter
+// ========================================
+
+/**
+ * Open a cache for writing (new file, or append to an existing one)
+ */
+int ThumbnailCacheWriter::open(const std::string &path, bool append,
+                               std::unordered_set<std::string> &cachedKeys)
+{
+    cachedKeys.clear();
+    cachePath = path;
+    newRecords = 0;
+
+    if (append && fs::exists(cachePath))
+    {
+        // === Index the existing records and cut off a partial tail ===
+
+        std::vector<uint8_t> data;
+        std::vector<ThumbnailCacheEntry> entries;
+        size_t end = 0;
+
+        if (readWholeFile(cachePath, data) != 0 ||
+            indexRecords(data, cachePath, entries, end) != 0)
+        {
+            return -1;
+        }
+
+        if (end < data.size())
+        {
+            std::error_code ec;
+            fs::resize_file(cachePath, end, ec);
+            if (ec)
+            {
+                std::cerr << "Error: Could not truncate " << cachePath << ": " << ec.message() << std::endl;
+                return -1;
+            }
+            std::cout << "Thumbnail cache " << cachePath << ": dropped a partial last record" << std::endl;
+        }
+
+        for (const auto &entry : entries)
+        {
+            cachedKeys.insert(entry.key);
+        }
+
+        std::cout << "Appending to thumbnail cache " << cachePath << " ("
+                  << entries.size() << " thumbnails)" << std::endl;
+
+        file.open(cachePath, std::ios::binary | std::ios::app);
+    }
+    else
+    {
+        file.open(cachePath, std::ios::binary | std::ios::trunc);
+
+        std::vector<uint8_t> header(THUMB_CACHE_MAGIC, THUMB_CACHE_MAGIC + 8);
+        putU32(header, THUMB_CACHE_VERSION);
+        putU32(header, THUMB_CACHE_LONG_SIDE);
+        file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    }
+
+    if (!file.is_open() || !file)
+    {
+        std::cerr << "Error: Could not open thumbnail cache for writing: " << cachePath << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Append one thumbnail record
+ */
+int ThumbnailCacheWriter::write(const std::string &key, const cv::Mat &thumbnail)
+{
+    if (thumbnail.type() != CV_8UC3 || thumbnail.cols > 0xFFFF || thumbnail.rows > 0xFFFF)
+    {
+        std::cerr << "Error: Cannot cache thumbnail of " << key << " (must be BGR, < 65536 px)" << std::endl;
+        return -1;
+    }
+
+    std::vector<uint8_t> header;
+    putU32(header, static_cast<uint32_t>(key.size()));
+    header.insert(header.end(), key.begin(), key.end());
+    putU16(header, static_cast<uint32_t>(thumbnail.cols));
+    putU16(header, static_cast<uint32_t>(thumbnail.rows));
+
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+
+    // Row by row, since the thumbnail may be a non-continuous view
+    for (int row = 0; row < thumbnail.rows; row++)
+    {
+        file.write(reinterpret_cast<const char *>(thumbnail.ptr<uint8_t>(row)),
+                   static_cast<std::streamsize>(thumbnail.cols) * 3);
+    }
+
+    if (!file)
+    {
+        std::cerr << "Error: Failed to write thumbnail cache: " << cachePath << std::endl;
+        return -1;
+    }
+
+    newRecords++;
+    return 0;
+}
+
+/**
+ * Flush and close the cache file
+ */
+int ThumbnailCacheWriter::close()
+{
+    if (!file.is_open())
+        return 0;
+
+    file.flush();
+    bool ok = static_cast<bool>(file);
+    file.close();
+
+    if (!ok)
+    {
+        std::cerr << "Error: Failed to write thumbnail cache: " << cachePath << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// ========================================
+// ThumbnailCache
+// ========================================
+
+/**
+ * Load a whole cache file into memory and index its records
+ */
+int ThumbnailCache::load(const std::string &path)
+{
+    size_t end = 0;
+
+    if (readWholeFile(path, data) != 0 ||
+        indexRecords(data, path, entries, end) != 0)
+    {
+        return -1;
+    }
+
+    if (end < data.size())
+    {
+        std::cerr << "Warning: " << path << " ends in a partial record (ignored)" << std::endl;
+    }
+
+    return 0;
+}
+
+/**
+ * Thumbnail i as a view into the loaded bytes
+ */
+cv::Mat ThumbnailCache::image(size_t i) const
+{
+    const ThumbnailCacheEntry &entry = entries[i];
+    // Read-only in practice: the extractors take const cv::Mat &
+    return cv::Mat(entry.height, entry.width, CV_8UC3,
+                   const_cast<uint8_t *>(data.data() + entry.offset));
+}
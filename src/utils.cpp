@@ -15,6 +15,8 @@
 #include <iomanip>
 #include <algorithm>
 #include <filesystem>
+#include <cctype>
+#include <limits>
 
 namespace fs = std::filesystem;
 
@@ -176,6 +178,244 @@ int readFeaturesFromCSV(const std::string &filename,
     return 0;
 }
 
+/**
+ * Pack the rows of a feature database into a FeatureMatrix
+ */
+int buildFeatureMatrix(const std::vector<FeatureData> &db, size_t dim,
+                       FeatureMatrix &matrix)
+{
+    int skipped = 0;
+    
+    matrix.rows = 0;
+    matrix.dim = dim;
+    matrix.data.clear();
+    matrix.source.clear();
+    matrix.norms.clear();
+    matrix.data.reserve(db.size() * dim);
+    matrix.source.reserve(db.size());
+    
+    for (size_t i = 0; i < db.size(); i++)
+    {
+        if (db[i].feature.size() != dim)
+        {
+            skipped++;
+            continue;
+        }
+        
+        matrix.data.insert(matrix.data.end(), db[i].feature.begin(), db[i].feature.end());
+        matrix.source.push_back(i);
+    }
+    
+    matrix.rows = matrix.source.size();
+    return skipped;
+}
+
+/**
+ * Open the CSV for writing, or resume an interrupted run
+ * @param path Output CSV filename
+ * @param resume Keep committed rows from an interrupted run
+ * @param committedKeys Output: keys (filenames) already in the CSV
+ * @return 0 on success, -1 on error
+ *
+ * Implementation details:
+ *  - Reads "<csv>.progress" (rows N / bytes B) if it exists
+ *  - Truncates the CSV to B bytes, so a row cut off by the crash is dropped
+ *  - Collects the key (text before the first comma) of every kept row and
+ *    checks the count against the marker
+ *  - Reopens the CSV in append mode and writes a fresh marker right away
+ */
+int FeatureCSVWriter::open(const std::string &path, bool resume,
+                           std::unordered_set<std::string> &committedKeys)
+{
+    committedKeys.clear();
+    csvPath = path;
+    progressPath = path + ".progress";
+    rowCount = 0;
+    newRows = 0;
+    sinceCheckpoint = 0;
+
+    bool resuming = resume && fs::exists(csvPath);
+
+    if (resuming)
+    {
+        std::ifstream marker(progressPath);
+        size_t markerRows = 0;
+        bool haveMarker = marker.is_open();
+
+        if (haveMarker)
+        {
+            std::string label1, label2;
+            std::uintmax_t committedBytes = 0;
+
+            if (!(marker >> label1 >> markerRows >> label2 >> committedBytes) ||
+                label1 != "rows" || label2 != "bytes")
+            {
+                std::cerr << "Error: Malformed progress marker: " << progressPath << std::endl;
+                return -1;
+            }
+
+            if (committedBytes > fs::file_size(csvPath))
+            {
+                std::cerr << "Error: " << csvPath << " is shorter than its last checkpoint" << std::endl;
+                return -1;
+            }
+
+            // Drop everything written after the last checkpoint
+            std::error_code ec;
+            fs::resize_file(csvPath, committedBytes, ec);
+            if (ec)
+            {
+                std::cerr << "Error: Could not truncate " << csvPath << ": " << ec.message() << std::endl;
+                return -1;
+            }
+        }
+
+        std::ifstream existing(csvPath);
+        std::string line;
+        while (std::getline(existing, line))
+        {
+            if (line.empty())
+                continue;
+
+            committedKeys.insert(line.substr(0, line.find(',')));
+            rowCount++;
+        }
+
+        if (haveMarker && rowCount != markerRows)
+        {
+            std::cerr << "Error: " << csvPath << " has " << rowCount << " rows but its checkpoint says "
+                      << markerRows << std::endl;
+            return -1;
+        }
+
+        std::cout << "Resuming " << csvPath << ": " << rowCount << " rows already committed"
+                  << (haveMarker ? "" : " (previous run finished)") << std::endl;
+
+        file.open(csvPath, std::ios::out | std::ios::app);
+    }
+    else
+    {
+        file.open(csvPath, std::ios::out | std::ios::trunc);
+    }
+
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file for writing: " << csvPath << std::endl;
+        return -1;
+    }
+
+    // Same formatting as writeFeaturesToCSV (6 decimal places)
+    file << std::fixed << std::setprecision(6);
+
+    return checkpoint();
+}
+
+/**
+ * Append one row; checkpoints automatically every checkpointEvery rows
+ */
+int FeatureCSVWriter::write(const FeatureData &data)
+{
+    return write(data.filename, data.feature);
+}
+
+/**
+ * Append one row from a key and a feature vector
+ */
+int FeatureCSVWriter::write(const std::string &key, const std::vector<float> &feature)
+{
+    file << key;
+    for (float value : feature)
+    {
+        file << "," << value;
+    }
+    file << '\n';
+
+    if (!file)
+    {
+        std::cerr << "Error: Failed writing to " << csvPath << std::endl;
+        return -1;
+    }
+
+    rowCount++;
+    newRows++;
+    sinceCheckpoint++;
+
+    if (checkpointEvery > 0 && sinceCheckpoint >= checkpointEvery)
+    {
+        return checkpoint();
+    }
+
+    return 0;
+}
+
+/**
+ * Flush the CSV and record the committed rows/bytes in the marker
+ *
+ * The marker is written to "<csv>.progress.tmp" and renamed over the old
+ * one, so a crash mid-checkpoint leaves the previous marker intact.
+ */
+int FeatureCSVWriter::checkpoint()
+{
+    file.flush();
+    if (!file)
+    {
+        std::cerr << "Error: Failed flushing " << csvPath << std::endl;
+        return -1;
+    }
+
+    std::error_code ec;
+    std::uintmax_t bytes = fs::file_size(csvPath, ec);
+    if (ec)
+    {
+        std::cerr << "Error: Could not stat " << csvPath << ": " << ec.message() << std::endl;
+        return -1;
+    }
+
+    std::string tempPath = progressPath + ".tmp";
+    {
+        std::ofstream marker(tempPath, std::ios::out | std::ios::trunc);
+        marker << "rows " << rowCount << "\n"
+               << "bytes " << bytes << "\n";
+        if (!marker)
+        {
+            std::cerr << "Error: Could not write progress marker: " << tempPath << std::endl;
+            return -1;
+        }
+    }
+
+    fs::rename(tempPath, progressPath, ec);
+    if (ec)
+    {
+        std::cerr << "Error: Could not update progress marker: " << ec.message() << std::endl;
+        return -1;
+    }
+
+    sinceCheckpoint = 0;
+    return 0;
+}
+
+/**
+ * Final checkpoint, close the CSV and remove the progress marker
+ */
+int FeatureCSVWriter::close()
+{
+    if (!file.is_open())
+        return 0;
+
+    if (checkpoint() != 0)
+        return -1;
+
+    file.close();
+
+    std::error_code ec;
+    fs::remove(progressPath, ec);
+
+    std::cout << "Successfully wrote " << rowCount
+              << " feature vectors to " << csvPath << std::endl;
+
+    return 0;
+}
+
 /**
  * Get all image filenames from a directory
  * Filters for common image extensions (.jpg, .jpeg, .png, .bmp)
@@ -243,6 +483,158 @@ int getImageFilenames(const std::string &dirPath,
     }
 }
 
+/**
+ * Check whether a path has a video file extension
+ */
+bool isVideoFile(const std::string &path)
+{
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    static const std::vector<std::string> videoExtensions = {".mp4", ".avi", ".mov", ".mkv", ".m4v", ".webm"};
+
+    return std::find(videoExtensions.begin(), videoExtensions.end(), ext) != videoExtensions.end();
+}
+
+/**
+ * Get all video filenames from a directory
+ * Mirrors getImageFilenames, filtering with isVideoFile
+ */
+int getVideoFilenames(const std::string &dirPath,
+                      std::vector<std::string> &filenames)
+{
+    // Clear output vector
+    filenames.clear();
+
+    try
+    {
+        // Check if directory exists
+        if (!fs::exists(dirPath) || !fs::is_directory(dirPath))
+        {
+            std::cerr << "Error: Directory does not exist: " << dirPath << std::endl;
+            return -1;
+        }
+
+        for (const auto &entry : fs::directory_iterator(dirPath))
+        {
+            if (entry.is_regular_file() && isVideoFile(entry.path().string()))
+            {
+                filenames.push_back(entry.path().filename().string());
+            }
+        }
+
+        // Sort filenames alphabetically for consistency
+        std::sort(filenames.begin(), filenames.end());
+
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error reading directory: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+/**
+ * Keep entry if it is among the keepBest nearest so far
+ */
+void MatchSelector::offerBest(const Entry &entry)
+{
+    if (best.size() < keepBest)
+    {
+        best.push_back(entry);
+        std::push_heap(best.begin(), best.end(), nearer);
+    }
+    else if (keepBest > 0 && nearer(entry, best.front()))
+    {
+        std::pop_heap(best.begin(), best.end(), nearer);
+        best.back() = entry;
+        std::push_heap(best.begin(), best.end(), nearer);
+    }
+}
+
+/**
+ * Keep entry if it is among the keepWorst farthest so far
+ */
+void MatchSelector::offerWorst(const Entry &entry)
+{
+    if (worst.size() < keepWorst)
+    {
+        worst.push_back(entry);
+        std::push_heap(worst.begin(), worst.end(), farther);
+    }
+    else if (keepWorst > 0 && farther(entry, worst.front()))
+    {
+        std::pop_heap(worst.begin(), worst.end(), farther);
+        worst.back() = entry;
+        std::push_heap(worst.begin(), worst.end(), farther);
+    }
+}
+
+/**
+ * Offer one database row to both heaps
+ */
+void MatchSelector::add(size_t item, float distance)
+{
+    Entry entry{distance, item};
+    offered++;
+    offerBest(entry);
+    offerWorst(entry);
+}
+
+/**
+ * Merge another selector's partial heaps: the k best of the union are
+ * among the k best of each part
+ */
+void MatchSelector::merge(const MatchSelector &other)
+{
+    for (const Entry &entry : other.best)
+    {
+        offerBest(entry);
+    }
+    for (const Entry &entry : other.worst)
+    {
+        offerWorst(entry);
+    }
+    offered += other.offered;
+}
+
+/**
+ * k-th best distance so far, once the nearest heap is full
+ */
+float MatchSelector::bound() const
+{
+    if (keepWorst > 0 || keepBest == 0 || best.size() < keepBest)
+    {
+        return std::numeric_limits<float>::infinity();
+    }
+    return best.front().distance;
+}
+
+/**
+ * Sort the kept rows and look up their filenames
+ */
+void MatchSelector::finish(const std::vector<FeatureData> &db, MatchSelection &selection) const
+{
+    std::vector<Entry> nearest(best), farthest(worst);
+    std::sort(nearest.begin(), nearest.end(), nearer);
+    std::sort(farthest.begin(), farthest.end(), nearer);
+    
+    selection.best.clear();
+    selection.worst.clear();
+    selection.ranked = offered;
+    
+    for (const Entry &entry : nearest)
+    {
+        selection.best.push_back(MatchResult{db[entry.item].filename, entry.distance});
+    }
+    for (const Entry &entry : farthest)
+    {
+        selection.worst.push_back(MatchResult{db[entry.item].filename, entry.distance});
+    }
+}
+
 /**
  * Print top N matches to console
  * Displays ranked results with distances in a readable format
@@ -0,0 +1,118 @@
+/*
+ * Name: Akash Shridhar Shetty, Skandhan Madhusudhana
+ * Date: February 2025
+ * File: video.cpp
+ *
+ * Purpose:
+ * Implementation of pipelined video frame sampling for feature extraction.
+ */
+
+#include "video.h"
+#include "features.h"
+#include "distance.h"
+#include "pipeline.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+/**
+ * One decoded frame travelling from the decode thread to the consumer
+ */
+struct DecodedFrame
+{
+    int index;
+    cv::Mat image;
+};
+
+std::string videoFrameKey(const std::string &videoFilename, int frameIndex)
+{
+    return videoFilename + "#" + std::to_string(frameIndex);
+}
+
+/**
+ * Coarse scene signature: 8x8 rg histogram of a small thumbnail
+ */
+static void sceneSignature(const cv::Mat &frame, cv::Mat &thumb,
+                           std::vector<float> &signature, ExtractionWorkspace &ws)
+{
+    const int THUMB_WIDTH = 64;
+    int thumbHeight = std::max(1, frame.rows * THUMB_WIDTH / std::max(1, frame.cols));
+    cv::resize(frame, thumb, cv::Size(THUMB_WIDTH, thumbHeight), 0, 0, cv::INTER_AREA);
+    extractRGChromaticityHistogram(thumb, signature, ws, 8);
+}
+
+int sampleVideoFrames(const std::string &path,
+                      const VideoSamplingOptions &options,
+                      const std::function<int(int, const cv::Mat &)> &onFrame)
+{
+    cv::VideoCapture capture(path);
+
+    if (!capture.isOpened())
+    {
+        std::cerr << "Error: Could not open video: " << path << std::endl;
+        return -1;
+    }
+
+    int stride = std::max(1, options.frameStride);
+    BoundedQueue<DecodedFrame> queue(options.queueDepth);
+
+    // === Decode thread: read, sample, and queue frames ===
+
+    std::thread decoder([&]()
+    {
+        ExtractionWorkspace ws;
+        cv::Mat thumb;
+        std::vector<float> signature;
+        std::vector<float> lastKeptSignature;
+
+        for (int index = 0; !queue.closed() && capture.grab(); index++)
+        {
+            // Only every stride-th frame is a candidate
+            if (index % stride != 0)
+                continue;
+
+            DecodedFrame frame;
+            frame.index = index;
+            if (!capture.retrieve(frame.image) || frame.image.empty())
+                continue;
+
+            // Scene change mode: drop candidates too similar to the last kept frame
+            if (options.sceneThreshold > 0.0f)
+            {
+                sceneSignature(frame.image, thumb, signature, ws);
+
+                if (!lastKeptSignature.empty() &&
+                    distanceHistogramIntersection(signature, lastKeptSignature) <= options.sceneThreshold)
+                    continue;
+
+                lastKeptSignature.swap(signature);
+            }
+
+            // push() fails once the consumer has stopped early
+            if (!queue.push(std::move(frame)))
+                break;
+        }
+
+        queue.close();
+    });
+
+    // === Consumer (calling thread): hand frames to the extractor ===
+
+    int keptFrames = 0;
+    DecodedFrame frame;
+
+    while (queue.pop(frame))
+    {
+        keptFrames++;
+        if (onFrame(frame.index, frame.image) != 0)
+        {
+            // Stop the decoder; it exits on its next push
+            queue.close();
+            break;
+        }
+    }
+
+    decoder.join();
+    return keptFrames;
+}